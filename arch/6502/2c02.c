@@ -1,20 +1,64 @@
+#include <string.h>
+
 #include "2c02.h"
+#include "host_timer.h"
+#include "logger.h"
+#include "nes_state.h"
+#include "probes.h"
 
 #include "debug.h"
-#include "palette.h"
 
 // PPU Implementation: Backgrounds and Sprites
-// - Static background rendering (no scrolling)
-// - Sprite evaluation and rendering
-// - Sprite 0 hit detection
-// - 4 background palettes + 4 sprite palettes
+// - CPU-visible timing: VBlank, NMI, sprite 0 hit and sprite overflow
+// - Every PPU-visible state change is logged for the renderer
+//   (2c02_render.c), which produces the pixels from the log
 
 // Debug logging control
 static int debug_frame_count = 0;
 static struct ppu2c02 ppu = {0};
 
+// Registers and memories of this PPU, in the machine state arena
+#define regs (nes_state->ppu_regs)
+#define mem (nes_state->ppu_mem)
+
+static uint8_t ppu_read(uint16_t addr);
+
+// Every mapper keeps the PPU-visible pattern memory in its CHR bank table,
+// so it is read from there directly rather than through the cartridge
+static inline uint8_t chr_read(uint16_t addr) {
+    return ppu.cart->map->chr[(addr >> 10) & 0x07][addr & 0x03ff];
+}
+
+static void copy_chr(uint8_t *dst) {
+    for (uint8_t slot = 0; slot < 8; slot++) {
+        memcpy(dst + slot * MAPPER_CHR_BANK_SIZE, ppu.cart->map->chr[slot],
+               MAPPER_CHR_BANK_SIZE);
+    }
+}
+
+// The mapper switched CHR banks, so hand the renderer the new pattern memory
+static void chr_switched(struct nes_cartridge *cartridge) {
+    uint8_t *chr = ppu_render_log_chr_bank(regs.scanline, regs.dot);
+
+    (void)cartridge;
+    if (!chr) {
+        return;
+    }
+
+    copy_chr(chr);
+}
+
+// The mapper switched the nametable mirroring
+static void mirroring_switched(struct nes_cartridge *cartridge) {
+    (void)cartridge;
+    ppu_render_log(regs.scanline, regs.dot, PPU_LOG_MIRRORING, 0,
+                   nes_state->mirroring);
+}
+
 static void connect_cartridge(struct nes_cartridge *cartridge) {
     ppu.cart = cartridge;
+    cartridge->chr_switched = chr_switched;
+    cartridge->mirroring_switched = mirroring_switched;
 }
 
 static uint16_t nametable_mirror(uint16_t addr) {
@@ -44,33 +88,7 @@ static uint16_t nametable_mirror(uint16_t addr) {
         return mirror_addr;
     }
 
-    // Normalize address to $2000-$2FFF range (handle mirrors)
-    addr = 0x2000 + ((addr - 0x2000) % 0x1000);
-
-    // Get nametable index (0-3)
-    uint8_t nametable = (addr >> 10) & 0x03; // Bits 10-11
-
-    if (ppu.cart->hdr->flags6.mirroring == 0) {
-        // Horizontal mirroring (vertical arrangement)
-        // $2000 = $2400, $2800 = $2C00
-        // Map: 0->0, 1->0, 2->1, 3->1
-        if (nametable == 0 || nametable == 1) {
-            mirror_addr = (addr & 0x03FF); // First 1KB
-        } else {
-            mirror_addr = 0x0400 | (addr & 0x03FF); // Second 1KB
-        }
-    } else {
-        // Vertical mirroring (horizontal arrangement)
-        // $2000 = $2800, $2400 = $2C00
-        // Map: 0->0, 1->1, 2->0, 3->1
-        if (nametable == 0 || nametable == 2) {
-            mirror_addr = (addr & 0x03FF); // First 1KB
-        } else {
-            mirror_addr = 0x0400 | (addr & 0x03FF); // Second 1KB
-        }
-    }
-
-    return mirror_addr;
+    return ppu_nametable_index(nes_state->mirroring, addr);
 }
 
 static uint8_t ppu_read(uint16_t addr) {
@@ -78,20 +96,20 @@ static uint8_t ppu_read(uint16_t addr) {
 
     if (addr < 0x2000) {
         // Pattern table (CHR ROM) - accessed through cartridge
-        if (ppu.cart && ppu.cart->ppu_read) {
-            data = ppu.cart->ppu_read(ppu.cart, addr);
+        if (ppu.cart && ppu.cart->map) {
+            data = chr_read(addr);
         } else {
             // Cartridge not loaded yet, return 0
             data = 0;
         }
     } else if (addr >= 0x2000 && addr <= 0x3eff) {
-        printf("nametable read %04x\n", addr);
-        data = ppu.nametable[nametable_mirror(addr)];
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "Nametable read %04x", addr);
+        data = mem.nametable[nametable_mirror(addr)];
 
     } else if (addr >= 0x3f00 && addr <= 0x3fff) {
         // palette
-        printf("Palette READ\n");
-        data = ppu.palette_table[addr & 0x1f];
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "Palette read %04x", addr);
+        data = mem.palette_table[addr & 0x1f];
     } else if (addr >= 0x4000) {
         // [0x4000, 0xFFFF]
         // 	These addresses are mirrors of the the of the
@@ -107,18 +125,28 @@ static void ppu_write(uint16_t addr, uint8_t data) {
     if (addr < 0x2000) {
         // Pattern table (CHR ROM/RAM) - accessed through cartridge
         if (ppu.cart && ppu.cart->ppu_write) {
+            HOST_TIMER_ENTER(HOST_PHASE_MAPPER);
             ppu.cart->ppu_write(ppu.cart, addr, data);
+            HOST_TIMER_LEAVE();
+            if (ppu.cart->chr_ram_allocated) {
+                ppu_render_log(regs.scanline, regs.dot, PPU_LOG_CHR, addr,
+                               data);
+            }
         }
         // If cartridge not loaded, silently ignore write
     } else if (addr >= 0x2000 && addr <= 0x3eff) {
         // printf("nametable write %04x : %02x\n", nametable_mirror(addr),
         // data);
-        ppu.nametable[nametable_mirror(addr)] = data;
-        dump_nametable(ppu.nametable);
+        uint16_t index = nametable_mirror(addr);
+        mem.nametable[index] = data;
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_VRAM, index, data);
+        dump_nametable(mem.nametable);
     } else if (addr >= 0x3f00 && addr <= 0x3fff) {
         // palette
-        printf("Palette WRITE %04x %02x\n", addr, data);
-        ppu.palette_table[addr & 0x1f] = data;
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "Palette write %04x %02x", addr, data);
+        mem.palette_table[addr & 0x1f] = data;
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_PALETTE, addr & 0x1f,
+                       data);
     } else if (addr >= 0x4000) {
         // [0x4000, 0xFFFF]
         // 	These addresses are mirrors of the the of the
@@ -138,21 +166,21 @@ static uint8_t cpu_read(uint16_t addr) {
     switch (addr & 0x2007) {
     case PPUCTRL:
         // WRITE ONLY
-        printf("PPUCTRL is write only\n");
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "PPUCTRL is write only");
         // exit(1);
         break;
 
     case PPUMASK:
         // WRITE ONLY
-        printf("PPUMASK is write only\n");
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "PPUMASK is write only");
         // exit(1);
         break;
 
     case PPUSTATUS:
         // The act of reading this register resets vblank and w latch
-        data = ppu.ppustatus.reg;
-        ppu.ppustatus.vblank_started = 0;
-        ppu.w = 0; // Reset write latch
+        data = regs.ppustatus.reg;
+        regs.ppustatus.vblank_started = 0;
+        regs.w = 0; // Reset write latch
         break;
 
     case OAMADDR:
@@ -162,7 +190,7 @@ static uint8_t cpu_read(uint16_t addr) {
 
     case OAMDATA:
         // Return data at current OAM address
-        data = ppu.oam[ppu.oamaddr];
+        data = mem.oam[regs.oamaddr];
         break;
 
     case PPUSCROLL:
@@ -179,22 +207,22 @@ static uint8_t cpu_read(uint16_t addr) {
         // - Reads from $3F00-$3FFF (palette) are immediate, but still fill
         // buffer
 
-        uint16_t addr = ppu.v & 0x3FFF; // Use v register as address
+        uint16_t addr = regs.v & 0x3FFF; // Use v register as address
 
         if (addr >= 0x3F00 && addr <= 0x3FFF) {
             // Palette reads bypass buffer (immediate)
             data = ppu_read(addr);
             // But buffer is still filled with nametable data "underneath"
-            ppu.ppudata_read_buffer = ppu_read(addr & 0x2FFF);
+            regs.ppudata_read_buffer = ppu_read(addr & 0x2FFF);
         } else {
             // Buffered read: return previous buffer contents
-            data = ppu.ppudata_read_buffer;
+            data = regs.ppudata_read_buffer;
             // Fill buffer with new data for next read
-            ppu.ppudata_read_buffer = ppu_read(addr);
+            regs.ppudata_read_buffer = ppu_read(addr);
         }
 
         // Auto-increment v register based on PPUCTRL bit 2
-        ppu.v += (ppu.ppuctrl.vram_addr_increment) ? 32 : 1;
+        regs.v += (regs.ppuctrl.vram_addr_increment) ? 32 : 1;
         break;
     }
 
@@ -203,42 +231,48 @@ static uint8_t cpu_read(uint16_t addr) {
 
 static void cpu_write(uint16_t addr, uint8_t data) {
     // printf("CPU write %04x DATA %02x\n", addr, data);
+    NES_PROBE4(ppu__write, addr & 0x07, data, regs.scanline, regs.dot);
     switch (addr & 0x2007) {
     case PPUCTRL:
-        ppu.ppuctrl.reg = data;
+        regs.ppuctrl.reg = data;
         // PPUCTRL: Nametable select bits also affect t register
         //   t: ....BA.. ........ = d: ......BA
-        ppu.t = (ppu.t & 0xF3FF) | ((data & 0x03) << 10);
+        regs.t = (regs.t & 0xF3FF) | ((data & 0x03) << 10);
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_CTRL, 0, data);
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_SCROLL, regs.t, regs.x);
         break;
 
     case PPUMASK:
-        ppu.ppumask.reg = data;
+        regs.ppumask.reg = data;
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_MASK, 0, data);
         /*
         printf(
             "  -> PPUMASK write: reg=0x%02x gray=%d bg_left8=%d spr_left8=%d "
             "bg_enable=%d spr_enable=%d emph_r=%d emph_g=%d emph_b=%d\n",
-            data, ppu.ppumask.grayscale, ppu.ppumask.bg_enable,
-            ppu.ppumask.sprite_enable, ppu.ppumask.bg_render_enable,
-            ppu.ppumask.sprite_render_enable, ppu.ppumask.intensify_red,
-            ppu.ppumask.intensify_green, ppu.ppumask.intensify_blue);
+            data, regs.ppumask.grayscale, regs.ppumask.bg_enable,
+            regs.ppumask.sprite_enable, regs.ppumask.bg_render_enable,
+            regs.ppumask.sprite_render_enable, regs.ppumask.intensify_red,
+            regs.ppumask.intensify_green, regs.ppumask.intensify_blue);
         */
         break;
 
     case PPUSTATUS:
         // READ ONLY
-        printf("PPUSTATUS is read only\n");
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "PPUSTATUS is read only");
         // exit(1);
         break;
 
     case OAMADDR:
         // Set OAM address register
-        ppu.oamaddr = data;
+        regs.oamaddr = data;
         break;
 
     case OAMDATA:
         // Write data to OAM at current address, then increment
-        ppu.oam[ppu.oamaddr] = data;
-        ppu.oamaddr++; // Auto-increment (wraps at 256)
+        mem.oam[regs.oamaddr] = data;
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_OAM, regs.oamaddr,
+                       data);
+        regs.oamaddr++; // Auto-increment (wraps at 256)
         break;
 
     case PPUSCROLL:
@@ -250,30 +284,28 @@ static void cpu_write(uint16_t addr, uint8_t data) {
         // Second write (w=1): Vertical scroll
         //   t: .CBA..HG FED..... = d: HGFEDCBA
         //   w:                   = 0
-        if (ppu.w == 0) {
+        if (regs.w == 0) {
             // First write: horizontal scroll
-            uint16_t old_t = ppu.t;
-            uint8_t old_x = ppu.x;
-            ppu.t = (ppu.t & 0xFFE0) | (data >> 3); // Coarse X
-            ppu.x = data & 0x07;                    // Fine X
-            ppu.w = 1;
-            if (debug_frame_count < 3) {
-                printf("[PPUSCROLL] Frame %d: X write data=%02x, t: "
-                       "%04x->%04x, x: %d->%d\n",
-                       debug_frame_count, data, old_t, ppu.t, old_x, ppu.x);
-            }
+            uint16_t old_t = regs.t;
+            uint8_t old_x = regs.x;
+            regs.t = (regs.t & 0xFFE0) | (data >> 3); // Coarse X
+            regs.x = data & 0x07;                    // Fine X
+            regs.w = 1;
+            LOG(LOG_PPU, LOG_LEVEL_TRACE,
+                "[PPUSCROLL] Frame %d: X write data=%02x, t: %04x->%04x, "
+                "x: %d->%d",
+                debug_frame_count, data, old_t, regs.t, old_x, regs.x);
         } else {
             // Second write: vertical scroll
-            uint16_t old_t = ppu.t;
-            ppu.t = (ppu.t & 0x8FFF) | ((data & 0x07) << 12); // Fine Y
-            ppu.t = (ppu.t & 0xFC1F) | ((data & 0xF8) << 2);  // Coarse Y
-            ppu.w = 0;
-            if (debug_frame_count < 3) {
-                printf(
-                    "[PPUSCROLL] Frame %d: Y write data=%02x, t: %04x->%04x\n",
-                    debug_frame_count, data, old_t, ppu.t);
-            }
+            uint16_t old_t = regs.t;
+            regs.t = (regs.t & 0x8FFF) | ((data & 0x07) << 12); // Fine Y
+            regs.t = (regs.t & 0xFC1F) | ((data & 0xF8) << 2);  // Coarse Y
+            regs.w = 0;
+            LOG(LOG_PPU, LOG_LEVEL_TRACE,
+                "[PPUSCROLL] Frame %d: Y write data=%02x, t: %04x->%04x",
+                debug_frame_count, data, old_t, regs.t);
         }
+        ppu_render_log(regs.scanline, regs.dot, PPU_LOG_SCROLL, regs.t, regs.x);
         break;
 
     case PPUADDR:
@@ -286,382 +318,224 @@ static void cpu_write(uint16_t addr, uint8_t data) {
         //   t: ........ HGFEDCBA = d: HGFEDCBA
         //   v                    = t
         //   w:                   = 0
-        if (ppu.w == 0) {
+        if (regs.w == 0) {
             // First write: high byte
-            ppu.t = (ppu.t & 0x00FF) | ((data & 0x3F) << 8);
-            if (debug_frame_count < 3) {
-                printf("[PPUADDR] Frame %d: Hi write data=%02x, t=%04x, w→1\n",
-                       debug_frame_count, data, ppu.t);
-            }
-            ppu.w = 1;
+            regs.t = (regs.t & 0x00FF) | ((data & 0x3F) << 8);
+            LOG(LOG_PPU, LOG_LEVEL_TRACE,
+                "[PPUADDR] Frame %d: Hi write data=%02x, t=%04x, w→1",
+                debug_frame_count, data, regs.t);
+            ppu_render_log(regs.scanline, regs.dot, PPU_LOG_SCROLL, regs.t,
+                           regs.x);
+            regs.w = 1;
         } else {
             // Second write: low byte
-            ppu.t = (ppu.t & 0xFF00) | data;
-            ppu.v = ppu.t; // Copy t to v
-            ppu.w = 0;
-            if (debug_frame_count < 3) {
-                printf("[PPUADDR] Frame %d: Lo write data=%02x, t=%04x, v←t, "
-                       "w→0\n",
-                       debug_frame_count, data, ppu.t);
-            }
-        }
-        // Keep legacy ppuaddr for compatibility (until we remove it)
-        if (ppu.ppuaddr_latch == 0) {
-            ppu.ppuaddr = (data << 8);
-            ppu.ppuaddr_latch = 1;
-        } else {
-            ppu.ppuaddr |= data;
-            ppu.ppuaddr_latch = 0;
+            regs.t = (regs.t & 0xFF00) | data;
+            regs.v = regs.t; // Copy t to v
+            regs.w = 0;
+            ppu_render_log(regs.scanline, regs.dot, PPU_LOG_VADDR, regs.v, 0);
+            LOG(LOG_PPU, LOG_LEVEL_TRACE,
+                "[PPUADDR] Frame %d: Lo write data=%02x, t=%04x, v←t, w→0",
+                debug_frame_count, data, regs.t);
         }
         break;
 
     case PPUDATA:
-        ppu_write(ppu.ppuaddr, data);
+        ppu_write(regs.v & 0x3FFF, data);
         // auto increment based on ctrl register
-        ppu.ppuaddr += (ppu.ppuctrl.vram_addr_increment) ? 32 : 1;
+        regs.v += (regs.ppuctrl.vram_addr_increment) ? 32 : 1;
         break;
     }
 }
 
-// Helper: Get color from palette index
-static uint32_t get_palette_color(uint8_t palette_index) {
-    return NES_PALETTE[palette_index & 0x3F];
-}
-
-// Fetch background tile data during the 8-dot tile cycle
-// These functions are called at specific dots to fetch tile data in advance
-static void fetch_nametable_byte(void) {
-    // Fetch tile index from nametable using current v register
-    uint16_t addr = 0x2000 | (ppu.v & 0x0FFF);
-    ppu.bg_next_tile_id = ppu.nametable[nametable_mirror(addr)];
-}
-
-static void fetch_attribute_byte(void) {
-    // Fetch attribute byte using coarse X/Y from v register
-    uint16_t addr = 0x23C0 | (ppu.v & 0x0C00) | ((ppu.v >> 4) & 0x38) |
-                    ((ppu.v >> 2) & 0x07);
-    uint8_t attr_byte = ppu.nametable[nametable_mirror(addr)];
-
-    // Select 2-bit palette based on position within 4x4 tile group
-    uint8_t shift = ((ppu.v >> 4) & 0x04) | (ppu.v & 0x02);
-    ppu.bg_next_tile_attr = (attr_byte >> shift) & 0x03;
-}
+// Bulk PPUDATA transfer, equivalent to writing each byte to $2007 in turn.
+// Sequential runs within nametable RAM or CHR-RAM are copied and logged in
+// one go, anything else takes the per-byte path.
+static void write_block(const uint8_t *data, uint16_t len) {
+    uint16_t increment = (regs.ppuctrl.vram_addr_increment) ? 32 : 1;
 
-static void fetch_pattern_low_byte(void) {
-    // Fetch low bit plane from pattern table
-    uint16_t pattern_base = ppu.ppuctrl.bg_pattern_table ? 0x1000 : 0x0000;
-    uint16_t fine_y = (ppu.v >> 12) & 0x07;
-    uint16_t addr = pattern_base + (ppu.bg_next_tile_id * 16) + fine_y;
+    while (len) {
+        uint16_t addr = regs.v & 0x3fff;
+        uint16_t run = 1;
 
-    if (ppu.cart && ppu.cart->ppu_read) {
-        ppu.bg_next_tile_lsb = ppu.cart->ppu_read(ppu.cart, addr);
-    } else {
-        ppu.bg_next_tile_lsb = 0;
-    }
-}
-
-static void fetch_pattern_high_byte(void) {
-    // Fetch high bit plane from pattern table
-    uint16_t pattern_base = ppu.ppuctrl.bg_pattern_table ? 0x1000 : 0x0000;
-    uint16_t fine_y = (ppu.v >> 12) & 0x07;
-    uint16_t addr = pattern_base + (ppu.bg_next_tile_id * 16) + fine_y + 8;
-
-    if (ppu.cart && ppu.cart->ppu_read) {
-        ppu.bg_next_tile_msb = ppu.cart->ppu_read(ppu.cart, addr);
-    } else {
-        ppu.bg_next_tile_msb = 0;
-    }
-}
-
-// Background pixel rendering for sprite compositing
-// Returns palette index for the background pixel at (x, y)
-// Uses static nametable $2000 (no scrolling)
-static uint8_t render_background_pixel_level1(uint8_t x, uint8_t y) {
-    // Check if background rendering is enabled
-    if (!ppu.ppumask.bg_render_enable) {
-        // Return backdrop color palette index
-        return ppu.palette_table[0];
-    }
-
-    // Direct tile calculation (no scrolling - always shows nametable $2000
-    // top-left)
-    uint16_t tile_x = x / 8; // 0-31
-    uint16_t tile_y = y / 8; // 0-29
-
-    // Nametable address (always $2000 for Level 1)
-    uint16_t nametable_addr = 0x2000 + (tile_y * 32) + tile_x;
-    uint8_t tile_id = ppu.nametable[nametable_mirror(nametable_addr)];
-
-    // Pixel within tile (0-7)
-    uint8_t pixel_x = x % 8;
-    uint8_t pixel_y = y % 8;
-
-    // Fetch pattern data from CHR-ROM
-    uint16_t pattern_base = ppu.ppuctrl.bg_pattern_table ? 0x1000 : 0x0000;
-    uint16_t pattern_addr = pattern_base + (tile_id * 16) + pixel_y;
-
-    uint8_t plane0 = 0;
-    uint8_t plane1 = 0;
-    if (ppu.cart && ppu.cart->ppu_read) {
-        plane0 = ppu.cart->ppu_read(ppu.cart, pattern_addr);
-        plane1 = ppu.cart->ppu_read(ppu.cart, pattern_addr + 8);
-    }
-
-    // Extract 2-bit pixel color
-    uint8_t bit0 = (plane0 >> (7 - pixel_x)) & 0x01;
-    uint8_t bit1 = (plane1 >> (7 - pixel_x)) & 0x01;
-    uint8_t pixel_color = (bit1 << 1) | bit0;
-
-    // Fetch attribute byte for palette selection
-    uint16_t attr_x = tile_x / 4; // 0-7
-    uint16_t attr_y = tile_y / 4; // 0-7
-    uint16_t attr_addr = 0x23C0 + (attr_y * 8) + attr_x;
-    uint8_t attr_byte = ppu.nametable[nametable_mirror(attr_addr)];
-
-    // Extract palette index from attribute byte
-    uint8_t attr_shift = ((tile_y & 0x02) << 1) | (tile_x & 0x02);
-    uint8_t palette_index = (attr_byte >> attr_shift) & 0x03;
-
-    // Return palette index for this pixel
-    uint8_t palette_addr;
-    if (pixel_color == 0) {
-        palette_addr = 0; // Backdrop color (universal background)
-    } else {
-        // Background palettes start at 0, each palette is 4 colors
-        palette_addr = (palette_index * 4) + pixel_color;
-    }
-
-    return ppu.palette_table[palette_addr];
-}
+        if (increment == 1 && addr >= 0x2000 && addr < 0x3f00) {
+            // Stay within one 1KB nametable (and its mirror)
+            uint16_t index = nametable_mirror(addr);
 
-// Render a single background pixel using shift registers (hardware-accurate)
-static uint8_t render_background_pixel(uint8_t x, uint8_t y) {
-    (void)x; // Screen coordinates not used
-    (void)y;
-
-    if (!ppu.ppumask.bg_render_enable) {
-        // Debug: Print on first scanline to see why rendering is disabled
-        if (ppu.scanline == 0 && ppu.dot == 1) {
-            printf("DEBUG: bg_render_enable=0, PPUMASK=%02x, "
-                   "backdrop=palette[0]=%02x -> color=%08x\n",
-                   ppu.ppumask.reg, ppu.palette_table[0],
-                   NES_PALETTE[ppu.palette_table[0] & 0x3F]);
+            run = 0x400 - (addr & 0x3ff);
+            if (run > 0x3f00 - addr) {
+                run = 0x3f00 - addr; // Palette follows $3EFF
+            }
+            if (run > len) {
+                run = len;
+            }
+            memcpy(&mem.nametable[index], data, run);
+            ppu_render_log_run(regs.scanline, regs.dot, PPU_LOG_VRAM_RUN,
+                               index, data, run);
+        } else if (increment == 1 && addr < 0x2000 && ppu.cart &&
+                   ppu.cart->chr_ram_allocated) {
+            // Stay within one 1KB CHR bank, written straight into the
+            // mapper's bank table like chr_read() reads it
+            run = 0x400 - (addr & 0x3ff);
+            if (run > len) {
+                run = len;
+            }
+            memcpy(&ppu.cart->map->chr[addr >> 10][addr & 0x3ff], data, run);
+            ppu_render_log_run(regs.scanline, regs.dot, PPU_LOG_CHR_RUN, addr,
+                               data, run);
+        } else {
+            ppu_write(addr, *data);
         }
-        return ppu.palette_table[0]; // Backdrop color
-    }
 
-    // TEMPORARY: Disable fine X scrolling to diagnose issues
-    // Force fine_x to 0 for 8-pixel aligned scrolling only
-    uint8_t fine_x = 0; // TODO: Use ppu.x when fine X is debugged
-
-    // Select pixel from shift registers using fine X
-    // Shift registers hold 16 bits, we select bit 15-fine_x
-    uint8_t bit_select = 15 - fine_x;
-    uint8_t pixel_lo = (ppu.bg_shift_pattern_lo >> bit_select) & 0x01;
-    uint8_t pixel_hi = (ppu.bg_shift_pattern_hi >> bit_select) & 0x01;
-    uint8_t pixel_color = pixel_lo | (pixel_hi << 1);
-
-    // Select palette from attribute shift registers
-    // ISSUE: Attribute registers are 8-bit, not 16-bit like pattern registers
-    // They should also use fine_x offset, but from bit 7-fine_x
-    uint8_t attr_bit_select = 7 - fine_x;
-    uint8_t attr_lo = (ppu.bg_shift_attr_lo >> attr_bit_select) & 0x01;
-    uint8_t attr_hi = (ppu.bg_shift_attr_hi >> attr_bit_select) & 0x01;
-    uint8_t palette_index = attr_lo | (attr_hi << 1);
-
-    // Debug: Sample a pixel to see actual data
-    if (ppu.scanline == 100 && ppu.dot == 128 && pixel_color == 0) {
-        printf("DEBUG: pixel_color=%d palette[0]=%02x shift_lo=%04x "
-               "shift_hi=%04x\n",
-               pixel_color, ppu.palette_table[0], ppu.bg_shift_pattern_lo,
-               ppu.bg_shift_pattern_hi);
+        regs.v += run * increment;
+        data += run;
+        len -= run;
     }
+}
 
-    if (pixel_color == 0) {
-        // Transparent - use backdrop color
-        return ppu.palette_table[0];
+// PPU dots left before VBlank ends, 0 outside of VBlank
+static uint32_t vblank_dots(void) {
+    if (regs.scanline < 241 || (regs.scanline == 241 && regs.dot <= 1)) {
+        return 0;
     }
 
-    // Get final color from palette
-    uint8_t palette_addr = (palette_index * 4) + pixel_color;
-    return ppu.palette_table[palette_addr];
+    return (260 - regs.scanline) * 341 + (341 - regs.dot);
 }
 
 // Evaluate sprites for current scanline
 // Finds up to 8 sprites that are visible on this scanline
 static void evaluate_sprites_for_scanline(int16_t scanline) {
-    ppu.sprite_count = 0;
-    uint8_t sprite_height = ppu.ppuctrl.sprite_size ? 16 : 8; // 8x8 or 8x16
-
-    // Scan all 64 sprites in OAM
-    for (int i = 0; i < 64 && ppu.sprite_count < 8; i++) {
-        uint8_t sprite_y = ppu.oam[i * 4 + 0];
-        uint8_t tile_index = ppu.oam[i * 4 + 1];
-        uint8_t attributes = ppu.oam[i * 4 + 2];
-        uint8_t sprite_x = ppu.oam[i * 4 + 3];
-
-        // Check if sprite is on this scanline
-        // Y position is scanline where top of sprite appears (sprite drawn on
-        // Y+1 to Y+height)
-        int16_t sprite_top = sprite_y + 1;
-        int16_t sprite_bottom = sprite_y + sprite_height;
-
-        if (scanline >= sprite_top && scanline < sprite_bottom) {
-            // Store in secondary OAM
-            ppu.secondary_oam[ppu.sprite_count].y = sprite_y;
-            ppu.secondary_oam[ppu.sprite_count].tile = tile_index;
-            ppu.secondary_oam[ppu.sprite_count].attr = attributes;
-            ppu.secondary_oam[ppu.sprite_count].x = sprite_x;
-            ppu.sprite_count++;
-        }
-    }
+    uint8_t sprite_height = regs.ppuctrl.sprite_size ? 16 : 8; // 8x8 or 8x16
 
     // Set sprite overflow flag if more than 8 sprites on scanline
-    if (ppu.sprite_count == 8) {
-        // Check if there are more sprites
-        for (int i = 8 * 4; i < 256; i += 4) {
-            uint8_t sprite_y = ppu.oam[i];
-            int16_t sprite_top = sprite_y + 1;
-            int16_t sprite_bottom = sprite_y + sprite_height;
-            if (scanline >= sprite_top && scanline < sprite_bottom) {
-                ppu.ppustatus.sprite_overflow = 1;
-                break;
-            }
-        }
+    if (ppu_evaluate_sprites(mem.oam, sprite_height, scanline,
+                             mem.secondary_oam, &regs.sprite_count)) {
+        regs.ppustatus.sprite_overflow = 1;
     }
 }
 
-// Render sprite pixel at given screen coordinates
-static uint8_t render_sprite_pixel(uint8_t x, uint8_t y) {
-    if (!ppu.ppumask.sprite_render_enable) {
-        return 0xFF; // Sprites disabled
-    }
-
-    // Check secondary OAM for sprites at this pixel
-    for (int i = 0; i < ppu.sprite_count; i++) {
-        uint8_t sprite_x = ppu.secondary_oam[i].x;
-        uint8_t sprite_y = ppu.secondary_oam[i].y;
-        uint8_t tile_index = ppu.secondary_oam[i].tile;
-        uint8_t attributes = ppu.secondary_oam[i].attr;
-
-        // Check if pixel is within sprite bounds
-        if (x < sprite_x || x >= sprite_x + 8) {
-            continue; // Not in this sprite's X range
-        }
-
-        // Calculate pixel position within sprite (0-7 or 0-15)
-        uint8_t pixel_x = x - sprite_x;
-        uint8_t pixel_y = y - (sprite_y + 1); // +1 because Y is scanline-1
-
-        // Validate Y coordinate is within sprite bounds
-        uint8_t sprite_height = ppu.ppuctrl.sprite_size ? 16 : 8;
-        if (pixel_y >= sprite_height) {
-            continue; // Out of bounds, skip this sprite
-        }
-
-        // Apply horizontal flip
-        if (attributes & 0x40) {
-            pixel_x = 7 - pixel_x;
-        }
+// Whether the background pixel at x of the current scanline is opaque
+// v holds the scroll position of the scanline's first pixel, as in the
+// renderer
+static uint8_t background_opaque(uint8_t x) {
+    uint16_t tile_v = ppu_scroll_v(regs.v, regs.x, x);
+    uint16_t nametable_addr = 0x2000 | (tile_v & 0x0FFF);
+    uint8_t tile_id = mem.nametable[nametable_mirror(nametable_addr)];
+    uint16_t pattern_base = regs.ppuctrl.bg_pattern_table ? 0x1000 : 0x0000;
+    uint16_t pattern_addr =
+        pattern_base + (tile_id * 16) + ((tile_v >> 12) & 0x07);
+    uint8_t bit = 7 - ((regs.x + x) & 0x07);
+
+    return ((ppu_read(pattern_addr) | ppu_read(pattern_addr + 8)) >> bit) &
+           0x01;
+}
 
-        // Apply vertical flip
-        if (attributes & 0x80) {
-            pixel_y = sprite_height - 1 - pixel_y;
-        }
+// Sprite 0 hit is visible to the CPU, so it is resolved here rather than by
+// the renderer. Returns the dot at which sprite 0 hits the background on
+// this scanline, or -1.
+static int16_t find_sprite0_hit(int16_t scanline) {
+    uint8_t sprite_height = regs.ppuctrl.sprite_size ? 16 : 8;
+    uint8_t sprite_y = mem.oam[0];
+    uint8_t tile_index = mem.oam[1];
+    uint8_t attributes = mem.oam[2];
+    uint8_t sprite_x = mem.oam[3];
+    int16_t pixel_y = scanline - (sprite_y + 1);
+
+    if (!regs.ppumask.bg_render_enable || !regs.ppumask.sprite_render_enable) {
+        return -1;
+    }
 
-        // Get pattern table address (sprites use table from PPUCTRL bit 3)
-        uint16_t pattern_table_base =
-            ppu.ppuctrl.sprite_pattern_table ? 0x1000 : 0x0000;
-        uint16_t tile_addr = pattern_table_base + (tile_index * 16);
+    if (pixel_y < 0 || pixel_y >= sprite_height) {
+        return -1;
+    }
 
-        // Read pattern data (2 bitplanes) with NULL safety
-        uint8_t plane0 = 0;
-        uint8_t plane1 = 0;
+    if (attributes & 0x80) {
+        pixel_y = sprite_height - 1 - pixel_y;
+    }
 
-        if (ppu.cart && ppu.cart->ppu_read) {
-            plane0 = ppu.cart->ppu_read(ppu.cart, tile_addr + pixel_y);
-            plane1 = ppu.cart->ppu_read(ppu.cart, tile_addr + pixel_y + 8);
-        }
+    uint16_t pattern_table_base =
+        regs.ppuctrl.sprite_pattern_table ? 0x1000 : 0x0000;
+    uint16_t tile_addr = pattern_table_base + (tile_index * 16) + pixel_y;
+    uint8_t plane0 = ppu_read(tile_addr & 0x1fff);
+    uint8_t plane1 = ppu_read((tile_addr + 8) & 0x1fff);
 
-        // Extract pixel color (2 bits)
-        uint8_t bit0 = (plane0 >> (7 - pixel_x)) & 0x01;
-        uint8_t bit1 = (plane1 >> (7 - pixel_x)) & 0x01;
-        uint8_t pixel_color = (bit1 << 1) | bit0;
+    // No hit at x=255
+    for (uint16_t x = sprite_x; x < sprite_x + 8 && x < 255; x++) {
+        uint8_t bit = (attributes & 0x40) ? (x - sprite_x) : 7 - (x - sprite_x);
 
-        // If pixel is transparent (color 0), try next sprite
-        if (pixel_color == 0) {
-            continue;
+        if (((plane0 | plane1) >> bit) & 0x01 &&
+            background_opaque(x)) {
+            return x + 1;
         }
-
-        // Get sprite palette (bits 0-1 of attributes select palette 0-3)
-        // Sprite palettes start at $3F10
-        uint8_t palette_index =
-            (attributes & 0x03) + 4; // +4 for sprite palettes
-        uint8_t palette_addr = (palette_index * 4) + pixel_color;
-        uint8_t color = ppu.palette_table[palette_addr];
-
-        // Encode sprite info in upper bits for priority handling
-        // Bit 7: 1 = sprite pixel (vs background)
-        // Bit 6: priority bit from attributes (0=front, 1=back)
-        // Bit 5: sprite 0 flag
-        return color | 0x80 | ((attributes & 0x20) << 1) |
-               ((i == 0) ? 0x20 : 0);
     }
 
-    return 0xFF; // No sprite pixel
+    return -1;
 }
 
-// Combine background and sprite pixels with priority handling
-static uint8_t combine_pixels(uint8_t bg, uint8_t sprite) {
-    // Sprite encoding: bit 7=sprite present, bit 6=priority, bit 5=sprite 0
-    // Lower 6 bits = palette index
+// Dot at which PPU A12 rises on a rendering scanline, or -1. With the
+// background and sprites in different pattern tables A12 goes high once per
+// line: for the sprite fetches at dot 260 when sprites use $1000, or for the
+// next line's tile fetches at dot 324 when the background does. 8x16 sprites
+// count as $1000 since unused sprite slots fetch tile $FF.
+static int16_t a12_rise_dot(void) {
+    uint8_t bg = regs.ppuctrl.bg_pattern_table;
+    uint8_t sprite =
+        regs.ppuctrl.sprite_size || regs.ppuctrl.sprite_pattern_table;
+
+    if (!regs.ppumask.bg_render_enable && !regs.ppumask.sprite_render_enable) {
+        return -1;
+    }
 
-    if (sprite == 0xFF) {
-        return bg; // No sprite, use background
+    if (sprite && !bg) {
+        return 260;
+    }
+    if (bg && !sprite) {
+        return 324;
     }
+    return -1;
+}
 
-    // Extract sprite info
-    uint8_t is_sprite = (sprite & 0x80) ? 1 : 0;
-    uint8_t priority_behind = (sprite & 0x40) ? 1 : 0;
-    uint8_t is_sprite_0 = (sprite & 0x20) ? 1 : 0;
-    uint8_t sprite_color = sprite & 0x1F; // Lower 5 bits
+// First dot from the current one on at which clock() has work to do. Pixels
+// come from the renderer, so only these few dots per scanline need more
+// than the dot counter advancing.
+static int16_t next_event_dot(void) {
+    int16_t next = 340; // End of scanline
 
-    if (!is_sprite) {
-        return bg; // Not actually a sprite
+    if (regs.dot <= 1 && (regs.scanline < 240 || regs.scanline == 241)) {
+        return 1; // Sprite evaluation, VBlank start / end
     }
 
-    // Sprite 0 hit detection
-    // Set when sprite 0 opaque pixel overlaps background opaque pixel
-    if (is_sprite_0 && bg != 0 && sprite_color != 0) {
-        ppu.ppustatus.sprite_0_hit = 1;
+    if (regs.scanline >= 0 && regs.scanline < 240) {
+        if (regs.dot <= regs.sprite0_hit_dot) {
+            return regs.sprite0_hit_dot;
+        }
+        if (regs.dot <= 256) {
+            return 256; // Scroll: next row
+        }
+    } else if (regs.scanline == -1 && regs.dot <= 304) {
+        next = 304; // Scroll: reload from t
     }
 
-    // Handle priority
-    if (priority_behind) {
-        // Sprite behind background: only show if background is transparent
-        if (bg == 0) {
-            return sprite_color;
-        } else {
-            return bg;
+    // Both possible A12 edges for a mapper counting scanlines
+    if (ppu.cart && ppu.cart->scanline && regs.scanline < 240) {
+        if (regs.dot <= 260) {
+            return 260;
+        }
+        if (regs.dot <= 324 && next > 324) {
+            next = 324;
         }
-    } else {
-        // Sprite in front: sprite always wins
-        return sprite_color;
     }
-}
 
-// Increment horizontal position in v register
-// Called every 8 dots during rendering
-static void increment_coarse_x(void) {
-    if ((ppu.v & 0x001F) == 31) { // if coarse X == 31
-        ppu.v &= ~0x001F;         // coarse X = 0
-        ppu.v ^= 0x0400;          // switch horizontal nametable
-    } else {
-        ppu.v += 1; // increment coarse X
-    }
+    return next;
 }
 
 static void clock() {
+    // Between events only the dot counter moves, and never past the end of
+    // the scanline since dot 340 is always an event
+    if (regs.dot < regs.next_event_dot) {
+        regs.dot++;
+        return;
+    }
+
     // NES PPU timing:
     // Scanlines -1 to 260 (262 total)
     // -1: Pre-render scanline
@@ -669,118 +543,149 @@ static void clock() {
     // 240: Post-render (idle)
     // 241-260: VBlank
 
-    // Render visible pixels (and pre-render scanline)
-    if (ppu.scanline >= -1 && ppu.scanline < 240) {
+    // Visible scanlines: pixels are produced by the renderer from the frame
+    // log, only the CPU-visible sprite flags are tracked here
+    if (regs.scanline >= 0 && regs.scanline < 240) {
         // Sprite evaluation at start of scanline
-        if (ppu.dot == 1 && ppu.scanline >= 0) {
+        if (regs.dot == 1) {
+            regs.sprite0_hit_dot = -1;
             // Only evaluate sprites if either bg or sprite rendering is enabled
-            if (ppu.ppumask.bg_render_enable ||
-                ppu.ppumask.sprite_render_enable) {
-                evaluate_sprites_for_scanline(ppu.scanline);
+            if (regs.ppumask.bg_render_enable ||
+                regs.ppumask.sprite_render_enable) {
+                evaluate_sprites_for_scanline(regs.scanline);
+                regs.sprite0_hit_dot = find_sprite0_hit(regs.scanline);
             }
         }
 
-        // Render pixels: background + sprites
-        if (ppu.scanline >= 0 && ppu.dot >= 1 && ppu.dot <= 256) {
-            // Get background pixel
-            uint8_t bg_pixel =
-                render_background_pixel_level1(ppu.dot - 1, ppu.scanline);
-
-            // Get sprite pixel
-            uint8_t sprite_pixel =
-                render_sprite_pixel(ppu.dot - 1, ppu.scanline);
-
-            // Composite background and sprite
-            uint8_t final_pixel = combine_pixels(bg_pixel, sprite_pixel);
-
-            // Write to frame buffer
-            if (ppu.frame_buffer) {
-                int index = ppu.scanline * 256 + (ppu.dot - 1);
-                ppu.frame_buffer[index] = get_palette_color(final_pixel);
-            }
+        if (regs.dot == regs.sprite0_hit_dot) {
+            regs.ppustatus.sprite_0_hit = 1;
         }
     }
 
     // Scanline 241, dot 1: Enter VBlank
-    if (ppu.scanline == 241 && ppu.dot == 1) {
-        if (debug_frame_count < 3) {
-            printf("\n===== Frame %d complete, entering VBlank =====\n\n",
-                   debug_frame_count);
-        }
-        ppu.ppustatus.vblank_started = 1;
-        ppu.frame_complete = 1;
+    if (regs.scanline == 241 && regs.dot == 1) {
+        LOG(LOG_PPU, LOG_LEVEL_DEBUG, "Frame %d complete, entering VBlank",
+            debug_frame_count);
+        regs.ppustatus.vblank_started = 1;
+        ppu_render_end_frame();
+        regs.frame_complete = 1;
 
         // Trigger NMI if enabled in PPUCTRL (bit 7)
-        if (ppu.ppuctrl.nmi) {
-            ppu.nmi_triggered = 1;
-            printf("PPU: NMI triggered at scanline 241 (VBlank start)\n");
+        if (regs.ppuctrl.nmi) {
+            regs.nmi_triggered = 1;
+            LOG(LOG_PPU, LOG_LEVEL_DEBUG,
+                "NMI triggered at scanline 241 (VBlank start)");
         }
     }
 
     // Scanline -1 (pre-render), dot 1: Clear VBlank
-    if (ppu.scanline == -1 && ppu.dot == 1) {
-        ppu.ppustatus.vblank_started = 0;
-        ppu.ppustatus.sprite_0_hit = 0;
-        // ppu.ppustatus.sprite_overflow = 0;
-        ppu.frame_complete = 0;
+    if (regs.scanline == -1 && regs.dot == 1) {
+        regs.ppustatus.vblank_started = 0;
+        regs.ppustatus.sprite_0_hit = 0;
+        // regs.ppustatus.sprite_overflow = 0;
+        regs.frame_complete = 0;
         // Note: nmi_triggered is NOT cleared here - CPU clears it when
         // servicing NMI
     }
 
-    // No scroll register operations in this version (static backgrounds only)
+    // Scroll position updates. Tiles are fetched by the renderer, so v only
+    // holds the position of each scanline's first pixel.
+    if (regs.scanline < 240 &&
+        (regs.ppumask.bg_render_enable || regs.ppumask.sprite_render_enable)) {
+        if (regs.scanline >= 0 && regs.dot == 256) {
+            // Next row, horizontal position reloaded from t
+            regs.v = ppu_increment_y(regs.v);
+            regs.v = (regs.v & ~PPU_V_HORIZONTAL) | (regs.t & PPU_V_HORIZONTAL);
+        } else if (regs.scanline == -1 && regs.dot == 304) {
+            // Pre-render scanline reloads the whole position
+            regs.v = regs.t;
+        }
+    }
+
+    // Scanline counters on the cartridge are clocked by A12 rising, which
+    // happens at a fixed dot of every rendering scanline
+    if (ppu.cart && ppu.cart->scanline && regs.scanline < 240 &&
+        regs.dot == a12_rise_dot()) {
+        HOST_TIMER_ENTER(HOST_PHASE_MAPPER);
+        ppu.cart->scanline(ppu.cart);
+        HOST_TIMER_LEAVE();
+    }
 
     // Advance dot counter
-    ppu.dot++;
-    if (ppu.dot > 340) {
-        ppu.dot = 0;
-        ppu.scanline++;
-        if (ppu.scanline > 260) {
-            ppu.scanline = -1; // Reset to pre-render
+    regs.dot++;
+    if (regs.dot > 340) {
+        regs.dot = 0;
+        regs.scanline++;
+        if (regs.scanline > 260) {
+            regs.scanline = -1; // Reset to pre-render
             debug_frame_count++;
         }
     }
+    regs.next_event_dot = next_event_dot();
 }
 
-static void connect_bus(void *bus) { ppu.bus = (struct nesbus *)bus; }
+// The bus has just pointed nes_state at the arena the PPU runs on
+static void connect_bus(void *bus) {
+    ppu.bus = (struct nesbus *)bus;
+    ppu.state = &regs;
+}
+
+// Full copy of the PPU-visible state for the renderer to start from
+static void capture_render_state(struct ppu_render_state *state) {
+    state->ctrl = regs.ppuctrl.reg;
+    state->mask = regs.ppumask.reg;
+    state->x = regs.x;
+    state->t = regs.t;
+    state->v = regs.v;
+    state->mirroring = nes_state->mirroring;
+    memcpy(state->palette_table, mem.palette_table,
+           sizeof(state->palette_table));
+    memcpy(state->oam, mem.oam, sizeof(state->oam));
+    memcpy(state->nametable, mem.nametable, sizeof(state->nametable));
+    if (ppu.cart && ppu.cart->map) {
+        copy_chr(state->chr);
+    } else {
+        memset(state->chr, 0, sizeof(state->chr));
+    }
+}
 
 static void set_framebuffer(uint32_t *fb) {
+    struct ppu_render_state state;
+
     ppu.frame_buffer = fb;
-    ppu.scanline = -1; // Start at pre-render scanline per NES hardware spec
-    ppu.dot = 0;
-    ppu.frame_complete = 0;
+    regs.scanline = -1; // Start at pre-render scanline per NES hardware spec
+    regs.dot = 0;
+    regs.next_event_dot = 0;
+    regs.sprite0_hit_dot = -1;
+    regs.frame_complete = 0;
 
     // Initialize backdrop color to black (NES power-on default)
     // 0x0F = black in NES palette
-    ppu.palette_table[0] = 0x0F;
+    mem.palette_table[0] = 0x0F;
+
+    capture_render_state(&state);
+    ppu_render_reset(&state);
+    ppu_render_set_framebuffer(fb);
 
     printf("PPU: Frame buffer connected at %p\n", (void *)fb);
     printf("PPU: Backdrop color initialized to palette[0]=%02x (black)\n",
-           ppu.palette_table[0]);
+           mem.palette_table[0]);
+}
+
+// A snapshot was loaded into the arena: restart the renderer from it
+static void restore(void) {
+    struct ppu_render_state state;
+
+    capture_render_state(&state);
+    ppu_render_reset(&state);
 }
 
 static void reset(void) {
-    ppu.ppuaddr_latch = 0;
     // Reset loopy registers
-    ppu.v = 0;
-    ppu.t = 0;
-    ppu.x = 0;
-    ppu.w = 0;
-
-    // Reset shift registers
-    ppu.bg_shift_pattern_lo = 0;
-    ppu.bg_shift_pattern_hi = 0;
-    ppu.bg_shift_attr_lo = 0;
-    ppu.bg_shift_attr_hi = 0;
-
-    // Reset attribute latches
-    ppu.bg_attr_latch_lo = 0;
-    ppu.bg_attr_latch_hi = 0;
-
-    // Reset tile fetch latches
-    ppu.bg_next_tile_id = 0;
-    ppu.bg_next_tile_attr = 0;
-    ppu.bg_next_tile_lsb = 0;
-    ppu.bg_next_tile_msb = 0;
+    regs.v = 0;
+    regs.t = 0;
+    regs.x = 0;
+    regs.w = 0;
 }
 
 struct ppu2c02 *ppu2c02_init() {
@@ -791,8 +696,14 @@ struct ppu2c02 *ppu2c02_init() {
     ppu.clock = clock;
     ppu.connect_bus = connect_bus;
     ppu.reset = reset;
+    ppu.restore = restore;
     ppu.connect_cartridge = connect_cartridge;
     ppu.set_framebuffer = set_framebuffer;
+    ppu.set_render_mode = ppu_render_set_mode;
+    ppu.set_render_bands = ppu_render_set_bands;
+    ppu.sync_framebuffer = ppu_render_sync;
+    ppu.write_block = write_block;
+    ppu.vblank_dots = vblank_dots;
 
     return &ppu;
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #ifndef __2C02_H__
 #define __2C02_H__
 
+#include "2c02_render.h"
 #include "cartridge.h"
 #include "nesbus.h"
+#include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,23 +31,28 @@ typedef void (*fp_reset)(void);
 typedef void (*fp_clock)(void);
 typedef void (*fp_connect_bus)(void *bus);
 typedef void (*fp_set_framebuffer)(uint32_t *fb);
+typedef int (*fp_set_render_mode)(enum ppu_render_mode mode);
+typedef int (*fp_set_render_bands)(uint8_t bands);
+typedef void (*fp_sync_framebuffer)(void);
+typedef void (*fp_write_block)(const uint8_t *data, uint16_t len);
+typedef uint32_t (*fp_vblank_dots)(void);
+typedef void (*fp_restore)(void);
+
+// PPU registers and counters, everything clock() and the CPU-facing
+// registers touch. 22 bytes, so together with the CPU registers they fit
+// in the first cache line of the machine state arena (nes_state.h).
+struct ppu2c02_regs {
+    // Scanline and dot counters for PPU timing
+    int16_t scanline;  // -1 to 260 (NTSC: 262 scanlines total, -1 is pre-render)
+    int16_t dot;       // 0 to 340 (341 dots per scanline)
+    int16_t next_event_dot;  // Next dot clock() must handle
+    int16_t sprite0_hit_dot; // Dot of sprite 0 hit on this scanline, or -1
 
-struct ppu2c02 {
-    fp_ppu_read ppu_read;
-    fp_ppu_write ppu_write;
-    fp_cpu_read cpu_read;
-    fp_cpu_write cpu_write;
-    fp_clock clock;
-    fp_connect_bus connect_bus;
-    fp_connect_cartridge connect_cartridge;
-    fp_set_framebuffer set_framebuffer;
-    fp_reset reset;
-    struct nes_cartridge *cart;
-    struct nesbus *bus;
-
-    uint8_t pattern_table[0x2000]; // CHR ROM
-    uint8_t nametable[0x2000];     // VRAM
-    uint8_t palette_table[0x20];
+    // Loopy registers for scrolling (NESdev PPU scrolling)
+    uint16_t v;  // Current VRAM address (15 bits)
+    uint16_t t;  // Temporary VRAM address (15 bits)
+    uint8_t x;   // Fine X scroll (3 bits: 0-7)
+    uint8_t w;   // Write latch (1 bit: 0 or 1) - shared by PPUSCROLL and PPUADDR
 
     union {
         struct {
@@ -83,63 +91,70 @@ struct ppu2c02 {
         uint8_t reg;
     } ppustatus;
 
+    // NMI signal (set by PPU, read by CPU via nesbus)
+    uint8_t nmi_triggered;  // 1 when NMI should fire, cleared when CPU reads it
+    uint8_t frame_complete; // Flag set when frame rendering is done
+    uint8_t sprite_count;   // Number of sprites on current scanline (0-8)
+
     uint8_t oamaddr;    // $2003 - OAM address register
-    uint8_t oamdata;    // $2004 - OAM data register (not used, actual data in oam[])
-    uint8_t ppuscroll;  // Legacy field, will be removed
-    uint16_t ppuaddr;   // Legacy field, will be removed
-    uint8_t ppudata;
 
-    uint8_t ppuaddr_latch;  // Legacy latch, replaced by 'w'
+    // PPUDATA read buffer (internal buffering for reads from $0000-$3EFF)
+    // Reads from $3F00-$3FFF (palette) bypass the buffer
+    uint8_t ppudata_read_buffer;
+};
 
-    // Loopy registers for scrolling (NESdev PPU scrolling)
-    uint16_t v;  // Current VRAM address (15 bits)
-    uint16_t t;  // Temporary VRAM address (15 bits)
-    uint8_t x;   // Fine X scroll (3 bits: 0-7)
-    uint8_t w;   // Write latch (1 bit: 0 or 1) - shared by PPUSCROLL and PPUADDR
+static_assert(sizeof(struct ppu2c02_regs) == 22, "PPU registers grew");
+static_assert(offsetof(struct ppu2c02_regs, v) == 8 &&
+                  offsetof(struct ppu2c02_regs, ppuctrl) == 14 &&
+                  offsetof(struct ppu2c02_regs, nmi_triggered) == 17,
+              "PPU register layout changed");
+
+// PPU memories, in the cold part of the machine state arena. Pattern
+// memory is not here: it belongs to the cartridge.
+struct ppu2c02_mem {
+    uint8_t palette_table[0x20];
 
     // OAM (Object Attribute Memory) - 256 bytes for 64 sprites
     // Each sprite: 4 bytes (Y, tile index, attributes, X)
     uint8_t oam[256];
 
     // Secondary OAM - holds up to 8 sprites for current scanline
-    struct {
-        uint8_t y;
-        uint8_t tile;
-        uint8_t attr;
-        uint8_t x;
-    } secondary_oam[8];
-    uint8_t sprite_count;  // Number of sprites on current scanline (0-8)
-
-    // Frame buffer for rendering output (provided by GUI, 256x240 ARGB8888)
-    uint32_t *frame_buffer;
-
-    // Background rendering shift registers (internal PPU registers)
-    uint16_t bg_shift_pattern_lo;   // Low bit plane shift register (16-bit)
-    uint16_t bg_shift_pattern_hi;   // High bit plane shift register (16-bit)
-    uint8_t bg_shift_attr_lo;        // Low attribute shift register (8-bit)
-    uint8_t bg_shift_attr_hi;        // High attribute shift register (8-bit)
+    struct ppu_sprite secondary_oam[8];
 
-    // Attribute latches (feed shift registers on every shift)
-    uint8_t bg_attr_latch_lo;        // Low attribute latch (feeds bit 0 during shifts)
-    uint8_t bg_attr_latch_hi;        // High attribute latch (feeds bit 0 during shifts)
+    // 2KB of nametable RAM, indexed through ppu_nametable_index()
+    uint8_t nametable[0x800];
+};
 
-    // Latches for next tile data (loaded into shift registers every 8 dots)
-    uint8_t bg_next_tile_id;         // Next tile index from nametable
-    uint8_t bg_next_tile_attr;       // Next tile attribute
-    uint8_t bg_next_tile_lsb;        // Next tile pattern low byte
-    uint8_t bg_next_tile_msb;        // Next tile pattern high byte
+static_assert(sizeof(struct ppu2c02_mem) == 0x940, "PPU memories grew");
+static_assert(offsetof(struct ppu2c02_mem, oam) == 0x20 &&
+                  offsetof(struct ppu2c02_mem, nametable) == 0x140,
+              "PPU memory layout changed");
 
-    // Scanline and dot counters for PPU timing
-    int16_t scanline;  // -1 to 260 (NTSC: 262 scanlines total, -1 is pre-render)
-    int16_t dot;       // 0 to 340 (341 dots per scanline)
-    uint8_t frame_complete;  // Flag set when frame rendering is done
+struct ppu2c02 {
+    fp_ppu_read ppu_read;
+    fp_ppu_write ppu_write;
+    fp_cpu_read cpu_read;
+    fp_cpu_write cpu_write;
+    fp_clock clock;
+    fp_connect_bus connect_bus;
+    fp_connect_cartridge connect_cartridge;
+    fp_set_framebuffer set_framebuffer;
+    fp_set_render_mode set_render_mode;
+    fp_set_render_bands set_render_bands;
+    fp_sync_framebuffer sync_framebuffer;
+    fp_write_block write_block;
+    fp_vblank_dots vblank_dots;
+    fp_reset reset;
+    // Resync with a snapshot just loaded into the machine state arena
+    fp_restore restore;
+    struct nes_cartridge *cart;
+    struct nesbus *bus;
 
-    // NMI signal (set by PPU, read by CPU via nesbus)
-    uint8_t nmi_triggered;  // 1 when NMI should fire, cleared when CPU reads it
+    // Frame buffer for rendering output (provided by GUI, 256x240 ARGB8888)
+    uint32_t *frame_buffer;
 
-    // PPUDATA read buffer (internal buffering for reads from $0000-$3EFF)
-    // Reads from $3F00-$3FFF (palette) bypass the buffer
-    uint8_t ppudata_read_buffer;
+    // This PPU's registers, in the machine state arena
+    struct ppu2c02_regs *state;
 };
 
 struct ppu2c02 *ppu2c02_init();
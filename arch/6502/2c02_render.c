@@ -0,0 +1,1129 @@
+// 2c02_render.c
+//
+// Replays a frame's log of PPU-visible state changes to produce its pixels.
+// The emulation thread only records the log; all pixel work happens here,
+// either inline at VBlank or on a worker thread overlapping the next frame.
+// A frame can further be split into bands of scanlines rendered in parallel.
+//
+// Scanlines during which nothing changes copy their background from a
+// pre-rendered image of the four nametables; lines with mid-line raster
+// effects are drawn dot by dot.
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "2c02_render.h"
+#include "host_timer.h"
+#include "logger.h"
+#include "perf_counters.h"
+#include "trace_timeline.h"
+#include "palette.h"
+
+#define FRAME_PIXELS (PPU_SCREEN_WIDTH * PPU_SCREEN_HEIGHT)
+
+// The four logical nametables, 2x2 screens of 32x30 tiles
+#define BG_CACHE_WIDTH 512
+#define BG_CACHE_HEIGHT 480
+#define BG_CACHE_ROWS (BG_CACHE_HEIGHT / 8)
+
+struct ppu_frame_log {
+    struct ppu_log_entry *entries;
+    uint32_t len;
+    uint32_t cap;
+    // Number of leading entries made during the previous frame's VBlank
+    uint32_t head;
+
+    // Pattern memory snapshots taken at CHR bank switches
+    uint8_t (*chr_banks)[0x2000];
+    uint32_t chr_bank_count;
+    uint32_t chr_bank_cap;
+
+    // Bytes written by runs
+    uint8_t *run_data;
+    uint32_t run_len;
+    uint32_t run_cap;
+};
+
+struct ppu_renderer {
+    enum ppu_render_mode mode;
+    struct ppu_render_state state; // Advanced frame by frame by the replay
+    struct ppu_frame_log logs[2];
+    uint8_t cur; // Log being filled by the emulation thread
+    uint32_t *framebuffer;
+
+    // Deferred mode worker
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t running;
+    uint8_t busy;         // Worker is rendering logs[job]
+    uint8_t job;          // Log the worker renders
+    uint8_t submitted;    // At least one frame has been handed to the worker
+    uint8_t back;         // Buffer the worker renders into
+    int8_t ready;         // Buffer holding the last completed frame, -1 if none
+    uint32_t *buffers[2];
+};
+
+static struct ppu_renderer render = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .ready = -1,
+};
+
+// Background of the four logical nametables pre-rendered as palette indices:
+// 0 for transparent pixels, otherwise palette * 4 + color. Colors are looked
+// up when a line is drawn, so palette writes need no redraw.
+struct bg_cache {
+    uint8_t pixels[BG_CACHE_HEIGHT][BG_CACHE_WIDTH];
+    uint64_t dirty[BG_CACHE_ROWS]; // Tiles to redraw, bit n for column n
+    uint32_t chr_dirty[8];         // Patterns changed since the nametables
+                                   // were last checked for them
+
+    // What the pixels and dirty tiles account for
+    uint8_t bg_table;
+    uint8_t mirroring;
+    uint8_t nametable[0x800];
+    uint8_t chr[0x1000]; // Background pattern table
+};
+
+// Thread pool rendering a frame as horizontal bands of scanlines. Band 0 is
+// rendered by the thread that owns the frame, the others by the pool.
+struct band_pool {
+    pthread_t threads[PPU_RENDER_MAX_BANDS];
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint8_t count;       // Bands per frame, 1 renders the frame in one pass
+    uint8_t stop;
+    uint32_t generation; // Bumped for every frame handed to the pool
+    uint8_t pending;     // Pool bands still being rendered
+
+    // Frame being rendered
+    const struct ppu_render_state *start_state;
+    const struct ppu_frame_log *log;
+    uint32_t *fb;
+
+    // Each band replays the log from the frame's start state on its own copy
+    struct ppu_render_state states[PPU_RENDER_MAX_BANDS];
+    // Band 0's cache also serves frames rendered in one pass
+    struct bg_cache caches[PPU_RENDER_MAX_BANDS];
+};
+
+static struct band_pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .count = 1,
+};
+
+uint8_t ppu_evaluate_sprites(const uint8_t *oam, uint8_t sprite_height,
+                             int16_t scanline, struct ppu_sprite *sprites,
+                             uint8_t *count) {
+    *count = 0;
+
+    // Scan all 64 sprites in OAM
+    for (int i = 0; i < 64; i++) {
+        const uint8_t *sprite = &oam[i * 4];
+
+        // Y position is scanline where top of sprite appears (sprite drawn on
+        // Y+1 to Y+height)
+        int16_t sprite_top = sprite[0] + 1;
+        int16_t sprite_bottom = sprite[0] + sprite_height;
+
+        if (scanline < sprite_top || scanline >= sprite_bottom) {
+            continue;
+        }
+
+        if (*count == 8) {
+            // A ninth sprite on this scanline
+            return 1;
+        }
+
+        sprites[*count].y = sprite[0];
+        sprites[*count].tile = sprite[1];
+        sprites[*count].attr = sprite[2];
+        sprites[*count].x = sprite[3];
+        (*count)++;
+    }
+
+    return 0;
+}
+
+static void log_clear(struct ppu_frame_log *log) {
+    log->len = 0;
+    log->head = 0;
+    log->chr_bank_count = 0;
+    log->run_len = 0;
+}
+
+// Make room for len more entries
+static int log_reserve(struct ppu_frame_log *log, uint32_t len) {
+    if (log->len + len > log->cap) {
+        uint32_t cap = log->cap ? log->cap : 1024;
+        while (log->len + len > cap) {
+            cap *= 2;
+        }
+
+        struct ppu_log_entry *entries =
+            realloc(log->entries, cap * sizeof(struct ppu_log_entry));
+        if (!entries) {
+            LOG(LOG_PPU, LOG_LEVEL_ERROR, "Failed to grow PPU frame log");
+            return -ENOMEM;
+        }
+        log->entries = entries;
+        log->cap = cap;
+    }
+
+    return 0;
+}
+
+// Make room for len more bytes of runs
+static int log_reserve_run(struct ppu_frame_log *log, uint32_t len) {
+    if (log->run_len + len > log->run_cap) {
+        uint32_t cap = log->run_cap ? log->run_cap : 0x2000;
+        while (log->run_len + len > cap) {
+            cap *= 2;
+        }
+
+        uint8_t *run_data = realloc(log->run_data, cap);
+        if (!run_data) {
+            LOG(LOG_PPU, LOG_LEVEL_ERROR, "Failed to grow PPU run buffer");
+            return -ENOMEM;
+        }
+        log->run_data = run_data;
+        log->run_cap = cap;
+    }
+
+    return 0;
+}
+
+static struct ppu_log_entry *log_next(struct ppu_frame_log *log,
+                                      int16_t scanline) {
+    if (log->head == log->len && scanline >= 240) {
+        log->head++;
+    }
+
+    return &log->entries[log->len++];
+}
+
+static void log_append(struct ppu_frame_log *log, int16_t scanline,
+                       int16_t dot, uint8_t type, uint16_t addr,
+                       uint8_t data) {
+    struct ppu_log_entry *entry = log_next(log, scanline);
+
+    entry->scanline = scanline;
+    entry->dot = dot;
+    entry->addr = addr;
+    entry->type = type;
+    entry->data = data;
+}
+
+// A run entry and the entry after it locating its bytes in the run buffer
+static void log_append_run(struct ppu_frame_log *log, int16_t scanline,
+                           int16_t dot, uint8_t type, uint16_t addr,
+                           uint32_t offset, uint16_t len) {
+    struct ppu_log_entry *entry;
+
+    log_append(log, scanline, dot, type, addr, 0);
+    entry = log_next(log, scanline);
+    entry->run.offset = offset;
+    entry->run.len = len;
+}
+
+void ppu_render_log(int16_t scanline, int16_t dot, uint8_t type,
+                    uint16_t addr, uint8_t data) {
+    struct ppu_frame_log *log = &render.logs[render.cur];
+
+    if (log_reserve(log, 1) < 0) {
+        return;
+    }
+
+    log_append(log, scanline, dot, type, addr, data);
+}
+
+void ppu_render_log_run(int16_t scanline, int16_t dot, uint8_t type,
+                        uint16_t addr, const uint8_t *data, uint16_t len) {
+    struct ppu_frame_log *log = &render.logs[render.cur];
+
+    if (log_reserve_run(log, len) < 0) {
+        // The PPU has the bytes already, so log them one by one instead
+        uint8_t byte_type = type == PPU_LOG_VRAM_RUN ? PPU_LOG_VRAM
+                                                     : PPU_LOG_CHR;
+
+        if (log_reserve(log, len) < 0) {
+            return;
+        }
+        for (uint16_t i = 0; i < len; i++) {
+            log_append(log, scanline, dot, byte_type, addr + i, data[i]);
+        }
+        return;
+    }
+
+    if (log_reserve(log, 2) < 0) {
+        return;
+    }
+
+    log_append_run(log, scanline, dot, type, addr, log->run_len, len);
+    memcpy(&log->run_data[log->run_len], data, len);
+    log->run_len += len;
+}
+
+uint8_t *ppu_render_log_chr_bank(int16_t scanline, int16_t dot) {
+    struct ppu_frame_log *log = &render.logs[render.cur];
+
+    if (log->chr_bank_count == log->chr_bank_cap) {
+        uint32_t cap = log->chr_bank_cap ? log->chr_bank_cap * 2 : 4;
+        uint8_t(*chr_banks)[0x2000] =
+            realloc(log->chr_banks, cap * sizeof(*chr_banks));
+        if (!chr_banks) {
+            LOG(LOG_PPU, LOG_LEVEL_ERROR, "Failed to grow PPU CHR snapshots");
+            return NULL;
+        }
+        log->chr_banks = chr_banks;
+        log->chr_bank_cap = cap;
+    }
+
+    ppu_render_log(scanline, dot, PPU_LOG_CHR_BANK, log->chr_bank_count, 0);
+
+    return log->chr_banks[log->chr_bank_count++];
+}
+
+// Position of a dot within the frame, pre-render scanline first
+static int32_t frame_pos(int16_t scanline, int16_t dot) {
+    return (scanline + 1) * 341 + dot;
+}
+
+static int32_t entry_pos(const struct ppu_frame_log *log, uint32_t i) {
+    const struct ppu_log_entry *entry = &log->entries[i];
+
+    if (entry->scanline >= 240) {
+        // Changes made in the previous VBlank happen before anything is
+        // drawn, those made after the last visible scanline after everything
+        return (i < log->head) ? -1 : INT32_MAX;
+    }
+
+    return frame_pos(entry->scanline, entry->dot);
+}
+
+// Physical nametable shown as logical nametable n
+static uint8_t bg_cache_page(const struct bg_cache *c, uint8_t n) {
+    return ppu_nametable_index(c->mirroring, n << 10) >> 10;
+}
+
+// Mark the tiles drawn from a byte of nametable RAM for redraw
+static void bg_cache_mark(struct bg_cache *c, uint16_t index) {
+    uint16_t offset = index & 0x3ff;
+    uint8_t first_row = offset >> 5;
+    uint8_t last_row = first_row;
+    uint32_t columns = 1u << (offset & 0x1f);
+
+    if (offset >= 0x3c0) {
+        // An attribute byte covers 4x4 tiles
+        first_row = ((offset - 0x3c0) >> 3) * 4;
+        last_row = (first_row + 3 < 29) ? first_row + 3 : 29;
+        columns = 0xfu << (((offset - 0x3c0) & 0x07) * 4);
+    }
+
+    for (uint8_t n = 0; n < 4; n++) {
+        if (bg_cache_page(c, n) != (index >> 10)) {
+            continue;
+        }
+        for (uint8_t row = first_row; row <= last_row; row++) {
+            c->dirty[(n >> 1) * 30 + row] |= (uint64_t)columns
+                                              << ((n & 1) * 32);
+        }
+    }
+}
+
+static void bg_cache_vram(struct bg_cache *c, uint16_t index, uint8_t data) {
+    if (c->nametable[index] != data) {
+        c->nametable[index] = data;
+        bg_cache_mark(c, index);
+    }
+}
+
+static void bg_cache_chr(struct bg_cache *c, uint16_t addr, uint8_t data) {
+    uint16_t offset = addr & 0x0fff;
+
+    if ((addr >> 12) != c->bg_table || c->chr[offset] == data) {
+        return;
+    }
+
+    c->chr[offset] = data;
+    c->chr_dirty[offset >> 9] |= 1u << ((offset >> 4) & 0x1f);
+}
+
+// Start over when the background pattern table or the mirroring changes
+static void bg_cache_check_table(struct bg_cache *c,
+                                 const struct ppu_render_state *s) {
+    uint8_t bg_table = (s->ctrl & PPUCTRL_BG_TABLE) ? 1 : 0;
+
+    if (bg_table == c->bg_table && s->mirroring == c->mirroring) {
+        return;
+    }
+
+    c->bg_table = bg_table;
+    c->mirroring = s->mirroring;
+    memcpy(c->nametable, s->nametable, sizeof(c->nametable));
+    memcpy(c->chr, &s->chr[bg_table << 12], sizeof(c->chr));
+    memset(c->dirty, 0xff, sizeof(c->dirty));
+    memset(c->chr_dirty, 0, sizeof(c->chr_dirty));
+}
+
+// Catch up with a state whose changes the cache did not follow, marking only
+// the tiles that differ
+static void bg_cache_sync(struct bg_cache *c,
+                          const struct ppu_render_state *s) {
+    const uint8_t *chr;
+
+    bg_cache_check_table(c, s);
+
+    if (memcmp(c->nametable, s->nametable, sizeof(c->nametable))) {
+        for (uint16_t index = 0; index < sizeof(c->nametable); index++) {
+            bg_cache_vram(c, index, s->nametable[index]);
+        }
+    }
+
+    chr = &s->chr[c->bg_table << 12];
+    if (memcmp(c->chr, chr, sizeof(c->chr))) {
+        for (uint16_t offset = 0; offset < sizeof(c->chr); offset++) {
+            bg_cache_chr(c, (c->bg_table << 12) | offset, chr[offset]);
+        }
+    }
+}
+
+// Mark every tile that uses a changed pattern
+static void bg_cache_resolve_chr(struct bg_cache *c) {
+    uint32_t changed = 0;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        changed |= c->chr_dirty[i];
+    }
+    if (!changed) {
+        return;
+    }
+
+    for (uint16_t index = 0; index < sizeof(c->nametable); index++) {
+        uint8_t tile = c->nametable[index];
+
+        if ((index & 0x3ff) < 0x3c0 &&
+            (c->chr_dirty[tile >> 5] & (1u << (tile & 0x1f)))) {
+            bg_cache_mark(c, index);
+        }
+    }
+    memset(c->chr_dirty, 0, sizeof(c->chr_dirty));
+}
+
+static void bg_cache_draw_tile(struct bg_cache *c, uint8_t row,
+                               uint8_t column) {
+    uint8_t tile_x = column & 0x1f;
+    uint8_t tile_y = row % 30;
+    uint8_t n = ((row / 30) << 1) | (column >> 5);
+    const uint8_t *page = &c->nametable[bg_cache_page(c, n) << 10];
+    const uint8_t *pattern = &c->chr[page[tile_y * 32 + tile_x] * 16];
+
+    uint8_t attr_byte = page[0x3c0 + (tile_y / 4) * 8 + (tile_x / 4)];
+    uint8_t attr_shift = ((tile_y & 0x02) << 1) | (tile_x & 0x02);
+    uint8_t palette = ((attr_byte >> attr_shift) & 0x03) * 4;
+
+    for (uint8_t y = 0; y < 8; y++) {
+        uint8_t *out = &c->pixels[row * 8 + y][column * 8];
+
+        for (uint8_t x = 0; x < 8; x++) {
+            uint8_t bit0 = (pattern[y] >> (7 - x)) & 0x01;
+            uint8_t bit1 = (pattern[y + 8] >> (7 - x)) & 0x01;
+            uint8_t pixel_color = (bit1 << 1) | bit0;
+
+            out[x] = pixel_color ? palette + pixel_color : 0;
+        }
+    }
+}
+
+// Copy the background of a scanline starting at v out of the cache, as
+// palette indices. Returns 0 for the attribute rows below a nametable,
+// which only the per-dot path draws.
+static uint8_t bg_cache_line(struct bg_cache *c,
+                             const struct ppu_render_state *s, uint16_t v,
+                             uint8_t *line) {
+    uint16_t coarse_y = (v >> 5) & 0x1f;
+    uint16_t x, y, run;
+    uint64_t dirty;
+
+    if (coarse_y >= 30) {
+        return 0;
+    }
+
+    x = ((v >> 10) & 0x01) * 256 + (v & 0x1f) * 8 + s->x;
+    y = ((v >> 11) & 0x01) * 240 + coarse_y * 8 + ((v >> 12) & 0x07);
+
+    // Bring the tiles of this row up to date
+    bg_cache_check_table(c, s);
+    bg_cache_resolve_chr(c);
+    dirty = c->dirty[y / 8];
+    while (dirty) {
+        bg_cache_draw_tile(c, y / 8, __builtin_ctzll(dirty));
+        dirty &= dirty - 1;
+    }
+    c->dirty[y / 8] = 0;
+
+    // The window wraps around to the left nametables
+    run = BG_CACHE_WIDTH - x;
+    if (run >= PPU_SCREEN_WIDTH) {
+        memcpy(line, &c->pixels[y][x], PPU_SCREEN_WIDTH);
+    } else {
+        memcpy(line, &c->pixels[y][x], run);
+        memcpy(line + run, c->pixels[y], PPU_SCREEN_WIDTH - run);
+    }
+
+    return 1;
+}
+
+// Returns the number of entries the change took
+static uint32_t apply_entry(struct ppu_render_state *s,
+                            struct bg_cache *cache,
+                            const struct ppu_frame_log *log,
+                            const struct ppu_log_entry *entry) {
+    const struct ppu_log_entry *run = entry + 1;
+    const uint8_t *data;
+
+    switch (entry->type) {
+    case PPU_LOG_CTRL:
+        s->ctrl = entry->data;
+        break;
+    case PPU_LOG_MASK:
+        s->mask = entry->data;
+        break;
+    case PPU_LOG_SCROLL:
+        s->t = entry->addr;
+        s->x = entry->data;
+        break;
+    case PPU_LOG_VADDR:
+        // The second PPUADDR write copies t into v
+        s->t = entry->addr;
+        s->v = entry->addr;
+        break;
+    case PPU_LOG_VRAM:
+        s->nametable[entry->addr & 0x7ff] = entry->data;
+        if (cache) {
+            bg_cache_vram(cache, entry->addr & 0x7ff, entry->data);
+        }
+        break;
+    case PPU_LOG_PALETTE:
+        s->palette_table[entry->addr & 0x1f] = entry->data;
+        break;
+    case PPU_LOG_OAM:
+        s->oam[entry->addr & 0xff] = entry->data;
+        break;
+    case PPU_LOG_CHR:
+        s->chr[entry->addr & 0x1fff] = entry->data;
+        if (cache) {
+            bg_cache_chr(cache, entry->addr & 0x1fff, entry->data);
+        }
+        break;
+    case PPU_LOG_CHR_BANK:
+        memcpy(s->chr, log->chr_banks[entry->addr], sizeof(s->chr));
+        if (cache) {
+            bg_cache_sync(cache, s);
+        }
+        break;
+    case PPU_LOG_MIRRORING:
+        // The background cache starts over on its next line
+        s->mirroring = entry->data;
+        break;
+    case PPU_LOG_VRAM_RUN:
+        data = &log->run_data[run->run.offset];
+        memcpy(&s->nametable[entry->addr], data, run->run.len);
+        if (cache) {
+            for (uint16_t i = 0; i < run->run.len; i++) {
+                bg_cache_vram(cache, entry->addr + i, data[i]);
+            }
+        }
+        return 2;
+    case PPU_LOG_CHR_RUN:
+        data = &log->run_data[run->run.offset];
+        memcpy(&s->chr[entry->addr], data, run->run.len);
+        if (cache) {
+            for (uint16_t i = 0; i < run->run.len; i++) {
+                bg_cache_chr(cache, entry->addr + i, data[i]);
+            }
+        }
+        return 2;
+    }
+
+    return 1;
+}
+
+// Apply every logged change made up to the given frame position, keeping
+// the background cache, if any, in step
+static uint32_t apply_entries(struct ppu_render_state *s,
+                              struct bg_cache *cache,
+                              const struct ppu_frame_log *log, uint32_t i,
+                              int32_t pos) {
+    while (i < log->len && entry_pos(log, i) <= pos) {
+        i += apply_entry(s, cache, log, &log->entries[i]);
+    }
+    return i;
+}
+
+static uint8_t rendering_enabled(const struct ppu_render_state *s) {
+    return s->mask & (PPUMASK_BG_ENABLE | PPUMASK_SPRITE_ENABLE);
+}
+
+// Scroll updates at dot 256 of a visible scanline: move down a row and
+// reload the horizontal position from t
+static void end_line(struct ppu_render_state *s) {
+    if (rendering_enabled(s)) {
+        s->v = ppu_increment_y(s->v);
+        s->v = (s->v & ~PPU_V_HORIZONTAL) | (s->t & PPU_V_HORIZONTAL);
+    }
+}
+
+// Apply the pre-render scanline and scanlines [0, last) without drawing
+// them. Returns the first log entry not yet applied.
+static uint32_t skip_lines(struct ppu_render_state *s,
+                           const struct ppu_frame_log *log, int16_t last) {
+    uint32_t i = apply_entries(s, NULL, log, 0, frame_pos(-1, 304));
+
+    // The pre-render scanline reloads the whole scroll position from t
+    if (rendering_enabled(s)) {
+        s->v = s->t;
+    }
+
+    for (int16_t y = 0; y < last; y++) {
+        i = apply_entries(s, NULL, log, i, frame_pos(y, PPU_SCREEN_WIDTH));
+        end_line(s);
+    }
+
+    return i;
+}
+
+// Fetch the tile at tile_v the way the PPU does every 8 dots (nametable
+// byte, attribute byte, then both pattern planes) and decode its row into
+// 8 background palette indices
+static void fetch_tile(const struct ppu_render_state *s, uint16_t tile_v,
+                       uint8_t *pixels) {
+    uint16_t nametable_addr = 0x2000 | (tile_v & 0x0FFF);
+    uint8_t tile_id =
+        s->nametable[ppu_nametable_index(s->mirroring, nametable_addr)];
+
+    uint16_t attr_addr = 0x23C0 | (tile_v & 0x0C00) | ((tile_v >> 4) & 0x38) |
+                         ((tile_v >> 2) & 0x07);
+    uint8_t attr_byte =
+        s->nametable[ppu_nametable_index(s->mirroring, attr_addr)];
+    uint8_t attr_shift = ((tile_v >> 4) & 0x04) | (tile_v & 0x02);
+    uint8_t palette = ((attr_byte >> attr_shift) & 0x03) * 4;
+
+    uint16_t pattern_base = (s->ctrl & PPUCTRL_BG_TABLE) ? 0x1000 : 0x0000;
+    uint16_t pattern_addr =
+        pattern_base + (tile_id * 16) + ((tile_v >> 12) & 0x07);
+    uint8_t plane0 = s->chr[pattern_addr];
+    uint8_t plane1 = s->chr[pattern_addr + 8];
+
+    for (uint8_t x = 0; x < 8; x++) {
+        uint8_t bit0 = (plane0 >> (7 - x)) & 0x01;
+        uint8_t bit1 = (plane1 >> (7 - x)) & 0x01;
+        uint8_t pixel_color = (bit1 << 1) | bit0;
+
+        pixels[x] = pixel_color ? palette + pixel_color : 0;
+    }
+}
+
+// Render sprite pixel at given screen coordinates
+// Bit 7 of the result is set for a sprite pixel, bit 6 is the priority bit
+static uint8_t sprite_pixel(const struct ppu_render_state *s,
+                            const struct ppu_sprite *sprites, uint8_t count,
+                            uint8_t x, uint8_t y) {
+    if (!(s->mask & PPUMASK_SPRITE_ENABLE)) {
+        return 0xFF; // Sprites disabled
+    }
+
+    uint8_t sprite_height = (s->ctrl & PPUCTRL_SPRITE_SIZE) ? 16 : 8;
+    uint16_t pattern_table_base =
+        (s->ctrl & PPUCTRL_SPRITE_TABLE) ? 0x1000 : 0x0000;
+
+    for (int i = 0; i < count; i++) {
+        const struct ppu_sprite *sprite = &sprites[i];
+
+        if (x < sprite->x || x >= sprite->x + 8) {
+            continue; // Not in this sprite's X range
+        }
+
+        // Calculate pixel position within sprite (0-7 or 0-15)
+        uint8_t pixel_x = x - sprite->x;
+        uint8_t pixel_y = y - (sprite->y + 1); // +1 because Y is scanline-1
+
+        if (pixel_y >= sprite_height) {
+            continue;
+        }
+
+        if (sprite->attr & 0x40) {
+            pixel_x = 7 - pixel_x; // Horizontal flip
+        }
+        if (sprite->attr & 0x80) {
+            pixel_y = sprite_height - 1 - pixel_y; // Vertical flip
+        }
+
+        uint16_t tile_addr = pattern_table_base + (sprite->tile * 16);
+        uint8_t plane0 = s->chr[(tile_addr + pixel_y) & 0x1fff];
+        uint8_t plane1 = s->chr[(tile_addr + pixel_y + 8) & 0x1fff];
+
+        uint8_t bit0 = (plane0 >> (7 - pixel_x)) & 0x01;
+        uint8_t bit1 = (plane1 >> (7 - pixel_x)) & 0x01;
+        uint8_t pixel_color = (bit1 << 1) | bit0;
+
+        // If pixel is transparent (color 0), try next sprite
+        if (pixel_color == 0) {
+            continue;
+        }
+
+        // Sprite palettes start at $3F10
+        uint8_t palette_index = (sprite->attr & 0x03) + 4;
+        uint8_t color = s->palette_table[(palette_index * 4) + pixel_color];
+
+        return color | 0x80 | ((sprite->attr & 0x20) << 1);
+    }
+
+    return 0xFF; // No sprite pixel
+}
+
+// Combine background and sprite pixels with priority handling
+static uint8_t combine_pixels(uint8_t bg, uint8_t sprite) {
+    if (sprite == 0xFF) {
+        return bg; // No sprite, use background
+    }
+
+    uint8_t sprite_color = sprite & 0x1F;
+
+    if ((sprite & 0x40) && bg != 0) {
+        // Sprite behind an opaque background
+        return bg;
+    }
+
+    return sprite_color;
+}
+
+// Background palette indices of a scanline starting at v during which
+// nothing changes. Returns 0 if the line must be drawn dot by dot.
+static uint8_t background_line(const struct ppu_render_state *s,
+                               struct bg_cache *cache, uint16_t v,
+                               uint8_t *line) {
+    if (!(s->mask & PPUMASK_BG_ENABLE)) {
+        memset(line, 0, PPU_SCREEN_WIDTH); // Backdrop
+        return 1;
+    }
+
+    return bg_cache_line(cache, s, v, line);
+}
+
+// Render scanlines [first, last), starting from log entry i. Returns the
+// first log entry not yet applied.
+static uint32_t render_lines(struct ppu_render_state *s,
+                             struct bg_cache *cache,
+                             const struct ppu_frame_log *log, uint32_t i,
+                             int16_t first, int16_t last, uint32_t *fb) {
+    struct ppu_sprite sprites[8];
+    uint8_t sprite_count;
+    uint8_t bg[PPU_SCREEN_WIDTH];
+
+    for (int16_t y = first; y < last; y++) {
+        uint32_t *line = &fb[y * PPU_SCREEN_WIDTH];
+        uint16_t v;
+
+        // Sprite evaluation at start of scanline
+        i = apply_entries(s, cache, log, i, frame_pos(y, 1));
+        sprite_count = 0;
+        if (rendering_enabled(s)) {
+            ppu_evaluate_sprites(s->oam,
+                                 (s->ctrl & PPUCTRL_SPRITE_SIZE) ? 16 : 8, y,
+                                 sprites, &sprite_count);
+        }
+
+        v = s->v;
+        if ((i == log->len ||
+             entry_pos(log, i) > frame_pos(y, PPU_SCREEN_WIDTH)) &&
+            background_line(s, cache, v, bg)) {
+            for (int16_t x = 0; x < PPU_SCREEN_WIDTH; x++) {
+                uint8_t sprite = sprite_pixel(s, sprites, sprite_count, x, y);
+                uint8_t color =
+                    combine_pixels(s->palette_table[bg[x]], sprite);
+
+                line[x] = NES_PALETTE[color & 0x3F];
+            }
+        } else {
+            // Raster effects: follow the log, drawing a tile at a time and
+            // splitting tiles only where something changes
+            for (int16_t x = 0; x < PPU_SCREEN_WIDTH;) {
+                uint8_t tile[8];
+                int32_t end;
+
+                i = apply_entries(s, cache, log, i, frame_pos(y, x + 1));
+
+                // A change logged at dot d first shows at pixel d - 1
+                end = x + 8 - ((s->x + x) & 0x07);
+                if (i < log->len &&
+                    entry_pos(log, i) - frame_pos(y, 0) - 1 < end) {
+                    end = entry_pos(log, i) - frame_pos(y, 0) - 1;
+                }
+                if (end > PPU_SCREEN_WIDTH) {
+                    end = PPU_SCREEN_WIDTH;
+                }
+
+                if (s->mask & PPUMASK_BG_ENABLE) {
+                    fetch_tile(s, ppu_scroll_v(v, s->x, x), tile);
+                } else {
+                    memset(tile, 0, sizeof(tile)); // Backdrop
+                }
+
+                for (; x < end; x++) {
+                    uint8_t sprite =
+                        sprite_pixel(s, sprites, sprite_count, x, y);
+                    uint8_t color = combine_pixels(
+                        s->palette_table[tile[(s->x + x) & 0x07]], sprite);
+
+                    line[x] = NES_PALETTE[color & 0x3F];
+                }
+            }
+        }
+
+        end_line(s);
+    }
+
+    return i;
+}
+
+// Render scanlines [first, last) of a frame from its start state
+static uint32_t render_range(struct ppu_render_state *s,
+                             struct bg_cache *cache,
+                             const struct ppu_frame_log *log, int16_t first,
+                             int16_t last, uint32_t *fb) {
+    uint32_t i = skip_lines(s, log, first);
+
+    bg_cache_sync(cache, s);
+
+    return render_lines(s, cache, log, i, first, last, fb);
+}
+
+static void render_band(uint8_t band) {
+    struct ppu_render_state *s = &pool.states[band];
+    int16_t first = PPU_SCREEN_HEIGHT * band / pool.count;
+    int16_t last = PPU_SCREEN_HEIGHT * (band + 1) / pool.count;
+
+    // Catch up with the changes made above this band without drawing
+    memcpy(s, pool.start_state, sizeof(struct ppu_render_state));
+    render_range(s, &pool.caches[band], pool.log, first, last, pool.fb);
+}
+
+static void *band_thread(void *arg) {
+    uint8_t band = (uintptr_t)arg;
+    // The pool starts at generation 0, see start_pool(). Reading it here
+    // instead would miss a frame handed out before this thread got the lock.
+    uint32_t generation = 0;
+
+    trace_timeline_thread_name("render band");
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (!pool.stop && pool.generation == generation) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        if (pool.stop) {
+            break;
+        }
+        generation = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        HOST_TIMER_ENTER(HOST_PHASE_RENDER);
+        TRACE_ENTER("render band");
+        render_band(band);
+        TRACE_LEAVE();
+        HOST_TIMER_LEAVE();
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.pending == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return NULL;
+}
+
+static void render_bands(const struct ppu_render_state *s,
+                         const struct ppu_frame_log *log, uint32_t *fb) {
+    pthread_mutex_lock(&pool.lock);
+    pool.start_state = s;
+    pool.log = log;
+    pool.fb = fb;
+    pool.pending = pool.count - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    render_band(0);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.pending) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void render_frame(struct ppu_render_state *s,
+                         const struct ppu_frame_log *log, uint32_t *fb) {
+    uint32_t i;
+
+    HOST_TIMER_ENTER(HOST_PHASE_RENDER);
+    TRACE_ENTER("render");
+    if (pool.count > 1) {
+        render_bands(s, log, fb);
+        // The bands worked on copies, so the whole log is applied here
+        i = skip_lines(s, log, PPU_SCREEN_HEIGHT);
+    } else {
+        i = render_range(s, &pool.caches[0], log, 0, PPU_SCREEN_HEIGHT, fb);
+    }
+
+    // Changes made after the last visible scanline carry into the next frame
+    apply_entries(s, NULL, log, i, INT32_MAX);
+    TRACE_LEAVE();
+    HOST_TIMER_LEAVE();
+}
+
+static void *render_thread(void *arg) {
+    (void)arg;
+
+    trace_timeline_thread_name("render");
+    pthread_mutex_lock(&render.lock);
+    while (render.running) {
+        if (!render.busy) {
+            pthread_cond_wait(&render.cond, &render.lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&render.lock);
+        render_frame(&render.state, &render.logs[render.job],
+                     render.buffers[render.back]);
+        pthread_mutex_lock(&render.lock);
+
+        render.busy = 0;
+        pthread_cond_broadcast(&render.cond);
+    }
+    pthread_mutex_unlock(&render.lock);
+
+    return NULL;
+}
+
+// Must be called with the lock held
+static void wait_idle(void) {
+    while (render.busy) {
+        pthread_cond_wait(&render.cond, &render.lock);
+    }
+}
+
+void ppu_render_end_frame(void) {
+    struct ppu_frame_log *log = &render.logs[render.cur];
+
+    if (render.mode == PPU_RENDER_INLINE) {
+        if (render.framebuffer) {
+            PERF_PHASE_ENTER(PERF_PHASE_RENDER);
+            render_frame(&render.state, log, render.framebuffer);
+            PERF_PHASE_LEAVE();
+        } else {
+            apply_entries(&render.state, NULL, log,
+                          skip_lines(&render.state, log, PPU_SCREEN_HEIGHT),
+                          INT32_MAX);
+        }
+        log_clear(log);
+        return;
+    }
+
+    pthread_mutex_lock(&render.lock);
+    HOST_TIMER_ENTER(HOST_PHASE_RENDER_WAIT);
+    TRACE_ENTER("render wait");
+    wait_idle();
+    TRACE_LEAVE();
+    HOST_TIMER_LEAVE();
+
+    // The worker finished the previous frame, so its buffer is ready
+    if (render.submitted) {
+        render.ready = render.back;
+        render.back ^= 1;
+    }
+
+    render.job = render.cur;
+    render.cur ^= 1;
+    log_clear(&render.logs[render.cur]);
+
+    render.submitted = 1;
+    render.busy = 1;
+    pthread_cond_broadcast(&render.cond);
+    pthread_mutex_unlock(&render.lock);
+}
+
+void ppu_render_sync(void) {
+    // Only the emulation thread changes which buffer is ready, and the worker
+    // will not touch it again until the next frame is submitted
+    if (render.mode != PPU_RENDER_DEFERRED || !render.framebuffer ||
+        render.ready < 0) {
+        return;
+    }
+
+    memcpy(render.framebuffer, render.buffers[render.ready],
+           FRAME_PIXELS * sizeof(uint32_t));
+}
+
+void ppu_render_reset(const struct ppu_render_state *state) {
+    pthread_mutex_lock(&render.lock);
+    wait_idle();
+
+    memcpy(&render.state, state, sizeof(struct ppu_render_state));
+    log_clear(&render.logs[render.cur]);
+    render.submitted = 0;
+    render.ready = -1;
+
+    pthread_mutex_unlock(&render.lock);
+}
+
+void ppu_render_set_framebuffer(uint32_t *fb) { render.framebuffer = fb; }
+
+static int start_worker(void) {
+    int ret;
+
+    for (int i = 0; i < 2; i++) {
+        render.buffers[i] = calloc(FRAME_PIXELS, sizeof(uint32_t));
+        if (!render.buffers[i]) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+
+    render.running = 1;
+    render.busy = 0;
+    render.submitted = 0;
+    render.back = 0;
+    render.ready = -1;
+
+    ret = -pthread_create(&render.thread, NULL, render_thread, NULL);
+
+out:
+    if (ret < 0) {
+        render.running = 0;
+        for (int i = 0; i < 2; i++) {
+            free(render.buffers[i]);
+            render.buffers[i] = NULL;
+        }
+    }
+
+    return ret;
+}
+
+static void stop_worker(void) {
+    pthread_mutex_lock(&render.lock);
+    wait_idle();
+    render.running = 0;
+    pthread_cond_broadcast(&render.cond);
+    pthread_mutex_unlock(&render.lock);
+
+    pthread_join(render.thread, NULL);
+
+    // Publish the frame that was in flight
+    if (render.submitted && render.framebuffer) {
+        memcpy(render.framebuffer, render.buffers[render.back],
+               FRAME_PIXELS * sizeof(uint32_t));
+    }
+
+    for (int i = 0; i < 2; i++) {
+        free(render.buffers[i]);
+        render.buffers[i] = NULL;
+    }
+    render.ready = -1;
+}
+
+static void stop_pool(void) {
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (uint8_t band = 1; band < pool.count; band++) {
+        pthread_join(pool.threads[band], NULL);
+    }
+
+    pool.stop = 0;
+    pool.count = 1;
+}
+
+static int start_pool(uint8_t bands) {
+    int ret = 0;
+
+    // No band thread is running, and pthread_create() publishes this to the
+    // new ones
+    pool.count = 1;
+    pool.generation = 0;
+    for (uint8_t band = 1; band < bands; band++) {
+        ret = -pthread_create(&pool.threads[band], NULL, band_thread,
+                              (void *)(uintptr_t)band);
+        if (ret < 0) {
+            break;
+        }
+        pool.count++;
+    }
+
+    if (ret < 0) {
+        stop_pool();
+    }
+
+    return ret;
+}
+
+int ppu_render_set_bands(uint8_t bands) {
+    int ret;
+
+    if (bands < 1 || bands > PPU_RENDER_MAX_BANDS) {
+        return -EINVAL;
+    }
+
+    // Never resize the pool under a frame the render thread is drawing
+    pthread_mutex_lock(&render.lock);
+    wait_idle();
+
+    stop_pool();
+    ret = start_pool(bands);
+    if (ret < 0) {
+        printf("ERROR: Failed to start PPU band threads: %d\n", ret);
+    } else {
+        printf("PPU: Rendering frames in %u band%s\n", bands,
+               (bands > 1) ? "s" : "");
+    }
+
+    pthread_mutex_unlock(&render.lock);
+
+    return ret;
+}
+
+int ppu_render_set_mode(enum ppu_render_mode mode) {
+    int ret = 0;
+
+    if (mode == render.mode) {
+        return 0;
+    }
+
+    if (mode == PPU_RENDER_DEFERRED) {
+        ret = start_worker();
+        if (ret < 0) {
+            printf("ERROR: Failed to start PPU render thread: %d\n", ret);
+            return ret;
+        }
+    } else {
+        stop_worker();
+    }
+
+    render.mode = mode;
+    printf("PPU: %s rendering\n",
+           (mode == PPU_RENDER_DEFERRED) ? "Deferred" : "Inline");
+
+    return ret;
+}
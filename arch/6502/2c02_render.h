@@ -0,0 +1,181 @@
+#ifndef __2C02_RENDER_H__
+#define __2C02_RENDER_H__
+
+#include <assert.h>
+#include <stdint.h>
+
+// Deferred PPU rendering
+//
+// The emulation thread records every PPU-visible state change made during a
+// frame into a log, timestamped with the (scanline, dot) the PPU was at when
+// the CPU made the change. At the end of the frame the log is replayed over
+// a private copy of the PPU state to produce the pixels, either inline or on
+// a worker thread while the CPU is already emulating the next frame.
+//
+// Since the log fixes the state at every dot, scanlines are independent and
+// a frame can be split into bands rendered on a small thread pool.
+
+#define PPU_SCREEN_WIDTH 256
+#define PPU_SCREEN_HEIGHT 240
+
+#define PPU_RENDER_MAX_BANDS 8
+
+// Bits of PPUCTRL / PPUMASK used by the renderer
+#define PPUCTRL_SPRITE_TABLE 0x08
+#define PPUCTRL_BG_TABLE 0x10
+#define PPUCTRL_SPRITE_SIZE 0x20
+#define PPUMASK_BG_ENABLE 0x08
+#define PPUMASK_SPRITE_ENABLE 0x10
+
+enum ppu_render_mode {
+    PPU_RENDER_INLINE,   // Replay the log on the emulation thread at VBlank
+    PPU_RENDER_DEFERRED, // Replay the log on a worker thread
+};
+
+enum ppu_log_type {
+    PPU_LOG_CTRL,      // data = PPUCTRL
+    PPU_LOG_MASK,      // data = PPUMASK
+    PPU_LOG_SCROLL,    // addr = t, data = fine x
+    PPU_LOG_VADDR,     // addr = v (= t)
+    PPU_LOG_VRAM,      // addr = nametable RAM index (0-0x7ff)
+    PPU_LOG_PALETTE,   // addr = palette index (0-0x1f)
+    PPU_LOG_OAM,       // addr = OAM index (0-0xff)
+    PPU_LOG_CHR,       // addr = pattern address (0-0x1fff)
+    PPU_LOG_CHR_BANK,  // addr = CHR snapshot index in the frame log
+    PPU_LOG_MIRRORING, // data = nametable mirroring
+    PPU_LOG_VRAM_RUN,  // addr = first nametable RAM index, within one 1KB
+    PPU_LOG_CHR_RUN,   // addr = first pattern address, within one 1KB
+};
+
+// Runs take two entries: the first as any other, the second holding where
+// the bytes are in the frame log's run buffer
+struct ppu_log_entry {
+    union {
+        struct {
+            int16_t scanline;
+            int16_t dot;
+            uint16_t addr;
+            uint8_t type;
+            uint8_t data;
+        };
+        struct {
+            uint32_t offset;
+            uint16_t len;
+        } run;
+    };
+};
+
+static_assert(sizeof(struct ppu_log_entry) == 8, "PPU log entry grew");
+
+// Everything the renderer needs to produce pixels
+struct ppu_render_state {
+    uint8_t ctrl;
+    uint8_t mask;
+    uint8_t x;
+    uint8_t mirroring;
+    uint16_t t;
+    uint16_t v;
+    uint8_t palette_table[0x20];
+    uint8_t oam[256];
+    uint8_t nametable[0x800];
+    uint8_t chr[0x2000]; // PPU-visible view of $0000-$1FFF
+};
+
+struct ppu_sprite {
+    uint8_t y;
+    uint8_t tile;
+    uint8_t attr;
+    uint8_t x;
+};
+
+// Map a $2000-$3EFF address onto the 2KB of nametable RAM. mirroring is
+// 0 = horizontal, 1 = vertical, 2/3 = single-screen lower/upper.
+static inline uint16_t ppu_nametable_index(uint8_t mirroring, uint16_t addr) {
+    uint8_t nametable = (addr >> 10) & 0x03;
+
+    switch (mirroring) {
+    case 0:
+        // Horizontal mirroring: $2000 = $2400, $2800 = $2C00
+        return ((nametable >> 1) << 10) | (addr & 0x03FF);
+    case 2:
+    case 3:
+        // Single screen: all four are the same 1KB
+        return ((mirroring & 0x01) << 10) | (addr & 0x03FF);
+    }
+    // Vertical mirroring: $2000 = $2800, $2400 = $2C00
+    return ((nametable & 0x01) << 10) | (addr & 0x03FF);
+}
+
+// Scrolling works on the PPU's internal address register v:
+//   yyy NN YYYYY XXXXX
+//   fine Y, nametable select, coarse Y, coarse X
+#define PPU_V_HORIZONTAL 0x041F
+#define PPU_V_VERTICAL 0x7BE0
+
+// Move v down one pixel row at the end of a scanline
+static inline uint16_t ppu_increment_y(uint16_t v) {
+    if ((v & 0x7000) != 0x7000) {
+        return v + 0x1000; // Fine Y
+    }
+
+    v &= ~0x7000;
+    uint8_t coarse_y = (v >> 5) & 0x1F;
+    if (coarse_y == 29) {
+        coarse_y = 0;
+        v ^= 0x0800; // Switch vertical nametable
+    } else if (coarse_y == 31) {
+        coarse_y = 0; // Attribute rows wrap without switching nametable
+    } else {
+        coarse_y++;
+    }
+
+    return (v & ~0x03E0) | (coarse_y << 5);
+}
+
+// v for the tile under pixel x of a scanline that starts at v with fine X
+// scroll fine_x. The pixel's column within that tile is (fine_x + x) & 7.
+static inline uint16_t ppu_scroll_v(uint16_t v, uint8_t fine_x, uint8_t x) {
+    uint16_t coarse_x = (v & 0x1F) + ((fine_x + x) >> 3);
+    uint16_t tile_v = (v & ~0x001F) | (coarse_x & 0x1F);
+
+    if (coarse_x & 0x20) {
+        tile_v ^= 0x0400; // Switch horizontal nametable
+    }
+    return tile_v;
+}
+
+// Find up to 8 sprites on a scanline. Returns 1 on sprite overflow.
+uint8_t ppu_evaluate_sprites(const uint8_t *oam, uint8_t sprite_height,
+                             int16_t scanline, struct ppu_sprite *sprites,
+                             uint8_t *count);
+
+// Start a new log from a full copy of the current PPU state
+void ppu_render_reset(const struct ppu_render_state *state);
+
+// Record a PPU-visible state change
+void ppu_render_log(int16_t scanline, int16_t dot, uint8_t type,
+                    uint16_t addr, uint8_t data);
+
+// Record a run of writes to consecutive addresses as a single entry of type
+// PPU_LOG_VRAM_RUN or PPU_LOG_CHR_RUN, which the renderer copies in one go
+void ppu_render_log_run(int16_t scanline, int16_t dot, uint8_t type,
+                        uint16_t addr, const uint8_t *data, uint16_t len);
+
+// Record a CHR bank switch. Returns the 8KB buffer the caller must fill with
+// the new PPU-visible pattern memory.
+uint8_t *ppu_render_log_chr_bank(int16_t scanline, int16_t dot);
+
+// Close the current frame's log and render it into the frame buffer
+void ppu_render_end_frame(void);
+
+// Publish the most recently completed deferred frame into the frame buffer
+void ppu_render_sync(void);
+
+void ppu_render_set_framebuffer(uint32_t *fb);
+
+int ppu_render_set_mode(enum ppu_render_mode mode);
+
+// Split each frame into this many bands of scanlines rendered in parallel
+int ppu_render_set_bands(uint8_t bands);
+
+#endif /* __2C02_RENDER_H__ */
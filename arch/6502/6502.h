@@ -29,20 +29,9 @@ struct instruction {
     uint8_t cycles;
 };
 
-struct cpu6502 {
-    fp_nmi nmi;
-    fp_irq irq;
-    fp_reset reset;
-    fp_read read;
-    fp_write write;
-    fp_fetch fetch;
-    fp_execute execute;
-    fp_clock clock;
-    fp_connect_bus connect_bus;
-    fp_print_regs print_regs;
-
-    struct nesbus *bus;
-
+// Registers and decode state of the CPU. They live in the machine state
+// arena (nes_state.h) and are reached as nes_state->cpu_regs.
+struct cpu6502_regs {
     union {
         struct {
             uint8_t C : 1;
@@ -62,14 +51,31 @@ struct cpu6502 {
     uint16_t PC;
     uint8_t sp;
 
+    uint8_t opcode;
+    uint8_t operand;
+    uint16_t operand_addr;
+    uint16_t cycles;
+
     // DEBUG purposes
     uint16_t start_pc;
+};
+
+struct cpu6502 {
+    fp_nmi nmi;
+    fp_irq irq;
+    fp_reset reset;
+    fp_read read;
+    fp_write write;
+    fp_fetch fetch;
+    fp_execute execute;
+    fp_clock clock;
+    fp_connect_bus connect_bus;
+    fp_print_regs print_regs;
+
+    struct nesbus *bus;
+    struct cpu6502_regs *state;
 
-    uint8_t opcode;
     struct instruction *curr_insn;
-    uint8_t operand;
-    uint16_t operand_addr;
-    uint8_t cycles;
 };
 
 #define SP(x) ((x.sp + 0x100))
@@ -82,9 +88,18 @@ struct cpu6502 {
 #define DECODE_B(inst) ((inst >> 2) & 0x7)
 #define DECODE_C(inst) ((inst)&0x3)
 
-#define GET_FLAG(f) (cpu.flags.f)
-#define SET_FLAG(f, v) (cpu.flags.f = !!(v))
+#define GET_FLAG(f) (regs.flags.f)
+#define SET_FLAG(f, v) (regs.flags.f = !!(v))
 
 struct cpu6502 *cpu6502_init();
 
+#ifdef NES_MAPPER_CORES
+// CPU cores with a mapper's memory path built in, installed as cpu.clock when
+// a cartridge with that mapper is connected. See 6502_core.h.
+void cpu6502_clock_nrom(void);
+void cpu6502_clock_mmc1(void);
+void cpu6502_clock_mmc3(void);
+void cpu6502_clock_discrete(void);
+#endif
+
 #endif /* __6502_H__ */
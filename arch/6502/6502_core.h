@@ -0,0 +1,1537 @@
+// 6502_core.h
+//
+// The 6502 interpreter, included once by every file that builds a CPU core.
+// 6502.c builds the generic core, which reaches memory through cpu.read and
+// cpu.write. With NES_MAPPER_CORES, 6502_core_<board>.c build one core per
+// mapper family: they define CORE_MAPPER_WRITE before including this file,
+// and accesses to plain memory are then compiled into every instruction as
+// bus page table lookups instead of calls through the bus, cartridge and
+// mapper function pointers.
+//
+// The CPU registers are in the machine state arena and shared by all cores,
+// only the code is duplicated.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "6502.h"
+#include "host_timer.h"
+#include "nes_state.h"
+#include "probes.h"
+
+#include "debug.h"
+
+#ifdef CPU_PROFILE
+#include "6502_hotspot.h"
+#include "6502_profile.h"
+
+// Extra cycle the addressing mode of the current instruction asked for
+static uint8_t profile_page_cross;
+#endif
+
+extern struct cpu6502 cpu6502_state;
+#define cpu cpu6502_state
+#define regs (nes_state->cpu_regs)
+
+#ifdef CORE_MAPPER_WRITE
+// Plain memory is reached straight through the bus page tables. Only
+// mapper register writes differ between cores, everything else with side
+// effects goes to the bus I/O handlers.
+static inline uint8_t core_read(uint16_t addr) {
+    uint8_t *page = cpu.bus->read_page[addr >> NES_PAGE_SHIFT];
+    uint8_t data;
+
+    if (page) {
+        return page[addr & (NES_PAGE_SIZE - 1)];
+    }
+    HOST_TIMER_ENTER(HOST_PHASE_BUS);
+    data = cpu.bus->io_read[addr >> NES_PAGE_SHIFT](addr);
+    HOST_TIMER_LEAVE();
+    return data;
+}
+
+static inline void core_write(uint16_t addr, uint8_t data) {
+    uint8_t *page = cpu.bus->write_page[addr >> NES_PAGE_SHIFT];
+
+    if (page) {
+        page[addr & (NES_PAGE_SIZE - 1)] = data;
+    } else if (addr >= 0x8000) {
+        HOST_TIMER_ENTER(HOST_PHASE_MAPPER);
+        CORE_MAPPER_WRITE(cpu.bus->cart->map, addr, data);
+        HOST_TIMER_LEAVE();
+    } else {
+        HOST_TIMER_ENTER(HOST_PHASE_BUS);
+        cpu.bus->io_write[addr >> NES_PAGE_SHIFT](addr, data);
+        HOST_TIMER_LEAVE();
+    }
+}
+
+#define CORE_READ(addr) core_read(addr)
+#define CORE_WRITE(addr, data) core_write(addr, data)
+#else
+#define CORE_READ(addr) cpu.read(addr)
+#define CORE_WRITE(addr, data) cpu.write(addr, data)
+#endif
+
+// Each should return how many extra clock cycles are required
+// based on the caveats in the cpu docs
+static uint8_t IMP();
+static uint8_t ACC();
+static uint8_t IMM();
+static uint8_t ZPG();
+static uint8_t ZPX();
+static uint8_t ZPY();
+static uint8_t REL();
+static uint8_t ABS();
+static uint8_t ABX();
+static uint8_t ABY();
+static uint8_t IND();
+static uint8_t IDX();
+static uint8_t IDY();
+
+static uint8_t ADC();
+static uint8_t AND();
+static uint8_t ASL();
+static uint8_t BCC();
+static uint8_t BCS();
+static uint8_t BEQ();
+static uint8_t BIT();
+static uint8_t BMI();
+static uint8_t BNE();
+static uint8_t BPL();
+static uint8_t BRK();
+static uint8_t BVC();
+static uint8_t BVS();
+static uint8_t CLC();
+static uint8_t CLD();
+static uint8_t CLI();
+static uint8_t CLV();
+static uint8_t CMP();
+static uint8_t CPX();
+static uint8_t CPY();
+static uint8_t DEC();
+static uint8_t DEX();
+static uint8_t DEY();
+static uint8_t EOR();
+static uint8_t INC();
+static uint8_t INX();
+static uint8_t INY();
+static uint8_t JMP();
+static uint8_t JSR();
+static uint8_t LDA();
+static uint8_t LDX();
+static uint8_t LDY();
+static uint8_t LSR();
+static uint8_t NOP();
+static uint8_t ORA();
+static uint8_t PHA();
+static uint8_t PHP();
+static uint8_t PLA();
+static uint8_t PLP();
+static uint8_t ROL();
+static uint8_t ROR();
+static uint8_t RTI();
+static uint8_t RTS();
+static uint8_t SBC();
+static uint8_t SEC();
+static uint8_t SED();
+static uint8_t SEI();
+static uint8_t STA();
+static uint8_t STX();
+static uint8_t STY();
+static uint8_t TAX();
+static uint8_t TAY();
+static uint8_t TSX();
+static uint8_t TXA();
+static uint8_t TXS();
+static uint8_t TYA();
+static uint8_t XXX(); // invalid opcode
+
+static struct instruction invalid_opcode = {"???", 0x00, &XXX, &IMP, 2};
+
+// This lookup table is based on the layout as described in:
+// https://www.masswerk.at/6502/6502_instruction_set.html
+// c a b
+static struct instruction instruction_table[3][8][8] = {
+    {
+        {{"BRK", 0x00, &BRK, &IMP, 7},
+         {"???", 0x04, &XXX, &IMP, 2},
+         {"PHP", 0x08, &PHP, &IMP, 3},
+         {"???", 0x0C, &XXX, &IMP, 2},
+         {"BPL", 0x10, &BPL, &REL, 2},
+         {"???", 0x14, &XXX, &IMP, 2},
+         {"CLC", 0x18, &CLC, &IMP, 2},
+         {"???", 0x1C, &XXX, &IMP, 2}},
+        {{"JSR", 0x20, &JSR, &ABS, 6},
+         {"BIT", 0x24, &BIT, &ZPG, 3},
+         {"PLP", 0x28, &PLP, &IMP, 4},
+         {"BIT", 0x2C, &BIT, &ABS, 4},
+         {"BMI", 0x30, &BMI, &REL, 2},
+         {"???", 0x34, &XXX, &IMP, 2},
+         {"SEC", 0x38, &SEC, &IMP, 2},
+         {"???", 0x3C, &XXX, &IMP, 2}},
+        {{"RTI", 0x40, &RTI, &IMP, 6},
+         {"???", 0x44, &XXX, &IMP, 2},
+         {"PHA", 0x48, &PHA, &IMP, 3},
+         {"JMP", 0x4C, &JMP, &ABS, 3},
+         {"BVC", 0x50, &BVC, &REL, 2},
+         {"???", 0x54, &XXX, &IMP, 2},
+         {"CLI", 0x58, &CLI, &IMP, 2},
+         {"???", 0x5C, &XXX, &IMP, 2}},
+        {{"RTS", 0x60, &RTS, &IMP, 6},
+         {"???", 0x64, &XXX, &IMP, 2},
+         {"PLA", 0x68, &PLA, &IMP, 4},
+         {"JMP", 0x6C, &JMP, &IND, 5},
+         {"BVS", 0x70, &BVS, &REL, 2},
+         {"???", 0x74, &XXX, &IMP, 2},
+         {"SEI", 0x78, &SEI, &IMP, 2},
+         {"???", 0x7C, &XXX, &IMP, 2}},
+        {{"???", 0x80, &XXX, &IMP, 2},
+         {"STY", 0x84, &STY, &ZPG, 3},
+         {"DEY", 0x88, &DEY, &IMP, 2},
+         {"STY", 0x8C, &STY, &ABS, 4},
+         {"BCC", 0x90, &BCC, &REL, 2},
+         {"STY", 0x94, &STY, &ZPX, 4},
+         {"TYA", 0x98, &TYA, &IMP, 2},
+         {"???", 0x9C, &XXX, &IMP, 2}},
+        {{"LDY", 0xA0, &LDY, &IMM, 2},
+         {"LDY", 0xA4, &LDY, &ZPG, 3},
+         {"TAY", 0xA8, &TAY, &IMP, 2},
+         {"LDY", 0xAC, &LDY, &ABS, 4},
+         {"BCS", 0xB0, &BCS, &REL, 2},
+         {"LDY", 0xB4, &LDY, &ZPX, 4},
+         {"CLV", 0xB8, &CLV, &IMP, 2},
+         {"LDY", 0xBC, &LDY, &ABX, 4}},
+        {{"CPY", 0xC0, &CPY, &IMM, 2},
+         {"CPY", 0xC4, &CPY, &ZPG, 3},
+         {"INY", 0xC8, &INY, &IMP, 2},
+         {"CPY", 0xCC, &CPY, &ABS, 4},
+         {"BNE", 0xD0, &BNE, &REL, 2},
+         {"???", 0xD4, &XXX, &IMP, 2},
+         {"CLD", 0xD8, &CLD, &IMP, 2},
+         {"???", 0xDC, &XXX, &IMP, 2}},
+        {{"CPX", 0xE0, &CPX, &IMM, 2},
+         {"CPX", 0xE4, &CPX, &ZPG, 3},
+         {"INX", 0xE8, &INX, &IMP, 2},
+         {"CPX", 0xEC, &CPX, &ABS, 4},
+         {"BEQ", 0xF0, &BEQ, &REL, 2},
+         {"???", 0xF4, &XXX, &IMP, 2},
+         {"SED", 0xF8, &SED, &IMP, 2},
+         {"???", 0xFC, &XXX, &IMP, 2}},
+    },
+    {
+        {{"ORA", 0x01, &ORA, &IDX, 6},
+         {"ORA", 0x05, &ORA, &ZPG, 3},
+         {"ORA", 0x09, &ORA, &IMM, 2},
+         {"ORA", 0x0D, &ORA, &ABS, 4},
+         {"ORA", 0x11, &ORA, &IDY, 5},
+         {"ORA", 0x15, &ORA, &ZPX, 2},
+         {"ORA", 0x19, &ORA, &ABY, 4},
+         {"ORA", 0x1D, &ORA, &ABX, 4}},
+        {{"AND", 0x21, &AND, &IDX, 6},
+         {"AND", 0x25, &AND, &ZPG, 3},
+         {"AND", 0x29, &AND, &IMM, 2},
+         {"AND", 0x2D, &AND, &ABS, 4},
+         {"AND", 0x31, &AND, &IDY, 5},
+         {"AND", 0x35, &AND, &ZPX, 4},
+         {"AND", 0x39, &AND, &ABY, 4},
+         {"AND", 0x3D, &AND, &ABX, 4}},
+        {{"EOR", 0x41, &EOR, &IDX, 6},
+         {"EOR", 0x45, &EOR, &ZPG, 3},
+         {"EOR", 0x49, &EOR, &IMM, 2},
+         {"EOR", 0x4D, &EOR, &ABS, 4},
+         {"EOR", 0x51, &EOR, &IDY, 5},
+         {"EOR", 0x55, &EOR, &ZPX, 4},
+         {"EOR", 0x59, &EOR, &ABY, 4},
+         {"EOR", 0x5D, &EOR, &ABX, 4}},
+        {{"ADC", 0x61, &ADC, &IDX, 6},
+         {"ADC", 0x65, &ADC, &ZPG, 3},
+         {"ADC", 0x69, &ADC, &IMM, 2},
+         {"ADC", 0x6D, &ADC, &ABS, 4},
+         {"ADC", 0x71, &ADC, &IDY, 5},
+         {"ADC", 0x75, &ADC, &ZPX, 4},
+         {"ADC", 0x79, &ADC, &ABY, 4},
+         {"ADC", 0x7D, &ADC, &ABX, 4}},
+        {{"STA", 0x81, &STA, &IDX, 6},
+         {"STA", 0x85, &STA, &ZPG, 3},
+         {"???", 0x89, &XXX, &IMP, 2},
+         {"STA", 0x8D, &STA, &ABS, 4},
+         {"STA", 0x91, &STA, &IDY, 6},
+         {"STA", 0x95, &STA, &ZPX, 4},
+         {"STA", 0x99, &STA, &ABY, 5},
+         {"STA", 0x9D, &STA, &ABX, 5}},
+        {{"LDA", 0xA1, &LDA, &IDX, 6},
+         {"LDA", 0xA5, &LDA, &ZPG, 3},
+         {"LDA", 0xA9, &LDA, &IMM, 2},
+         {"LDA", 0xAD, &LDA, &ABS, 4},
+         {"LDA", 0xB1, &LDA, &IDY, 5},
+         {"LDA", 0xB5, &LDA, &ZPX, 4},
+         {"LDA", 0xB9, &LDA, &ABY, 4},
+         {"LDA", 0xBD, &LDA, &ABX, 4}},
+        {{"CMP", 0xC1, &CMP, &IDX, 6},
+         {"CMP", 0xC5, &CMP, &ZPG, 3},
+         {"CMP", 0xC9, &CMP, &IMM, 2},
+         {"CMP", 0xCD, &CMP, &ABS, 4},
+         {"CMP", 0xD1, &CMP, &IDY, 5},
+         {"CMP", 0xD5, &CMP, &ZPX, 4},
+         {"CMP", 0xD9, &CMP, &ABY, 4},
+         {"CMP", 0xDD, &CMP, &ABX, 4}},
+        {{"SBC", 0xE1, &SBC, &IDX, 6},
+         {"SBC", 0xE5, &SBC, &ZPG, 3},
+         {"SBC", 0xE9, &SBC, &IMM, 2},
+         {"SBC", 0xED, &SBC, &ABS, 4},
+         {"SBC", 0xF1, &SBC, &IDY, 5},
+         {"SBC", 0xF5, &SBC, &ZPX, 4},
+         {"SBC", 0xF9, &SBC, &ABY, 4},
+         {"SBC", 0xFD, &SBC, &ABX, 4}},
+    },
+    {
+        {{"???", 0x02, &XXX, &IMP, 2},
+         {"ASL", 0x06, &ASL, &ZPG, 2},
+         {"ASL", 0x0A, &ASL, &ACC, 2},
+         {"ASL", 0x0E, &ASL, &ABS, 6},
+         {"???", 0x12, &XXX, &IMP, 2},
+         {"ASL", 0x16, &ASL, &ZPX, 6},
+         {"???", 0x1A, &XXX, &IMP, 2},
+         {"ASL", 0x1E, &ASL, &ABX, 7}},
+        {{"???", 0x22, &XXX, &IMP, 2},
+         {"ROL", 0x26, &ROL, &ZPG, 2},
+         {"ROL", 0x2A, &ROL, &ACC, 2},
+         {"ROL", 0x2E, &ROL, &ABS, 6},
+         {"???", 0x32, &XXX, &IMP, 2},
+         {"ROL", 0x36, &ROL, &ZPX, 6},
+         {"???", 0x3A, &XXX, &IMP, 2},
+         {"ROL", 0x3E, &ROL, &ABX, 7}},
+        {{"???", 0x42, &XXX, &IMP, 2},
+         {"LSR", 0x46, &LSR, &ZPG, 5},
+         {"LSR", 0x4A, &LSR, &ACC, 2},
+         {"LSR", 0x4E, &LSR, &ABS, 6},
+         {"???", 0x52, &XXX, &IMP, 2},
+         {"LSR", 0x56, &LSR, &ZPX, 6},
+         {"???", 0x5A, &XXX, &IMP, 2},
+         {"LSR", 0x5E, &LSR, &ABX, 7}},
+        {{"???", 0x62, &XXX, &IMP, 2},
+         {"ROR", 0x66, &ROR, &ZPG, 2},
+         {"ROR", 0x6A, &ROR, &ACC, 2},
+         {"ROR", 0x6E, &ROR, &ABS, 6},
+         {"???", 0x72, &XXX, &IMP, 2},
+         {"ROR", 0x76, &ROR, &ZPX, 6},
+         {"???", 0x7A, &XXX, &IMP, 2},
+         {"ROR", 0x7E, &ROR, &ABX, 7}},
+        {{"???", 0x82, &XXX, &IMP, 2},
+         {"STX", 0x86, &STX, &ZPG, 3},
+         {"TXA", 0x8A, &TXA, &IMP, 2},
+         {"STX", 0x8E, &STX, &ABS, 4},
+         {"???", 0x92, &XXX, &IMP, 2},
+         {"STX", 0x96, &STX, &ZPY, 4},
+         {"TXS", 0x9A, &TXS, &IMP, 2},
+         {"???", 0x9E, &XXX, &IMP, 2}},
+        {{"LDX", 0xA2, &LDX, &IMM, 2},
+         {"LDX", 0xA6, &LDX, &ZPG, 3},
+         {"TAX", 0xAA, &TAX, &IMP, 2},
+         {"LDX", 0xAE, &LDX, &ABS, 4},
+         {"???", 0xB2, &XXX, &IMP, 2},
+         {"LDX", 0xB6, &LDX, &ZPY, 4},
+         {"TSX", 0xBA, &TSX, &IMP, 2},
+         {"LDX", 0xBE, &LDX, &ABY, 4}},
+        {{"???", 0xC2, &XXX, &IMP, 2},
+         {"DEC", 0xC6, &DEC, &ZPG, 5},
+         {"DEX", 0xCA, &DEX, &IMP, 2},
+         {"DEC", 0xCE, &DEC, &ABS, 6},
+         {"???", 0xD2, &XXX, &IMP, 2},
+         {"DEC", 0xD6, &DEC, &ZPX, 6},
+         {"???", 0xDA, &XXX, &IMP, 2},
+         {"DEC", 0xDE, &DEC, &ABX, 7}},
+        {{"???", 0xE2, &XXX, &IMP, 2},
+         {"INC", 0xE6, &INC, &ZPG, 5},
+         {"NOP", 0xEA, &NOP, &IMP, 2},
+         {"INC", 0xEE, &INC, &ABS, 6},
+         {"???", 0xF2, &XXX, &IMP, 2},
+         {"INC", 0xF6, &INC, &ZPX, 6},
+         {"???", 0xFA, &XXX, &IMP, 2},
+         {"INC", 0xFE, &INC, &ABX, 7}},
+    },
+};
+
+static uint8_t IMP() {
+    // No operand
+    regs.operand = 0;
+    return 0;
+}
+
+static uint8_t ACC() {
+    // Operand is implied to be the A register
+    regs.operand = regs.A;
+    return 0;
+}
+
+static uint8_t IMM() {
+    regs.operand_addr = regs.PC++;
+
+    return 0;
+}
+
+static uint8_t ZPG() {
+    regs.operand_addr = (uint16_t)CORE_READ(regs.PC++);
+
+    return 0;
+}
+
+static uint8_t ZPX() {
+    regs.operand_addr = ((uint16_t)CORE_READ(regs.PC++) + regs.X) & 0xff;
+    log_print("ZPX OPERAND ADDR: %02x\n", regs.operand_addr);
+    return 0;
+}
+
+static uint8_t ZPY() {
+    regs.operand_addr = ((uint16_t)CORE_READ(regs.PC++) + regs.Y) & 0xff;
+
+    return 0;
+}
+
+static uint8_t REL() {
+    uint16_t rel_addr;
+
+    rel_addr = CORE_READ(regs.PC++);
+
+    if (rel_addr & 0x80)
+        rel_addr |= 0xFF00;
+
+    regs.operand_addr = rel_addr;
+
+    return 1;
+}
+
+static uint8_t ABS() {
+    regs.operand_addr = CORE_READ(regs.PC++);
+    regs.operand_addr |= CORE_READ(regs.PC++) << 8;
+
+    return 0;
+}
+
+static uint8_t ABX() {
+    uint16_t page_check;
+
+    regs.operand_addr = CORE_READ(regs.PC++);
+    page_check = CORE_READ(regs.PC++);
+    regs.operand_addr |= page_check << 8;
+    regs.operand_addr += regs.X;
+
+    // According to the 6502 manual, if the addition of X causes
+    // this to cross a page, then add one cycle
+    if ((regs.operand_addr >> 8) != page_check)
+        return 1;
+
+    return 0;
+}
+
+static uint8_t ABY() {
+    uint16_t page_check;
+
+    regs.operand_addr = CORE_READ(regs.PC++);
+    page_check = CORE_READ(regs.PC++);
+    regs.operand_addr |= page_check << 8;
+    regs.operand_addr += regs.Y;
+
+    // According to the 6502 manual, if the addition of Y causes
+    // this to cross a page, then add one cycle
+    if ((regs.operand_addr >> 8) != page_check)
+        return 1;
+
+    return 0;
+}
+
+static uint8_t IND() {
+    uint16_t ind_addr;
+
+    ind_addr = CORE_READ(regs.PC++);
+    ind_addr |= CORE_READ(regs.PC++) << 8;
+
+    if ((ind_addr & 0x00FF) == 0xFF) {
+        // https://www.qmtpro.com/~nes/misc/nestest.txt
+        // 007h - JMP () data reading didn't wrap properly (this fails on a
+        // 65C02)
+        regs.operand_addr = CORE_READ(ind_addr);
+        regs.operand_addr |= CORE_READ(ind_addr & 0xff00) << 8;
+        log_print("IND operand addr %04x (from %04x wrapped)\n",
+                  regs.operand_addr, ind_addr);
+    } else {
+        regs.operand_addr = CORE_READ(ind_addr++);
+        regs.operand_addr |= CORE_READ(ind_addr) << 8;
+    }
+    return 0;
+}
+
+static uint8_t IDX() {
+    uint16_t ind_addr;
+
+    ind_addr = CORE_READ(regs.PC++);
+    log_print("IDX indirect addr: %04x\n", ind_addr);
+    ind_addr += regs.X;
+
+    // Zero page wrap around
+    ind_addr &= 0xff;
+    log_print("IDX indirect addr + x & ff: %04x\n", ind_addr);
+
+    regs.operand_addr = CORE_READ(ind_addr++);
+    regs.operand_addr |= CORE_READ(ind_addr & 0xff) << 8;
+    log_print("IDX OPERAND ADDR: %02x\n", regs.operand_addr);
+
+    return 0;
+}
+
+static uint8_t IDY() {
+    uint16_t ind_addr;
+
+    ind_addr = CORE_READ(regs.PC++);
+    log_print("IDY indirect addr in zero page: %04x\n", ind_addr);
+
+    regs.operand_addr = CORE_READ(ind_addr++);
+    regs.operand_addr |= CORE_READ(ind_addr & 0xFF) << 8;
+    log_print("IDY OPERAND ADDR: %02x\n", regs.operand_addr);
+
+    ind_addr = regs.operand_addr + regs.Y;
+    log_print("IDY addr + y: %04x\n", ind_addr);
+
+    regs.operand_addr = ind_addr;
+
+    if ((regs.operand_addr & 0xff00) != (ind_addr & 0xff00))
+        return 1;
+
+    return 0;
+}
+
+// if ( ( cpu.curr_insn->addr_mode != IMP ) &&
+// 	 ( cpu.curr_insn->addr_mode != ACC ) )
+// 	regs.operand = CORE_READ( regs.operand_addr );
+
+// if ( cpu.curr_insn->addr_mode == ACC )
+// 	regs.operand = regs.A;
+
+//     A + M + C -> A, C                N Z C I D V
+//                                      + + + - - +
+static uint8_t ADC() {
+    uint16_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    tmp = (uint16_t)regs.A + (uint16_t)regs.operand + (uint16_t)GET_FLAG(C);
+    SET_FLAG(C, (tmp > 0xFF));
+
+    // 1 + -1 = 0, c <- 1
+    if (((regs.A & 0x80) ^ (regs.operand & 0x80)) && !tmp)
+        SET_FLAG(C, 1);
+
+    // Set flags
+    tmp &= 0x00FF;
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!tmp));
+    // See
+    // https://github.com/OneLoneCoder/olcNES/blob/master/Part%232%20-%20CPU/olc6502.cpp#L601
+    SET_FLAG(V, (~((uint16_t)regs.A ^ (uint16_t)regs.operand) &
+                 ((uint16_t)regs.A ^ (uint16_t)tmp)) &
+                    0x0080);
+
+    regs.A = tmp & 0x00FF;
+
+    return 0;
+}
+
+//     A AND M -> A                     N Z C I D V
+//                                      + + - - - -
+static uint8_t AND() {
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    regs.A = regs.A & regs.operand;
+
+    // Set flags
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+
+    return 0;
+}
+
+//     C <- [76543210] <- 0             N Z C I D V
+//                                      + + + - - -
+static uint8_t ASL() {
+    uint8_t tmp;
+
+    if ((cpu.curr_insn->addr_mode != IMP) && (cpu.curr_insn->addr_mode != ACC))
+        regs.operand = CORE_READ(regs.operand_addr);
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.operand = regs.A;
+
+    SET_FLAG(C, (regs.operand & 0x80) >> 7);
+
+    tmp = regs.operand << 1;
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.A = tmp;
+    else
+        CORE_WRITE(regs.operand_addr, (tmp));
+
+    // Set flags
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!tmp));
+
+    return 0;
+}
+
+// branch on C = 0                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BCC() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (!GET_FLAG(C)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// branch on C = 1                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BCS() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (GET_FLAG(C)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// branch on Z = 1                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BEQ() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (GET_FLAG(Z)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// bits 7 and 6 of operand are transfered to bit 7 and 6 of SR (N,V);
+// the zeroflag is set to the result of operand AND accumulator.
+// A AND M, M7 -> N, M6 -> V        N Z C I D V
+//                                 M7 + - - - M6
+static uint8_t BIT() {
+    uint16_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    tmp = regs.A & regs.operand;
+    SET_FLAG(Z, (tmp & 0x00ff) == 0x00);
+
+    SET_FLAG(N, (regs.operand & 0x80));
+    SET_FLAG(V, (regs.operand & 0x40));
+
+    return 0;
+}
+
+// branch on N = 1                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BMI() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (GET_FLAG(N)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// branch on Z = 0                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BNE() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (!GET_FLAG(Z)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// branch on N = 0                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BPL() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (!GET_FLAG(N)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// interrupt,                       N Z C I D V
+// push PC+2, push SR               - - - 1 - -
+static uint8_t BRK() {
+    log_print("Interrupts not implemented\n");
+    // exit(1);
+    //  TODO: What else?
+    SET_FLAG(B, 1);
+    CORE_WRITE(SP(regs), (regs.PC >> 8) & 0x00FF);
+    DEC_SP(regs);
+    CORE_WRITE(SP(regs), regs.PC & 0x00ff);
+    DEC_SP(regs);
+
+    SET_FLAG(I, 1);
+    return 0;
+}
+
+// branch on V = 0                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BVC() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (!GET_FLAG(V)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// branch on V = 1                  N Z C I D V
+//                                  - - - - - -
+static uint8_t BVS() {
+    uint8_t cycles = 0;
+    uint16_t old_pc = regs.PC;
+
+    if (GET_FLAG(V)) {
+        // One extra cycle if the branch is taken
+        cycles++;
+
+        regs.PC += regs.operand_addr;
+
+        // One extra cycle if the branch crosses a page
+        if ((regs.PC & 0xff00) != (old_pc & 0xff00))
+            regs.cycles++;
+    }
+    return cycles;
+}
+
+// 0 -> C                           N Z C I D V
+//                                  - - 0 - - -
+static uint8_t CLC() {
+    SET_FLAG(C, 0);
+    return 0;
+}
+
+// 0 -> D                           N Z C I D V
+//                                  - - - - 0 -
+static uint8_t CLD() {
+    SET_FLAG(D, 0);
+    return 0;
+}
+
+// 0 -> I                           N Z C I D V
+//                                  - - - 0 - -
+static uint8_t CLI() {
+    SET_FLAG(I, 0);
+    return 0;
+}
+
+// 0 -> V                           N Z C I D V
+//                                  - - - - - 0
+static uint8_t CLV() {
+    SET_FLAG(V, 0);
+    return 0;
+}
+
+// A - M                            N Z C I D V
+//                                  + + + - - -
+static uint8_t CMP() {
+    uint16_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    tmp = (uint16_t)regs.A - (uint16_t)regs.operand;
+    SET_FLAG(C, (regs.A >= regs.operand) ? 1 : 0);
+
+    // Set flags
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!(tmp & 0xff)));
+
+    return 0;
+}
+
+// X - M                            N Z C I D V
+//                                  + + + - - -
+static uint8_t CPX() {
+    uint8_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    tmp = regs.X - regs.operand;
+
+    SET_FLAG(N, (tmp & 0x80));
+    tmp &= 0x00FF;
+    SET_FLAG(Z, (!tmp));
+    SET_FLAG(C, (regs.X >= regs.operand));
+
+    return 0;
+}
+
+// Y - M                            N Z C I D V
+//                                  + + + - - -
+static uint8_t CPY() {
+    uint8_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    tmp = regs.Y - regs.operand;
+
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!tmp));
+    SET_FLAG(C, (regs.Y >= regs.operand));
+    return 0;
+}
+
+// M - 1 -> M                       N Z C I D V
+//                                  + + - - - -
+static uint8_t DEC() {
+    uint8_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    tmp = (uint16_t)regs.operand - 1;
+
+    CORE_WRITE(regs.operand_addr, tmp & 0xFF);
+
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!tmp));
+
+    return 0;
+}
+
+// X - 1 -> X                       N Z C I D V
+//                                  + + - - - -
+static uint8_t DEX() {
+    regs.X--;
+
+    SET_FLAG(N, (regs.X & 0x80));
+    SET_FLAG(Z, (!regs.X));
+
+    return 0;
+}
+
+// Y - 1 -> Y                       N Z C I D V
+//                                  + + - - - -
+static uint8_t DEY() {
+    regs.Y--;
+
+    SET_FLAG(N, (regs.Y & 0x80));
+    SET_FLAG(Z, (!regs.Y));
+
+    return 0;
+}
+
+// A EOR M -> A                     N Z C I D V
+//                                  + + - - - -
+static uint8_t EOR() {
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    regs.A = regs.A ^ regs.operand;
+
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+
+    return 0;
+}
+
+// M + 1 -> M                       N Z C I D V
+//                                  + + - - - -
+static uint8_t INC() {
+    uint8_t tmp;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+    log_print("INC read %02x from %04x\n", regs.operand, regs.operand_addr);
+
+    tmp = (uint16_t)regs.operand + 1;
+
+    CORE_WRITE(regs.operand_addr, tmp & 0xFF);
+    log_print("INC wrote %02x to %04x\n", tmp & 0xFF, regs.operand_addr);
+
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!tmp));
+
+    return 0;
+}
+
+// X + 1 -> X                       N Z C I D V
+//                                  + + - - - -
+static uint8_t INX() {
+    regs.X++;
+
+    SET_FLAG(N, (regs.X & 0x80));
+    SET_FLAG(Z, (!regs.X));
+
+    return 0;
+}
+
+// Y + 1 -> Y                       N Z C I D V
+//                                  + + - - - -
+static uint8_t INY() {
+    regs.Y++;
+
+    SET_FLAG(N, (regs.Y & 0x80));
+    SET_FLAG(Z, (!regs.Y));
+
+    return 0;
+}
+
+// (PC+1) -> PCL                    N Z C I D V
+// (PC+2) -> PCH                    - - - - - -
+static uint8_t JMP() {
+    regs.PC = regs.operand_addr;
+    return 0;
+}
+
+// push (PC+2),                     N Z C I D V
+// (PC+1) -> PCL                    - - - - - -
+// (PC+2) -> PCH
+static uint8_t JSR() {
+    uint16_t tmp = regs.PC - 1;
+    CORE_WRITE(SP(regs), (tmp >> 8) & 0x00FF);
+    DEC_SP(regs);
+    CORE_WRITE(SP(regs), (tmp & 0x00FF));
+    DEC_SP(regs);
+    regs.PC = regs.operand_addr;
+
+    return 0;
+}
+
+// M -> A                           N Z C I D V
+//                                  + + - - - -
+static uint8_t LDA() {
+    regs.operand = CORE_READ(regs.operand_addr);
+    regs.A = regs.operand;
+
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+
+    return 0;
+}
+
+// M -> X                           N Z C I D V
+//                                  + + - - - -
+static uint8_t LDX() {
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    regs.X = regs.operand;
+
+    SET_FLAG(N, (regs.X & 0x80));
+    SET_FLAG(Z, (!regs.X));
+
+    return 0;
+}
+
+// M -> Y                           N Z C I D V
+//                                  + + - - - -
+static uint8_t LDY() {
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    regs.Y = regs.operand;
+
+    SET_FLAG(N, (regs.Y & 0x80));
+    SET_FLAG(Z, (!regs.Y));
+
+    return 0;
+}
+
+// 0 -> [76543210] -> C             N Z C I D V
+//                                  0 + + - - -
+static uint8_t LSR() {
+    uint8_t tmp;
+
+    if ((cpu.curr_insn->addr_mode != IMP) && (cpu.curr_insn->addr_mode != ACC))
+        regs.operand = CORE_READ(regs.operand_addr);
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.operand = regs.A;
+
+    SET_FLAG(C, (regs.operand & 0x1));
+
+    tmp = regs.operand >> 1;
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.A = tmp;
+    else
+        CORE_WRITE(regs.operand_addr, (tmp));
+
+    SET_FLAG(Z, (!tmp));
+    SET_FLAG(N, 0);
+
+    return 0;
+}
+
+// ---                              N Z C I D V
+//                                  - - - - - -
+static uint8_t NOP() { return 0; }
+
+// A OR M -> A                      N Z C I D V
+//                                  + + - - - -
+static uint8_t ORA() {
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    regs.A |= regs.operand;
+
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+    return 0;
+}
+
+// push A                           N Z C I D V
+//                                  - - - - - -
+static uint8_t PHA() {
+    CORE_WRITE(SP(regs), regs.A);
+    DEC_SP(regs);
+    return 0;
+}
+
+// push SR                          N Z C I D V
+//                                  - - - - - -
+static uint8_t PHP() {
+    // printf("PHP called, flags: %02x\n", regs.flags.reg);
+    SET_FLAG(B, 1); // Set B flag when pushing to stack from BRK or PHP
+    CORE_WRITE(SP(regs), regs.flags.reg);
+    DEC_SP(regs);
+    return 0;
+}
+
+// pull A                           N Z C I D V
+//                                  + + - - - -
+static uint8_t PLA() {
+    INC_SP(regs);
+    regs.A = CORE_READ(SP(regs));
+
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+
+    return 0;
+}
+
+// pull SR                          N Z C I D V
+//                                  from stack
+static uint8_t PLP() {
+    INC_SP(regs);
+    regs.flags.reg = CORE_READ(SP(regs));
+    return 0;
+}
+
+// C <- [76543210] <- C             N Z C I D V
+//                                  + + + - - -
+static uint8_t ROL() {
+
+    uint8_t tmp;
+    uint8_t old_carry = GET_FLAG(C);
+
+    if ((cpu.curr_insn->addr_mode != IMP) && (cpu.curr_insn->addr_mode != ACC))
+        regs.operand = CORE_READ(regs.operand_addr);
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.operand = regs.A;
+
+    SET_FLAG(C, (regs.operand & 0x80) >> 7);
+
+    tmp = regs.operand << 1 | old_carry;
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.A = tmp;
+    else
+        CORE_WRITE(regs.operand_addr, (tmp));
+
+    // Set flags
+    SET_FLAG(N, (tmp & 0x80));
+    SET_FLAG(Z, (!tmp));
+
+    return 0;
+}
+
+// C -> [76543210] -> C             N Z C I D V
+//                                  + + + - - -
+static uint8_t ROR() {
+    uint8_t tmp;
+    uint8_t old_carry = GET_FLAG(C);
+
+    if ((cpu.curr_insn->addr_mode != IMP) && (cpu.curr_insn->addr_mode != ACC))
+        regs.operand = CORE_READ(regs.operand_addr);
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.operand = regs.A;
+
+    SET_FLAG(C, (regs.operand & 0x1));
+
+    tmp = regs.operand >> 1 | (old_carry << 7);
+
+    if (cpu.curr_insn->addr_mode == ACC)
+        regs.A = tmp;
+    else
+        CORE_WRITE(regs.operand_addr, (tmp));
+
+    tmp &= 0x00FF;
+    SET_FLAG(Z, (!tmp));
+    SET_FLAG(N, tmp & 0x80);
+
+    return 0;
+}
+
+// pull SR, pull PC                 N Z C I D V
+//                                  from stack
+static uint8_t RTI() {
+    uint16_t tmp;
+
+    INC_SP(regs);
+    regs.flags.reg = CORE_READ(SP(regs));
+
+    INC_SP(regs);
+    tmp = CORE_READ(SP(regs));
+    INC_SP(regs);
+    tmp |= (CORE_READ(SP(regs)) << 8);
+
+    regs.PC = tmp;
+
+    return 0;
+}
+
+// pull PC, PC+1 -> PC              N Z C I D V
+//                                  - - - - - -
+static uint8_t RTS() {
+    uint16_t tmp;
+
+    INC_SP(regs);
+    tmp = CORE_READ(SP(regs));
+    INC_SP(regs);
+    tmp |= (CORE_READ(SP(regs)) << 8);
+
+    regs.PC = tmp + 1;
+
+    return 0;
+}
+
+// A - M - C -> A                   N Z C I D V
+//                                  + + + - - +
+static uint8_t SBC() {
+    uint16_t tmp;
+    uint16_t value;
+
+    regs.operand = CORE_READ(regs.operand_addr);
+
+    value = ((uint16_t)regs.operand) ^ 0x00ff;
+
+    tmp = (uint16_t)regs.A + value + (uint16_t)GET_FLAG(C);
+    SET_FLAG(C, (tmp & 0xFF00));
+
+    // Set flags
+    SET_FLAG(N, (tmp & 0x0080));
+    tmp &= 0x00FF;
+    SET_FLAG(Z, (!tmp));
+    SET_FLAG(V, ((tmp ^ (uint16_t)regs.A) & (tmp ^ value) & 0x0080));
+
+    regs.A = tmp & 0x00FF;
+
+    return 0;
+}
+
+// 1 -> C                           N Z C I D V
+//                                  - - 1 - - -
+static uint8_t SEC() {
+    SET_FLAG(C, 1);
+    return 0;
+}
+
+// 1 -> D                           N Z C I D V
+//                                  - - - - 1 -
+static uint8_t SED() {
+    SET_FLAG(D, 1);
+    return 0;
+}
+
+// 1 -> I                           N Z C I D V
+//                                  - - - 1 - -
+static uint8_t SEI() {
+    SET_FLAG(I, 1);
+    return 0;
+}
+
+// A -> M                           N Z C I D V
+//                                  - - - - - -
+static uint8_t STA() {
+    CORE_WRITE(regs.operand_addr, regs.A);
+    return 0;
+}
+
+// X -> M                           N Z C I D V
+//                                  - - - - - -
+static uint8_t STX() {
+    CORE_WRITE(regs.operand_addr, regs.X);
+    return 0;
+}
+
+// Y -> M                           N Z C I D V
+//                                  - - - - - -
+static uint8_t STY() {
+    CORE_WRITE(regs.operand_addr, regs.Y);
+    return 0;
+}
+
+// A -> X                           N Z C I D V
+//                                  + + - - - -
+static uint8_t TAX() {
+    regs.X = regs.A;
+    SET_FLAG(N, (regs.X & 0x80));
+    SET_FLAG(Z, (!regs.X));
+
+    return 0;
+}
+
+// A -> Y                           N Z C I D V
+//                                  + + - - - -
+static uint8_t TAY() {
+    regs.Y = regs.A;
+    SET_FLAG(N, (regs.Y & 0x80));
+    SET_FLAG(Z, (!regs.Y));
+
+    return 0;
+}
+
+// SP -> X                          N Z C I D V
+//                                  + + - - - -
+static uint8_t TSX() {
+    regs.X = (uint8_t)SP(regs);
+    SET_FLAG(N, (regs.X & 0x80));
+    SET_FLAG(Z, (!regs.X));
+
+    return 0;
+}
+
+// X -> A                           N Z C I D V
+//                                  + + - - - -
+static uint8_t TXA() {
+    regs.A = regs.X;
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+
+    return 0;
+}
+
+// X -> SP                          N Z C I D V
+//                                  - - - - - -
+static uint8_t TXS() {
+    SET_SP(regs, regs.X);
+
+    return 0;
+}
+
+// Y -> A                           N Z C I D V
+//                                  + + - - - -
+static uint8_t TYA() {
+    regs.A = regs.Y;
+    SET_FLAG(N, (regs.A & 0x80));
+    SET_FLAG(Z, (!regs.A));
+
+    return 0;
+}
+
+static uint8_t XXX() {
+    log_print("Invalid opcode encountered\n");
+#ifndef INVALID_AS_NOP
+    exit(1);
+#endif
+    return 1;
+}
+
+static uint8_t fetch() {
+    uint16_t operand;
+    uint8_t a, b, c;
+
+    // DEBUG
+    regs.start_pc = regs.PC;
+
+    regs.opcode = CORE_READ(regs.PC++);
+    a = DECODE_A(regs.opcode);
+    b = DECODE_B(regs.opcode);
+    c = DECODE_C(regs.opcode);
+
+    // No valid 6502 instruction exists with the lowest two bits both set
+    if (c == 3) {
+#ifdef CPU_PROFILE
+        profile_page_cross = 0;
+#endif
+        cpu.curr_insn = &invalid_opcode;
+        // cpu.op is the actual invalid opcode
+        // cpu.curr_insn contains a 0x00 placeholder value, which is incorrect
+        return regs.opcode;
+    }
+
+    cpu.curr_insn = &instruction_table[c][a][b];
+
+    // Set the initial cycle count
+    regs.cycles = cpu.curr_insn->cycles;
+
+    // Calling addr_mode will resolve operand and any addresses
+    // as well as determine any additional cycles to be added on
+    // for memory access types. Branc instructions can incur
+    // additional cycles but need to be resolved at execution
+#ifdef CPU_PROFILE
+    profile_page_cross = cpu.curr_insn->addr_mode();
+#else
+    cpu.curr_insn->addr_mode();
+#endif
+
+    return regs.opcode;
+}
+
+static uint8_t execute() {
+    regs.cycles += cpu.curr_insn->execute();
+    return 0;
+}
+
+// Games upload nametables and CHR-RAM during VBlank with loops like
+//
+//   loop: LDA src,X    BD lo hi
+//         STA $2007    8D 07 20
+//         INX          E8
+//         CPX #end     E0 end     (optional, otherwise loops until X wraps)
+//         BNE loop     D0 rel
+//
+// Called after fetching an LDA abs,X, this recognizes the loop and streams
+// the remaining bytes to the PPU as one block. Registers, flags, PC and the
+// cycle count end up as if the loop had been interpreted. Returns 1 if the
+// loop was run, 0 to execute the LDA normally.
+static uint8_t upload_ppudata() {
+    uint8_t data[256];
+    uint16_t base = regs.operand_addr - regs.X;
+    uint16_t branch = regs.PC + 4;
+    uint8_t has_cpx = 0;
+    uint8_t end = 0;
+    uint16_t count;
+    uint32_t cycles;
+    uint8_t taken;
+
+#ifdef CPU_PROFILE
+    // The profilers count every instruction of the loop on its own
+    if (cpu6502_profile.enabled || cpu6502_hotspot_enabled) {
+        return 0;
+    }
+#endif
+
+    if (CORE_READ(regs.PC) != 0x8D || CORE_READ(regs.PC + 1) != 0x07 ||
+        CORE_READ(regs.PC + 2) != 0x20 || CORE_READ(regs.PC + 3) != 0xE8) {
+        return 0;
+    }
+
+    if (CORE_READ(branch) == 0xE0) {
+        has_cpx = 1;
+        end = CORE_READ(branch + 1);
+        branch += 2;
+    }
+
+    if (CORE_READ(branch) != 0xD0 ||
+        (uint16_t)(branch + 2 + (int8_t)CORE_READ(branch + 1)) !=
+            regs.start_pc) {
+        return 0;
+    }
+
+    // Iterations left until X reaches the end value (0 means all 256)
+    count = (uint8_t)(end - regs.X);
+    if (count == 0) {
+        count = 256;
+    }
+
+    // Cycles as charged by the interpreter: LDA 4, STA 4, INX 2, CPX 2,
+    // taken BNE 3 (+1 across a page), and 2 for the final BNE
+    taken = 3;
+    if (((branch + 2) & 0xff00) != (regs.start_pc & 0xff00)) {
+        taken++;
+    }
+    cycles = count * (4 + 4 + 2 + (has_cpx ? 2 : 0) + taken) - (taken - 2);
+
+    // The writes are only invisible to rendering within VBlank
+    if (cycles * 3 > cpu.bus->ppu->vblank_dots()) {
+        return 0;
+    }
+
+    // Reading from MMIO has side effects, only stream from RAM or cartridge
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t addr = base + (uint8_t)(regs.X + i);
+        if (addr >= 0x2000 && addr < 0x6000) {
+            return 0;
+        }
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        data[i] = CORE_READ(base + (uint8_t)(regs.X + i));
+    }
+    cpu.bus->ppu->write_block(data, count);
+
+    regs.A = data[count - 1];
+    regs.X = end;
+    regs.operand = has_cpx ? end : data[count - 1];
+    // Final INX/CPX leave X == end
+    SET_FLAG(N, 0);
+    SET_FLAG(Z, 1);
+    if (has_cpx) {
+        SET_FLAG(C, 1);
+    }
+    regs.PC = branch + 2;
+    regs.cycles = cycles;
+
+    return 1;
+}
+
+static void clock() {
+#ifdef DEBUG
+    uint8_t buf[0x100];
+#endif
+
+    if (regs.cycles == 0) {
+        HOST_TIMER_ENTER(HOST_PHASE_CPU);
+
+        // Check for NMI before fetching next instruction
+        // NMI is edge-triggered and can't be disabled
+        if (nes_state->ppu_regs.nmi_triggered) {
+            // printf("CPU: Servicing NMI interrupt\n");
+            nes_state->ppu_regs.nmi_triggered = 0; // Clear the NMI flag
+            cpu.nmi(); // Call NMI handler (pushes PC/flags, jumps to vector)
+            regs.cycles = 7; // NMI takes 7 cycles
+            NES_PROBE1(nmi, regs.PC);
+#ifdef CPU_PROFILE
+            cpu6502_profile.nmi += cpu6502_profile.enabled;
+            if (cpu6502_hotspot_enabled) {
+                cpu6502_hotspot_interrupt(regs.PC, regs.sp, regs.cycles);
+            }
+#endif
+            HOST_TIMER_LEAVE();
+            return;         // Skip normal instruction fetch
+        }
+
+        // IRQ is level-triggered: the cartridge holds the line until the
+        // handler acknowledges it, and it is masked by the I flag
+        if (nes_state->irq && !GET_FLAG(I)) {
+            cpu.irq();
+            regs.cycles = 7;
+            NES_PROBE1(irq, regs.PC);
+#ifdef CPU_PROFILE
+            cpu6502_profile.irq += cpu6502_profile.enabled;
+            if (cpu6502_hotspot_enabled) {
+                cpu6502_hotspot_interrupt(regs.PC, regs.sp, regs.cycles);
+            }
+#endif
+            HOST_TIMER_LEAVE();
+            return;
+        }
+
+        fetch();
+
+        log_print("%04x: %02x %s %04x / %02x\n", regs.start_pc, regs.opcode,
+                  cpu.curr_insn->mnem, regs.operand_addr, regs.operand);
+
+        // Execution may add up to 2 cycles if a branch is taken that crosses
+        // a page boundry.
+        // An LDA abs,X that starts a PPUDATA upload loop runs the whole loop.
+        if (regs.opcode != 0xBD || !upload_ppudata()) {
+            execute();
+        }
+
+#ifdef CPU_PROFILE
+        // Branches take a cycle more when taken and another when they land
+        // on a different page
+        if (cpu6502_profile.enabled) {
+            uint8_t base = cpu.curr_insn->cycles;
+
+            if (cpu.curr_insn->addr_mode == REL) {
+                cpu6502_profile_insn(regs.opcode, regs.cycles,
+                                     regs.cycles > base + 1,
+                                     regs.cycles > base);
+            } else {
+                cpu6502_profile_insn(regs.opcode, regs.cycles,
+                                     profile_page_cross, 0);
+            }
+        }
+        if (cpu6502_hotspot_enabled) {
+            cpu6502_hotspot_insn(regs.start_pc, regs.opcode, regs.cycles,
+                                 regs.PC, regs.sp);
+        }
+#endif
+
+#ifdef DEBUG
+        // The trace reads memory through the bus, which costs far more than
+        // the instruction itself
+        cpu.print_regs();
+        cpu.bus->debug_read(SP(regs) - 0x10, buf, 0x20);
+        log_print("Stack:\n");
+        hex_dump(buf, 0x20);
+        cpu.bus->debug_read(regs.PC, buf, 0x10);
+        log_print("%04x: \n", regs.PC);
+        hex_dump(buf, 0x10);
+        cpu.bus->debug_read(0, buf, 0x20);
+        log_print("%04x: \n", 0);
+        hex_dump(buf, 0x20);
+        log_print("\n");
+#endif
+        HOST_TIMER_LEAVE();
+    }
+    log_print("%d cycles for this op\n", regs.cycles);
+    regs.cycles--;
+}
+
+#ifdef CORE_CLOCK
+// Entry point of a mapper core, installed as cpu.clock
+void CORE_CLOCK(void) { clock(); }
+#endif
@@ -0,0 +1,12 @@
+// 6502_core_discrete.c
+//
+// CPU core for the table-driven discrete boards: UxROM, CNROM, AxROM, GxROM
+// and Color Dreams
+
+#include "mapper_discrete.h"
+
+#define CORE_MAPPER_WRITE(map, addr, data)                                     \
+    mapper_discrete_cpu_write(map, addr, data)
+#define CORE_CLOCK cpu6502_clock_discrete
+
+#include "6502_core.h"
@@ -0,0 +1,10 @@
+// 6502_core_mmc1.c
+//
+// CPU core for MMC1
+
+#include "mapper_001.h"
+
+#define CORE_MAPPER_WRITE(map, addr, data) mapper_001_cpu_write(map, addr, data)
+#define CORE_CLOCK cpu6502_clock_mmc1
+
+#include "6502_core.h"
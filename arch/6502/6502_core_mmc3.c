@@ -0,0 +1,10 @@
+// 6502_core_mmc3.c
+//
+// CPU core for MMC3
+
+#include "mapper_004.h"
+
+#define CORE_MAPPER_WRITE(map, addr, data) mapper_004_cpu_write(map, addr, data)
+#define CORE_CLOCK cpu6502_clock_mmc3
+
+#include "6502_core.h"
@@ -0,0 +1,11 @@
+// 6502_core_nrom.c
+//
+// CPU core for NROM. PRG-ROM can't be written, so stores to $8000-$FFFF
+// compile to nothing.
+
+#include "mapper_000.h"
+
+#define CORE_MAPPER_WRITE(map, addr, data) ((void)(map), (void)(data))
+#define CORE_CLOCK cpu6502_clock_nrom
+
+#include "6502_core.h"
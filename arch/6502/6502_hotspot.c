@@ -0,0 +1,746 @@
+// 6502_hotspot.c
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "6502_hotspot.h"
+#include "mapper.h"
+
+// Every byte the CPU can run code from has a location index:
+//
+//   [0, 0x800)                CPU RAM
+//   [0x800, 0x2800)           PRG-RAM at $6000-$7FFF
+//   [0x2800, 0x2800 + ROM)    PRG-ROM, by offset into the ROM
+//   then 0x10000 more         anything else, by CPU address
+#define LOC_RAM 0x0000
+#define LOC_PRG_RAM 0x0800
+#define LOC_ROM 0x2800
+
+#define MAX_DEPTH 64
+#define MAX_NODES 65536
+#define NO_NODE 0xffffffff
+
+// The call tree: one node per distinct chain of routines from the top
+struct node {
+    uint32_t routine; // Location of the entry point, hs.locs for the top
+    uint32_t parent;
+    uint32_t child;
+    uint32_t sibling;
+    uint64_t calls;
+    uint64_t self;
+    uint64_t total;
+};
+
+// A routine on the shadow stack, and the stack pointer it returns to
+struct frame {
+    uint32_t node;
+    uint8_t sp;
+};
+
+struct label {
+    uint32_t loc;
+    char *name;
+};
+
+uint8_t cpu6502_hotspot_enabled;
+
+static struct {
+    struct nes_cartridge *cart;
+    uint32_t loc_other;
+    uint32_t locs;
+
+    // Per location: cycles charged, and the CPU address it last ran at
+    uint64_t *cycles;
+    uint16_t *cpu_addr;
+    uint64_t total;
+
+    struct node *nodes;
+    uint32_t node_count;
+    uint32_t current;
+    struct frame stack[MAX_DEPTH];
+    uint8_t depth;
+
+    // Sorted by location
+    struct label *labels;
+    uint32_t label_count;
+    uint32_t label_cap;
+} hs;
+
+static uint32_t locate(uint16_t pc) {
+    struct mapper *map = hs.cart->map;
+    uint8_t *bank = map->prg[(pc >> 13) & 0x03];
+
+    if (pc < 0x2000) {
+        return LOC_RAM + (pc & 0x07ff);
+    }
+    if (pc >= 0x8000 && bank) {
+        return LOC_ROM + (bank - hs.cart->prg_rom) + (pc & 0x1fff);
+    }
+    if (pc >= 0x6000 && pc < 0x8000) {
+        return LOC_PRG_RAM + (pc - 0x6000);
+    }
+    return hs.loc_other + pc;
+}
+
+int cpu6502_hotspot_start(struct nes_cartridge *cart) {
+    hs.cart = cart;
+    hs.loc_other = LOC_ROM + cart->prg_rom_len;
+    hs.locs = hs.loc_other + 0x10000;
+
+    hs.cycles = calloc(hs.locs, sizeof(*hs.cycles));
+    hs.cpu_addr = calloc(hs.locs, sizeof(*hs.cpu_addr));
+    hs.nodes = calloc(MAX_NODES, sizeof(*hs.nodes));
+    if (!hs.cycles || !hs.cpu_addr || !hs.nodes) {
+        free(hs.cycles);
+        free(hs.cpu_addr);
+        free(hs.nodes);
+        return -ENOMEM;
+    }
+
+    // Whatever runs outside any call is charged to the top of the tree
+    hs.nodes[0].routine = hs.locs;
+    hs.nodes[0].parent = NO_NODE;
+    hs.nodes[0].child = NO_NODE;
+    hs.nodes[0].sibling = NO_NODE;
+    hs.node_count = 1;
+    hs.current = 0;
+    hs.depth = 0;
+
+    cpu6502_hotspot_enabled = 1;
+    return 0;
+}
+
+// A call to routine; sp is what the stack pointer will be once it returns
+static void enter(uint32_t routine, uint8_t sp) {
+    uint32_t node;
+
+    // Calls nested deeper than we follow are charged to their caller. The
+    // returns still balance, as they are matched on the stack pointer.
+    if (hs.depth == MAX_DEPTH) {
+        return;
+    }
+
+    for (node = hs.nodes[hs.current].child; node != NO_NODE;
+         node = hs.nodes[node].sibling) {
+        if (hs.nodes[node].routine == routine) {
+            break;
+        }
+    }
+    if (node == NO_NODE) {
+        if (hs.node_count == MAX_NODES) {
+            node = hs.current; // Tree is full
+        } else {
+            node = hs.node_count++;
+            hs.nodes[node].routine = routine;
+            hs.nodes[node].parent = hs.current;
+            hs.nodes[node].child = NO_NODE;
+            hs.nodes[node].sibling = hs.nodes[hs.current].child;
+            hs.nodes[hs.current].child = node;
+        }
+    }
+
+    hs.nodes[node].calls++;
+    hs.stack[hs.depth].node = node;
+    hs.stack[hs.depth].sp = sp;
+    hs.depth++;
+    hs.current = node;
+}
+
+// Pop every frame the stack pointer has moved past, which also copes with
+// code that returns through a pushed address instead of a matching JSR
+static void leave(uint8_t sp) {
+    while (hs.depth && hs.stack[hs.depth - 1].sp <= sp) {
+        hs.depth--;
+    }
+    hs.current = hs.depth ? hs.stack[hs.depth - 1].node : 0;
+}
+
+void cpu6502_hotspot_insn(uint16_t pc, uint8_t opcode, uint16_t cycles,
+                          uint16_t next_pc, uint8_t sp) {
+    uint32_t loc = locate(pc);
+
+    hs.cycles[loc] += cycles;
+    hs.cpu_addr[loc] = pc;
+    hs.nodes[hs.current].self += cycles;
+    hs.total += cycles;
+
+    switch (opcode) {
+    case 0x20: // JSR pushed the return address
+        loc = locate(next_pc);
+        hs.cpu_addr[loc] = next_pc;
+        enter(loc, sp + 2);
+        break;
+    case 0x00: // BRK pushed the return address and flags
+        loc = locate(next_pc);
+        hs.cpu_addr[loc] = next_pc;
+        enter(loc, sp + 3);
+        break;
+    case 0x40: // RTI
+    case 0x60: // RTS
+        leave(sp);
+        break;
+    }
+}
+
+void cpu6502_hotspot_interrupt(uint16_t pc, uint8_t sp, uint16_t cycles) {
+    uint32_t loc = locate(pc);
+
+    hs.cpu_addr[loc] = pc;
+    enter(loc, sp + 3);
+
+    hs.cycles[loc] += cycles;
+    hs.nodes[hs.current].self += cycles;
+    hs.total += cycles;
+}
+
+// Labels
+
+static void add_label(uint32_t loc, const char *name) {
+    if (loc >= hs.locs || !*name) {
+        return;
+    }
+
+    if (hs.label_count == hs.label_cap) {
+        uint32_t cap = hs.label_cap ? hs.label_cap * 2 : 256;
+        struct label *labels = realloc(hs.labels, cap * sizeof(*labels));
+
+        if (!labels) {
+            return;
+        }
+        hs.labels = labels;
+        hs.label_cap = cap;
+    }
+
+    hs.labels[hs.label_count].loc = loc;
+    hs.labels[hs.label_count].name = strdup(name);
+    if (hs.labels[hs.label_count].name) {
+        hs.label_count++;
+    }
+}
+
+// Location of a CPU RAM or PRG-RAM address, or hs.locs
+static uint32_t ram_loc(uint32_t addr) {
+    if (addr < 0x2000) {
+        return LOC_RAM + (addr & 0x07ff);
+    }
+    if (addr >= 0x6000 && addr < 0x8000) {
+        return LOC_PRG_RAM + (addr - 0x6000);
+    }
+    return hs.locs;
+}
+
+static uint32_t rom_loc(uint32_t offset) {
+    return offset < hs.cart->prg_rom_len ? LOC_ROM + offset : hs.locs;
+}
+
+// Copy up to the first character of stop (or the end of the line) into
+// out, without surrounding blanks
+static void copy_field(const char *p, const char *stop, char *out,
+                       size_t len) {
+    size_t n = strcspn(p, stop);
+
+    while (n && isspace((unsigned char)*p)) {
+        p++;
+        n--;
+    }
+    while (n && isspace((unsigned char)p[n - 1])) {
+        n--;
+    }
+    if (n >= len) {
+        n = len - 1;
+    }
+    memcpy(out, p, n);
+    out[n] = '\0';
+}
+
+// FCEUX: <rom>.<hex bank>.nl holds "$C000#name#comment" for a 16KB bank,
+// <rom>.ram.nl the same for RAM
+static void load_nl(FILE *f, const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    const char *bank_name = ext;
+    long bank = -1;
+    char line[512];
+
+    while (bank_name > filename && bank_name[-1] != '.') {
+        bank_name--;
+    }
+    if (strncmp(bank_name, "ram.", 4) != 0) {
+        bank = strtol(bank_name, NULL, 16);
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        const char *hash;
+        unsigned long addr;
+
+        if (line[0] != '$' || !(hash = strchr(line, '#'))) {
+            continue;
+        }
+        addr = strtoul(line + 1, NULL, 16);
+        copy_field(hash + 1, "#\r\n", name, sizeof(name));
+
+        if (bank < 0) {
+            add_label(ram_loc(addr), name);
+        } else {
+            add_label(rom_loc(bank * 0x4000 + (addr & 0x3fff)), name);
+        }
+    }
+}
+
+// Mesen: "P:1F0E:name:comment", with P (or NesPrgRom) a PRG-ROM offset, R
+// (NesInternalRam) CPU RAM, and S/W (NesSaveRam/NesWorkRam) PRG-RAM
+static void load_mlb(FILE *f) {
+    char line[512];
+
+    while (fgets(line, sizeof(line), f)) {
+        char type[32];
+        char name[128];
+        const char *p = strchr(line, ':');
+        unsigned long addr;
+
+        if (!p) {
+            continue;
+        }
+        copy_field(line, ":", type, sizeof(type));
+        addr = strtoul(p + 1, NULL, 16);
+        p = strchr(p + 1, ':');
+        if (!p) {
+            continue;
+        }
+        copy_field(p + 1, ":\r\n", name, sizeof(name));
+
+        if (!strcmp(type, "P") || !strcmp(type, "NesPrgRom")) {
+            add_label(rom_loc(addr), name);
+        } else if (!strcmp(type, "R") || !strcmp(type, "NesInternalRam")) {
+            add_label(ram_loc(addr), name);
+        } else if (!strcmp(type, "S") || !strcmp(type, "W") ||
+                   !strcmp(type, "NesSaveRam") ||
+                   !strcmp(type, "NesWorkRam")) {
+            add_label(ram_loc(0x6000 + addr), name);
+        }
+    }
+}
+
+// Value of key= in a ca65 debug file record, without quotes. 0 if absent.
+static int dbg_field(const char *line, const char *key, char *out,
+                     size_t len) {
+    size_t key_len = strlen(key);
+    const char *p = line;
+
+    while ((p = strstr(p, key))) {
+        if ((p == line || p[-1] == '\t' || p[-1] == ',') &&
+            p[key_len] == '=') {
+            p += key_len + 1;
+            if (*p == '"') {
+                copy_field(p + 1, "\"", out, len);
+            } else {
+                copy_field(p, ",\r\n", out, len);
+            }
+            return 1;
+        }
+        p += key_len;
+    }
+    return 0;
+}
+
+// ca65/ld65: "seg" records give where each segment starts in the CPU
+// address space and in the output file, "sym" records of type lab give
+// label addresses
+static void load_dbg(FILE *f) {
+    struct {
+        unsigned long start;
+        long ooffs;
+    } segs[256];
+    char line[1024];
+    char value[128];
+    char name[128];
+
+    memset(segs, 0, sizeof(segs));
+    for (int i = 0; i < 256; i++) {
+        segs[i].ooffs = -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long id;
+
+        if (strncmp(line, "seg\t", 4) != 0 || !dbg_field(line, "id", value,
+                                                         sizeof(value))) {
+            continue;
+        }
+        id = strtoul(value, NULL, 0);
+        if (id >= 256) {
+            continue;
+        }
+        if (dbg_field(line, "start", value, sizeof(value))) {
+            segs[id].start = strtoul(value, NULL, 0);
+        }
+        if (dbg_field(line, "ooffs", value, sizeof(value))) {
+            segs[id].ooffs = strtol(value, NULL, 0);
+        }
+    }
+
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long val;
+        unsigned long seg;
+        long offset;
+
+        if (strncmp(line, "sym\t", 4) != 0 ||
+            !dbg_field(line, "type", value, sizeof(value)) ||
+            strcmp(value, "lab") != 0 ||
+            !dbg_field(line, "name", name, sizeof(name)) ||
+            !dbg_field(line, "val", value, sizeof(value))) {
+            continue;
+        }
+        val = strtoul(value, NULL, 0);
+
+        // Labels in segments written to the ROM file become ROM offsets,
+        // past the iNES header and trainer
+        if (dbg_field(line, "seg", value, sizeof(value)) &&
+            (seg = strtoul(value, NULL, 0)) < 256 && segs[seg].ooffs >= 0) {
+            offset = (long)(val - segs[seg].start) + segs[seg].ooffs -
+                     (long)sizeof(struct nes_cartridge_hdr) -
+                     hs.cart->trainer_len;
+            if (offset >= 0) {
+                add_label(rom_loc(offset), name);
+            }
+        } else {
+            add_label(ram_loc(val), name);
+        }
+    }
+}
+
+static int compare_labels(const void *a, const void *b) {
+    const struct label *x = a;
+    const struct label *y = b;
+
+    return (x->loc > y->loc) - (x->loc < y->loc);
+}
+
+int cpu6502_hotspot_load_labels(const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    uint32_t before = hs.label_count;
+    FILE *f;
+
+    if (!hs.cart) {
+        return -EINVAL;
+    }
+
+    f = fopen(filename, "r");
+    if (!f) {
+        int err = errno;
+
+        printf("Cannot open labels %s: %s\n", filename, strerror(err));
+        return -err;
+    }
+
+    if (ext && !strcmp(ext, ".nl")) {
+        load_nl(f, filename);
+    } else if (ext && !strcmp(ext, ".mlb")) {
+        load_mlb(f);
+    } else if (ext && !strcmp(ext, ".dbg")) {
+        load_dbg(f);
+    } else {
+        printf("Unknown label file type: %s\n", filename);
+        fclose(f);
+        return -EINVAL;
+    }
+    fclose(f);
+
+    qsort(hs.labels, hs.label_count, sizeof(*hs.labels), compare_labels);
+    return hs.label_count - before;
+}
+
+// Naming
+
+static uint32_t space_start(uint32_t loc) {
+    if (loc < LOC_PRG_RAM) {
+        return LOC_RAM;
+    }
+    if (loc < LOC_ROM) {
+        return LOC_PRG_RAM;
+    }
+    return loc < hs.loc_other ? LOC_ROM : hs.loc_other;
+}
+
+// Last label at or before loc in the same memory, NULL if none
+static const struct label *label_before(uint32_t loc) {
+    uint32_t lo = 0;
+    uint32_t hi = hs.label_count;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (hs.labels[mid].loc <= loc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || hs.labels[lo - 1].loc < space_start(loc)) {
+        return NULL;
+    }
+    return &hs.labels[lo - 1];
+}
+
+// "07:C123" for PRG-ROM bank 7 (16KB banks, as in .nl files), "RAM:0123",
+// "SRAM:6123", or the bare CPU address
+static void loc_address(uint32_t loc, char *buf, size_t len) {
+    if (loc < LOC_PRG_RAM) {
+        snprintf(buf, len, "RAM:%04X", loc - LOC_RAM);
+    } else if (loc < LOC_ROM) {
+        snprintf(buf, len, "SRAM:%04X", 0x6000 + loc - LOC_PRG_RAM);
+    } else if (loc < hs.loc_other) {
+        snprintf(buf, len, "%02X:%04X", (loc - LOC_ROM) / 0x4000,
+                 hs.cpu_addr[loc]);
+    } else {
+        snprintf(buf, len, "%04X", loc - hs.loc_other);
+    }
+}
+
+// Label, label+offset, or address
+static void loc_name(uint32_t loc, char *buf, size_t len) {
+    const struct label *label = label_before(loc);
+
+    if (!label) {
+        loc_address(loc, buf, len);
+    } else if (label->loc == loc) {
+        snprintf(buf, len, "%s", label->name);
+    } else {
+        snprintf(buf, len, "%s+%u", label->name, loc - label->loc);
+    }
+}
+
+// A routine's entry point by its label, else "sub_" and its address
+static void routine_name(uint32_t loc, char *buf, size_t len) {
+    const struct label *label = label_before(loc);
+    char addr[16];
+
+    if (loc == hs.locs) {
+        snprintf(buf, len, "(top)");
+    } else if (label && label->loc == loc) {
+        snprintf(buf, len, "%s", label->name);
+    } else {
+        loc_address(loc, addr, sizeof(addr));
+        snprintf(buf, len, "sub_%s", addr);
+    }
+}
+
+// Reports
+
+struct routine {
+    uint32_t loc;
+    uint64_t calls;
+    uint64_t self;
+    uint64_t total;
+};
+
+static const uint64_t *sort_cycles;
+
+static int by_cycles(const void *a, const void *b) {
+    uint64_t x = sort_cycles[*(const uint32_t *)a];
+    uint64_t y = sort_cycles[*(const uint32_t *)b];
+
+    return (x < y) - (x > y);
+}
+
+static int by_total(const void *a, const void *b) {
+    const struct routine *x = a;
+    const struct routine *y = b;
+
+    return (x->total < y->total) - (x->total > y->total);
+}
+
+static double percent(uint64_t part) {
+    return hs.total ? 100.0 * part / hs.total : 0.0;
+}
+
+// Fill in node totals. Children are always created after their parents.
+static void sum_tree(void) {
+    for (uint32_t n = 0; n < hs.node_count; n++) {
+        hs.nodes[n].total = hs.nodes[n].self;
+    }
+    for (uint32_t n = hs.node_count - 1; n > 0; n--) {
+        hs.nodes[hs.nodes[n].parent].total += hs.nodes[n].total;
+    }
+}
+
+// Whether the routine of node n is already further up its chain, so a
+// recursive call is not counted twice
+static int recursive(uint32_t n) {
+    for (uint32_t p = hs.nodes[n].parent; p != NO_NODE; p = hs.nodes[p].parent) {
+        if (hs.nodes[p].routine == hs.nodes[n].routine) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void print_flat(FILE *f, unsigned int top) {
+    uint32_t *order;
+    uint32_t used = 0;
+    char name[160];
+    char addr[16];
+
+    order = malloc(hs.locs * sizeof(*order));
+    if (!order) {
+        return;
+    }
+    for (uint32_t loc = 0; loc < hs.locs; loc++) {
+        if (hs.cycles[loc]) {
+            order[used++] = loc;
+        }
+    }
+    sort_cycles = hs.cycles;
+    qsort(order, used, sizeof(*order), by_cycles);
+
+    fprintf(f, "\n  %12s %7s  %-10s %s\n", "cycles", "%", "address", "label");
+    for (uint32_t i = 0; i < used && i < top; i++) {
+        loc_address(order[i], addr, sizeof(addr));
+        loc_name(order[i], name, sizeof(name));
+        fprintf(f, "  %12llu %6.2f%%  %-10s %s\n",
+                (unsigned long long)hs.cycles[order[i]],
+                percent(hs.cycles[order[i]]), addr,
+                strcmp(name, addr) ? name : "");
+    }
+    free(order);
+}
+
+// The callers or callees of r, merged across call chains, into the
+// scratch array edges
+static void print_edges(FILE *f, const struct routine *r, int callers,
+                        struct routine *edges) {
+    uint32_t used = 0;
+    char name[160];
+
+    for (uint32_t n = 1; n < hs.node_count; n++) {
+        struct node *node = &hs.nodes[n];
+        uint32_t other;
+        uint32_t e;
+
+        if (callers ? node->routine != r->loc
+                    : hs.nodes[node->parent].routine != r->loc) {
+            continue;
+        }
+        other = callers ? hs.nodes[node->parent].routine : node->routine;
+        for (e = 0; e < used && edges[e].loc != other; e++) {
+        }
+        if (e == used) {
+            memset(&edges[used++], 0, sizeof(*edges));
+            edges[e].loc = other;
+        }
+        edges[e].calls += node->calls;
+        edges[e].total += node->total;
+    }
+    qsort(edges, used, sizeof(*edges), by_total);
+
+    for (uint32_t e = 0; e < used; e++) {
+        routine_name(edges[e].loc, name, sizeof(name));
+        fprintf(f, "  %7s %6.2f%% %10llu    %s %s\n", "",
+                percent(edges[e].total), (unsigned long long)edges[e].calls,
+                callers ? "<-" : "->", name);
+    }
+}
+
+static void print_routines(FILE *f, unsigned int top) {
+    struct routine *routines;
+    struct routine *edges;
+    uint32_t *slot;
+    uint32_t used = 0;
+    char name[160];
+
+    routines = calloc(hs.node_count, sizeof(*routines));
+    edges = malloc(hs.node_count * sizeof(*edges));
+    slot = malloc((hs.locs + 1) * sizeof(*slot));
+    if (!routines || !edges || !slot) {
+        free(routines);
+        free(edges);
+        free(slot);
+        return;
+    }
+    memset(slot, 0xff, (hs.locs + 1) * sizeof(*slot));
+
+    sum_tree();
+    for (uint32_t n = 0; n < hs.node_count; n++) {
+        struct node *node = &hs.nodes[n];
+        struct routine *r;
+
+        if (slot[node->routine] == NO_NODE) {
+            slot[node->routine] = used;
+            routines[used++].loc = node->routine;
+        }
+        r = &routines[slot[node->routine]];
+        r->calls += node->calls;
+        r->self += node->self;
+        if (!recursive(n)) {
+            r->total += node->total;
+        }
+    }
+    qsort(routines, used, sizeof(*routines), by_total);
+
+    fprintf(f, "\n  %7s %7s %10s  %s\n", "total", "self", "calls", "routine");
+    for (uint32_t i = 0; i < used && i < top; i++) {
+        struct routine *r = &routines[i];
+
+        routine_name(r->loc, name, sizeof(name));
+        fprintf(f, "  %6.2f%% %6.2f%% %10llu  %s\n", percent(r->total),
+                percent(r->self), (unsigned long long)r->calls, name);
+        print_edges(f, r, 1, edges);
+        print_edges(f, r, 0, edges);
+    }
+
+    free(routines);
+    free(edges);
+    free(slot);
+}
+
+void cpu6502_hotspot_report(FILE *f, unsigned int top) {
+    if (!hs.cart) {
+        return;
+    }
+
+    fprintf(f, "\nCPU hot spots: %llu cycles, %u call chains, %u labels\n",
+            (unsigned long long)hs.total, hs.node_count, hs.label_count);
+    print_flat(f, top);
+    print_routines(f, top);
+}
+
+// Names of the routines from the top of the tree down to node n
+static void write_stack(FILE *f, uint32_t n) {
+    char name[160];
+
+    if (hs.nodes[n].parent != NO_NODE) {
+        write_stack(f, hs.nodes[n].parent);
+        fputc(';', f);
+    }
+    routine_name(hs.nodes[n].routine, name, sizeof(name));
+    fputs(name, f);
+}
+
+int cpu6502_hotspot_write_folded(const char *filename) {
+    FILE *f;
+
+    if (!hs.cart) {
+        return -EINVAL;
+    }
+
+    f = fopen(filename, "w");
+    if (!f) {
+        int err = errno;
+
+        printf("Cannot write %s: %s\n", filename, strerror(err));
+        return -err;
+    }
+
+    for (uint32_t n = 0; n < hs.node_count; n++) {
+        if (hs.nodes[n].self) {
+            write_stack(f, n);
+            fprintf(f, " %llu\n", (unsigned long long)hs.nodes[n].self);
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
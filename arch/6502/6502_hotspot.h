@@ -0,0 +1,46 @@
+// 6502_hotspot.h
+//
+// Where the emulated CPU spends its cycles. Built with -DCPU_PROFILE like
+// the instruction mix profile (6502_profile.h), and active while
+// cpu6502_hotspot_enabled is set.
+//
+// Cycles are charged to the address of the instruction that took them.
+// Code in PRG-ROM is identified by its offset in the ROM rather than its
+// CPU address, so banks that are switched into the same window are told
+// apart. A shadow call stack follows JSR/RTS and interrupts/RTI to group
+// the cycles into routines, named after the labels loaded, if any.
+
+#ifndef __6502_HOTSPOT_H__
+#define __6502_HOTSPOT_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cartridge.h"
+
+extern uint8_t cpu6502_hotspot_enabled;
+
+// Size the counters for the cartridge and start profiling. 0, or -errno.
+int cpu6502_hotspot_start(struct nes_cartridge *cart);
+
+// Called by the cores after each instruction with its address, opcode and
+// cycles, and the PC and stack pointer it left behind
+void cpu6502_hotspot_insn(uint16_t pc, uint8_t opcode, uint16_t cycles,
+                          uint16_t next_pc, uint8_t sp);
+
+// Called by the cores on entering an interrupt handler at pc
+void cpu6502_hotspot_interrupt(uint16_t pc, uint8_t sp, uint16_t cycles);
+
+// Name addresses from a ca65 debug file (.dbg), an FCEUX name list (.nl,
+// named <rom>.<bank>.nl or <rom>.ram.nl) or a Mesen label file (.mlb).
+// The number of labels loaded, or -errno.
+int cpu6502_hotspot_load_labels(const char *filename);
+
+// The top addresses, then routines with their callers and callees
+void cpu6502_hotspot_report(FILE *f, unsigned int top);
+
+// One line per call stack, "outer;inner;leaf cycles", for flame graph
+// tools. 0, or -errno.
+int cpu6502_hotspot_write_folded(const char *filename);
+
+#endif /* __6502_HOTSPOT_H__ */
@@ -0,0 +1,118 @@
+// 6502_profile.c
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "6502_profile.h"
+
+struct cpu6502_profile cpu6502_profile = {0};
+
+static const char *mode_names[CPU_MODE_COUNT] = {
+    "imp", "acc", "imm", "zpg", "zpx", "zpy", "rel",
+    "abs", "abx", "aby", "ind", "idx", "idy",
+};
+
+void cpu6502_profile_describe(uint8_t opcode, const char *mnem,
+                              enum cpu6502_addr_mode mode) {
+    cpu6502_profile.mnem[opcode] = mnem;
+    cpu6502_profile.mode[opcode] = mode;
+}
+
+void cpu6502_profile_enable(int enable) { cpu6502_profile.enabled = !!enable; }
+
+void cpu6502_profile_reset(void) {
+    memset(cpu6502_profile.count, 0, sizeof(cpu6502_profile.count));
+    memset(cpu6502_profile.cycles, 0, sizeof(cpu6502_profile.cycles));
+    memset(cpu6502_profile.page_cross, 0, sizeof(cpu6502_profile.page_cross));
+    memset(cpu6502_profile.branch_taken, 0,
+           sizeof(cpu6502_profile.branch_taken));
+    cpu6502_profile.nmi = 0;
+    cpu6502_profile.irq = 0;
+}
+
+// Sort indexes by the cycles they account for, most first
+static const uint64_t *sort_key;
+
+static int by_cycles(const void *a, const void *b) {
+    uint64_t x = sort_key[*(const uint16_t *)a];
+    uint64_t y = sort_key[*(const uint16_t *)b];
+
+    return (x < y) - (x > y);
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+void cpu6502_profile_report(FILE *f) {
+    uint64_t mode_count[CPU_MODE_COUNT] = {0};
+    uint64_t mode_cycles[CPU_MODE_COUNT] = {0};
+    uint64_t mode_page_cross[CPU_MODE_COUNT] = {0};
+    uint64_t total_count = 0;
+    uint64_t total_cycles = 0;
+    uint16_t order[256];
+    uint16_t used = 0;
+
+    for (uint16_t op = 0; op < 256; op++) {
+        uint8_t mode = cpu6502_profile.mode[op];
+
+        total_count += cpu6502_profile.count[op];
+        total_cycles += cpu6502_profile.cycles[op];
+        mode_count[mode] += cpu6502_profile.count[op];
+        mode_cycles[mode] += cpu6502_profile.cycles[op];
+        mode_page_cross[mode] += cpu6502_profile.page_cross[op];
+        if (cpu6502_profile.count[op]) {
+            order[used++] = op;
+        }
+    }
+
+    fprintf(f, "\nCPU profile: %llu instructions, %llu cycles, %llu NMIs, "
+               "%llu IRQs\n",
+            (unsigned long long)total_count, (unsigned long long)total_cycles,
+            (unsigned long long)cpu6502_profile.nmi,
+            (unsigned long long)cpu6502_profile.irq);
+
+    sort_key = cpu6502_profile.cycles;
+    qsort(order, used, sizeof(order[0]), by_cycles);
+
+    fprintf(f, "\n  op mnem mode %12s %6s %12s %6s %5s %10s %10s\n", "count",
+            "%", "cycles", "%", "avg", "pagecross", "taken");
+    for (uint16_t i = 0; i < used; i++) {
+        uint8_t op = order[i];
+        const char *mnem = cpu6502_profile.mnem[op];
+
+        fprintf(f, "  %02x %-4s %-4s %12llu %6.2f %12llu %6.2f %5.2f %10llu "
+                   "%10llu\n",
+                op, mnem ? mnem : "???",
+                mode_names[cpu6502_profile.mode[op]],
+                (unsigned long long)cpu6502_profile.count[op],
+                percent(cpu6502_profile.count[op], total_count),
+                (unsigned long long)cpu6502_profile.cycles[op],
+                percent(cpu6502_profile.cycles[op], total_cycles),
+                (double)cpu6502_profile.cycles[op] / cpu6502_profile.count[op],
+                (unsigned long long)cpu6502_profile.page_cross[op],
+                (unsigned long long)cpu6502_profile.branch_taken[op]);
+    }
+
+    used = 0;
+    for (uint16_t mode = 0; mode < CPU_MODE_COUNT; mode++) {
+        if (mode_count[mode]) {
+            order[used++] = mode;
+        }
+    }
+    sort_key = mode_cycles;
+    qsort(order, used, sizeof(order[0]), by_cycles);
+
+    fprintf(f, "\n  mode %12s %6s %12s %6s %10s\n", "count", "%", "cycles",
+            "%", "pagecross");
+    for (uint16_t i = 0; i < used; i++) {
+        uint8_t mode = order[i];
+
+        fprintf(f, "  %-4s %12llu %6.2f %12llu %6.2f %10llu\n",
+                mode_names[mode], (unsigned long long)mode_count[mode],
+                percent(mode_count[mode], total_count),
+                (unsigned long long)mode_cycles[mode],
+                percent(mode_cycles[mode], total_cycles),
+                (unsigned long long)mode_page_cross[mode]);
+    }
+}
@@ -0,0 +1,71 @@
+// 6502_profile.h
+//
+// Instruction mix profile of the CPU cores. Built with -DCPU_PROFILE (the
+// NES_CPU_PROFILE CMake option) the cores count every instruction they run
+// while cpu6502_profile.enabled is set; without it nothing here is compiled
+// into the interpreter.
+
+#ifndef __6502_PROFILE_H__
+#define __6502_PROFILE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum cpu6502_addr_mode {
+    CPU_MODE_IMP,
+    CPU_MODE_ACC,
+    CPU_MODE_IMM,
+    CPU_MODE_ZPG,
+    CPU_MODE_ZPX,
+    CPU_MODE_ZPY,
+    CPU_MODE_REL,
+    CPU_MODE_ABS,
+    CPU_MODE_ABX,
+    CPU_MODE_ABY,
+    CPU_MODE_IND,
+    CPU_MODE_IDX,
+    CPU_MODE_IDY,
+    CPU_MODE_COUNT
+};
+
+struct cpu6502_profile {
+    uint8_t enabled;
+
+    // Per opcode: executions, cycles taken, indexed accesses and taken
+    // branches that crossed a page, and branches taken
+    uint64_t count[256];
+    uint64_t cycles[256];
+    uint64_t page_cross[256];
+    uint64_t branch_taken[256];
+
+    // Interrupt entries, 7 cycles each
+    uint64_t nmi;
+    uint64_t irq;
+
+    // What each opcode is, filled in from the instruction table
+    const char *mnem[256];
+    uint8_t mode[256];
+};
+
+extern struct cpu6502_profile cpu6502_profile;
+
+// Called by the cores after executing an instruction
+static inline void cpu6502_profile_insn(uint8_t opcode, uint16_t cycles,
+                                        uint8_t page_cross, uint8_t taken) {
+    cpu6502_profile.count[opcode]++;
+    cpu6502_profile.cycles[opcode] += cycles;
+    cpu6502_profile.page_cross[opcode] += page_cross;
+    cpu6502_profile.branch_taken[opcode] += taken;
+}
+
+void cpu6502_profile_describe(uint8_t opcode, const char *mnem,
+                              enum cpu6502_addr_mode mode);
+
+// Start or stop counting; counts are kept until reset
+void cpu6502_profile_enable(int enable);
+void cpu6502_profile_reset(void);
+
+// Opcodes and addressing modes, most cycles first
+void cpu6502_profile_report(FILE *f);
+
+#endif /* __6502_PROFILE_H__ */
@@ -9,6 +9,8 @@
 #include <unistd.h>
 
 #include "cartridge.h"
+#include "nes_state.h"
+#include "probes.h"
 
 void cartridge_info(struct nes_cartridge *cartridge) {
     printf("prg_rom_size: %02x\n", cartridge->hdr->prg_rom_size * 0x4000);
@@ -84,11 +86,117 @@ static void cpu_write(struct nes_cartridge *cart, uint16_t addr, uint8_t data) {
     cart->map->cpu_write(cart->map, addr, data);
 }
 
-struct nes_cartridge *load_rom(const char *filename) {
-    int ret = 0;
+static void scanline(struct nes_cartridge *cart) {
+    cart->map->scanline(cart->map);
+}
+
+// Work RAM at $6000, 8KB unless the header asks for more
+static uint32_t prg_ram_size(struct nes_cartridge_hdr *hdr) {
+    uint32_t size;
+
+    if (hdr->flags7.ines_version == 2) {
+        // NES 2.0: byte 10 holds the volatile (low nibble) and battery-backed
+        // (high nibble) sizes as shift counts of 64 bytes
+        uint8_t shift = hdr->flags6.persistent_mem ? hdr->flags10.flagss >> 4
+                                                   : hdr->flags10.flagss & 0x0f;
+        size = shift ? 64u << shift : 0;
+    } else {
+        // iNES: 8KB units, 0 means one
+        size = (hdr->flags8.prg_ram_size ? hdr->flags8.prg_ram_size : 1) *
+               0x2000;
+    }
+
+    return size < 0x2000 ? 0x2000 : size;
+}
+
+// Battery-backed RAM lives in <rom>.sav, mapped shared so every write the
+// game makes is already in the page cache and survives a crash of the
+// emulator. Returns NULL if the file can't be used.
+static uint8_t *map_save_file(const char *filename, uint32_t len) {
+    const char *slash = strrchr(filename, '/');
+    const char *dot = strrchr(filename, '.');
+    size_t base_len = (dot && (!slash || dot > slash))
+                          ? (size_t)(dot - filename)
+                          : strlen(filename);
+    struct stat sb;
+    uint8_t *ram = NULL;
+    char *path;
     int fd;
+
+    path = malloc(base_len + sizeof(".sav"));
+    if (!path) {
+        return NULL;
+    }
+    memcpy(path, filename, base_len);
+    strcpy(path + base_len, ".sav");
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        printf("Failed to open save file %s: %s\n", path, strerror(errno));
+        goto out;
+    }
+
+    // A new (or short) file reads back as zeroed RAM
+    if (fstat(fd, &sb) < 0 ||
+        (sb.st_size < (off_t)len && ftruncate(fd, len) < 0)) {
+        printf("Failed to size save file %s: %s\n", path, strerror(errno));
+        goto out;
+    }
+
+    ram = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ram == MAP_FAILED) {
+        printf("Failed to map save file %s: %s\n", path, strerror(errno));
+        ram = NULL;
+        goto out;
+    }
+
+    printf("Battery-backed PRG-RAM saved to %s\n", path);
+
+out:
+    // The mapping keeps the file open
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(path);
+    return ram;
+}
+
+static void free_prg_ram(struct nes_cartridge *cart) {
+    if (!cart->prg_ram) {
+        return;
+    }
+
+    if (cart->prg_ram_mapped) {
+        msync(cart->prg_ram, cart->prg_ram_len, MS_SYNC);
+        munmap(cart->prg_ram, cart->prg_ram_len);
+    } else {
+        free(cart->prg_ram);
+    }
+    cart->prg_ram = NULL;
+}
+
+void cartridge_sync(struct nes_cartridge *cartridge) {
+    // Queue the pages written since the last sync for writeback without
+    // waiting for the disk
+    if (cartridge->prg_ram_mapped) {
+        msync(cartridge->prg_ram, cartridge->prg_ram_len, MS_ASYNC);
+    }
+}
+
+void unload_rom(struct nes_cartridge *cartridge) {
+    mapper_destroy(cartridge->map);
+    free_prg_ram(cartridge);
+
+    munmap(cartridge->raw_data, cartridge->raw_len);
+    close(cartridge->fd);
+    free(cartridge);
+}
+
+struct nes_cartridge *load_rom(const char *filename, struct nes_state *arena) {
+    int ret = 0;
+    int fd = -1;
     struct stat sb;
-    void *cartridge_data;
+    void *cartridge_data = MAP_FAILED;
     struct nes_cartridge *cartridge;
 
     cartridge = (struct nes_cartridge *)malloc(sizeof(struct nes_cartridge));
@@ -98,6 +206,7 @@ struct nes_cartridge *load_rom(const char *filename) {
     }
 
     memset(cartridge, 0, sizeof(struct nes_cartridge));
+    cartridge->arena = arena;
 
     cartridge->cpu_read = cpu_read;
     cartridge->cpu_write = cpu_write;
@@ -125,6 +234,7 @@ struct nes_cartridge *load_rom(const char *filename) {
     }
 
     cartridge->hdr = (struct nes_cartridge_hdr *)cartridge_data;
+    cartridge->raw_len = sb.st_size;
 
     if (cartridge->hdr->magic != NES_MAGIC) {
         printf("%s is not a valid NES cartridge\n", filename);
@@ -153,15 +263,24 @@ struct nes_cartridge *load_rom(const char *filename) {
         cartridge->chr_rom_len = cartridge->hdr->chr_rom_size * 0x2000;
         cartridge->chr_ram_allocated = 0;
     } else {
-        // No CHR-ROM: allocate 8KB CHR-RAM (games can use this as RAM)
-        cartridge->chr_rom_len = 0x2000;  // 8KB CHR-RAM
-        cartridge->chr_rom = (uint8_t *)malloc(cartridge->chr_rom_len);
-        if (cartridge->chr_rom) {
-            memset(cartridge->chr_rom, 0, cartridge->chr_rom_len);
-            cartridge->chr_ram_allocated = 1;
-            printf("Allocated 8KB CHR-RAM for cartridge (chr_rom_size=0)\n");
-        } else {
-            printf("ERROR: Failed to allocate CHR-RAM\n");
+        // No CHR-ROM: 8KB CHR-RAM (games can use this as RAM), kept in the
+        // machine state so snapshots include it
+        cartridge->chr_rom_len = sizeof(arena->chr_ram);
+        cartridge->chr_rom = arena->chr_ram;
+        memset(cartridge->chr_rom, 0, cartridge->chr_rom_len);
+        cartridge->chr_ram_allocated = 1;
+        printf("Using 8KB CHR-RAM for cartridge (chr_rom_size=0)\n");
+    }
+
+    cartridge->prg_ram_len = prg_ram_size(cartridge->hdr);
+    if (cartridge->hdr->flags6.persistent_mem) {
+        cartridge->prg_ram = map_save_file(filename, cartridge->prg_ram_len);
+        cartridge->prg_ram_mapped = cartridge->prg_ram != NULL;
+    }
+    if (!cartridge->prg_ram) {
+        cartridge->prg_ram = calloc(1, cartridge->prg_ram_len);
+        if (!cartridge->prg_ram) {
+            printf("ERROR: Failed to allocate PRG-RAM\n");
             ret = -ENOMEM;
             goto out;
         }
@@ -173,14 +292,20 @@ struct nes_cartridge *load_rom(const char *filename) {
     // Initialize and connect the mapper. The proper mapper will be determined
     // inside the mapper_init function
     cartridge->map = mapper_init(cartridge);
+    if (!cartridge->map) {
+        ret = -ENOTSUP;
+        goto out;
+    }
+    if (cartridge->map->scanline) {
+        cartridge->scanline = scanline;
+    }
+    NES_PROBE4(rom__load, filename, cartridge->mapper_id,
+               cartridge->prg_rom_len, cartridge->chr_rom_len);
 
 out:
     if (ret < 0) {
         if (cartridge) {
-            // Free CHR-RAM if we allocated it
-            if (cartridge->chr_ram_allocated && cartridge->chr_rom) {
-                free(cartridge->chr_rom);
-            }
+            free_prg_ram(cartridge);
         }
 
         if (cartridge_data != MAP_FAILED) {
@@ -11,6 +11,16 @@
 #define NES_MAGIC 0x1A53454E
 
 struct nes_cartridge;
+struct nes_state;
+
+// Nametable arrangement, as seen by the PPU. The first two match the iNES
+// header bit; the single-screen modes are selected by mappers.
+enum nes_mirroring {
+    NES_MIRROR_HORIZONTAL = 0,
+    NES_MIRROR_VERTICAL = 1,
+    NES_MIRROR_SINGLE_LOWER = 2,
+    NES_MIRROR_SINGLE_UPPER = 3,
+};
 
 struct nes_cartridge_hdr {
     uint32_t magic;
@@ -65,34 +75,62 @@ typedef void (*fp_cart_cpu_write)(struct nes_cartridge *cart, uint16_t addr,
 typedef uint8_t (*fp_cart_ppu_read)(struct nes_cartridge *cart, uint16_t addr);
 typedef void (*fp_cart_ppu_write)(struct nes_cartridge *cart, uint16_t addr,
                                   uint8_t data);
+typedef void (*fp_cart_chr_switched)(struct nes_cartridge *cart);
+typedef void (*fp_cart_mirroring_switched)(struct nes_cartridge *cart);
+typedef void (*fp_cart_scanline)(struct nes_cartridge *cart);
+typedef void (*fp_cart_prg_switched)(struct nes_cartridge *cart, uint16_t addr);
 
 struct nes_cartridge {
     union {
         struct nes_cartridge_hdr *hdr;
         uint8_t *raw_data;
     };
+    uint32_t raw_len;
     uint8_t *trainer;
     uint16_t trainer_len;
     uint8_t *prg_rom;
-    uint16_t prg_rom_len;
+    uint32_t prg_rom_len;
     uint8_t *chr_rom;
-    uint16_t chr_rom_len;
-    uint8_t chr_ram_allocated;  // 1 if chr_rom is malloc'd CHR-RAM, 0 if from file
+    uint32_t chr_rom_len;
+    uint8_t *prg_ram; // $6000-$7FFF work RAM
+    uint32_t prg_ram_len;
+    uint8_t prg_ram_mapped; // 1 if prg_ram is a shared mapping of the .sav
+    uint8_t chr_ram_allocated;  // 1 if chr_rom is the arena's CHR-RAM, 0 if from file
     uint8_t *pc_inst_rom;
     uint8_t *pc_prom;
     uint8_t mapper_id;
     int fd;
+    // Machine state arena the cartridge was loaded into, which holds its
+    // CHR-RAM and mapper registers
+    struct nes_state *arena;
     struct mapper *map;
     fp_cart_cpu_read cpu_read;
     fp_cart_cpu_write cpu_write;
     fp_cart_ppu_read ppu_read;
     fp_cart_ppu_write ppu_write;
+    // Called by the PPU on each rising edge of A12 while rendering. NULL
+    // unless the mapper counts scanlines.
+    fp_cart_scanline scanline;
+    // Called by the mapper when the PPU-visible CHR banks change
+    fp_cart_chr_switched chr_switched;
+    // Called by the mapper when it changes the nametable mirroring
+    fp_cart_mirroring_switched mirroring_switched;
+    // Called by the mapper when the memory behind the 8KB CPU window at addr
+    // ($6000-$E000) changes
+    fp_cart_prg_switched prg_switched;
 };
 
 typedef void (*fp_connect_cartridge)(struct nes_cartridge *cartridge);
 
-struct nes_cartridge *load_rom(const char *filename);
+// Load a cartridge into a machine state arena from nes_state_alloc()
+struct nes_cartridge *load_rom(const char *filename, struct nes_state *arena);
 
 void cartridge_info(struct nes_cartridge *cartridge);
 
+// Start writing battery-backed PRG-RAM back to the save file
+void cartridge_sync(struct nes_cartridge *cartridge);
+
+// Flush saves and release everything load_rom() set up
+void unload_rom(struct nes_cartridge *cartridge);
+
 #endif /* __CARTRIDGE_H__ */
\ No newline at end of file
@@ -0,0 +1,192 @@
+// Game Genie and raw memory patches
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cheat.h"
+
+// Each Game Genie letter stands for four bits
+static const char gg_letters[] = "APZLGITYEOXUKSVN";
+
+static int gg_decode(const char *code, size_t len, struct cheat *cheat) {
+    uint8_t n[8];
+
+    for (size_t i = 0; i < len; i++) {
+        const char *p = strchr(gg_letters, toupper((unsigned char)code[i]));
+
+        if (!p || !*p) {
+            return -EINVAL;
+        }
+        n[i] = p - gg_letters;
+    }
+
+    // The bits of address, value and compare are scattered over the
+    // letters; the address always lands in $8000-$FFFF
+    cheat->addr = 0x8000 | ((n[3] & 7) << 12) | ((n[5] & 7) << 8) |
+                  ((n[4] & 8) << 8) | ((n[2] & 7) << 4) | ((n[1] & 8) << 4) |
+                  (n[4] & 7) | (n[3] & 8);
+    cheat->value = ((n[1] & 7) << 4) | ((n[0] & 8) << 4) | (n[0] & 7);
+    if (len == 6) {
+        cheat->value |= n[5] & 8;
+        cheat->compare = 0;
+        cheat->has_compare = 0;
+    } else {
+        cheat->value |= n[7] & 8;
+        cheat->compare = ((n[7] & 7) << 4) | ((n[6] & 8) << 4) | (n[6] & 7) |
+                         (n[5] & 8);
+        cheat->has_compare = 1;
+    }
+    return 0;
+}
+
+// Exactly digits hex digits from *code, advancing it
+static int parse_hex(const char **code, int digits, uint16_t *out) {
+    *out = 0;
+    for (int i = 0; i < digits; i++) {
+        char c = (*code)[i];
+
+        if (!isxdigit((unsigned char)c)) {
+            return -EINVAL;
+        }
+        *out = (*out << 4) |
+               (isdigit((unsigned char)c) ? c - '0'
+                                          : tolower((unsigned char)c) - 'a' + 10);
+    }
+    *code += digits;
+    return 0;
+}
+
+static int raw_decode(const char *code, struct cheat *cheat) {
+    uint16_t addr, value, compare = 0;
+    int has_compare = 0;
+
+    if (parse_hex(&code, 4, &addr) || *code++ != ':' ||
+        parse_hex(&code, 2, &value)) {
+        return -EINVAL;
+    }
+    if (*code == ':') {
+        code++;
+        if (parse_hex(&code, 2, &compare)) {
+            return -EINVAL;
+        }
+        has_compare = 1;
+    }
+    if (*code) {
+        return -EINVAL;
+    }
+
+    cheat->addr = addr;
+    cheat->value = value;
+    cheat->compare = compare;
+    cheat->has_compare = has_compare;
+    return 0;
+}
+
+int cheat_decode(const char *code, struct cheat *cheat) {
+    size_t len = strlen(code);
+
+    if (strchr(code, ':')) {
+        return raw_decode(code, cheat);
+    }
+    if (len == 6 || len == 8) {
+        return gg_decode(code, len, cheat);
+    }
+    return -EINVAL;
+}
+
+int cheat_add(struct cheat_table *table, const struct cheat *cheat) {
+    int i;
+
+    // Several patches may share an address when their compare values tell
+    // apart the banks they are meant for
+    for (i = 0; i < table->count; i++) {
+        struct cheat *c = &table->patch[i];
+
+        if (c->addr == cheat->addr && c->has_compare == cheat->has_compare &&
+            c->compare == cheat->compare) {
+            *c = *cheat;
+            return 0;
+        }
+        if (c->addr > cheat->addr) {
+            break;
+        }
+    }
+
+    if (table->count == CHEAT_MAX) {
+        return -ENOSPC;
+    }
+    memmove(&table->patch[i + 1], &table->patch[i],
+            (table->count - i) * sizeof(*cheat));
+    table->patch[i] = *cheat;
+    table->count++;
+    table->pages[cheat->addr >> 13] |= 1u << ((cheat->addr >> 8) & 31);
+    return 0;
+}
+
+int cheat_load(struct cheat_table *table, const char *filename) {
+    char line[256];
+    int lineno = 0;
+    int count = 0;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (!f) {
+        int err = errno;
+
+        printf("Cannot open cheat file %s: %s\n", filename, strerror(err));
+        return -err;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char code[CHEAT_CODE_MAX + 1];
+        struct cheat cheat;
+        int ret;
+
+        lineno++;
+        if (sscanf(line, "%16s", code) != 1 || code[0] == '#') {
+            continue;
+        }
+
+        ret = cheat_decode(code, &cheat);
+        if (ret == 0) {
+            ret = cheat_add(table, &cheat);
+        }
+        if (ret < 0) {
+            printf("%s:%d: cannot use cheat %s: %s\n", filename, lineno, code,
+                   strerror(-ret));
+            fclose(f);
+            return ret;
+        }
+        count++;
+    }
+
+    fclose(f);
+    return count;
+}
+
+uint8_t cheat_apply(const struct cheat_table *table, uint16_t addr,
+                    uint8_t data) {
+    int lo = 0;
+    int hi = table->count;
+
+    // First patch at addr, then the first of those whose compare matches
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (table->patch[mid].addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < table->count && table->patch[lo].addr == addr; lo++) {
+        const struct cheat *c = &table->patch[lo];
+
+        if (!c->has_compare || c->compare == data) {
+            return c->value;
+        }
+    }
+    return data;
+}
\ No newline at end of file
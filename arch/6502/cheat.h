@@ -0,0 +1,49 @@
+#ifndef __CHEAT_H__
+#define __CHEAT_H__
+
+#include <stdint.h>
+
+// Cheats patch the value the CPU reads from an address, like a Game Genie
+// sitting between the console and the cartridge. The bus only consults the
+// table for pages flagged in its bitmap; every other page keeps its plain
+// page table entry.
+
+#define CHEAT_MAX 64
+#define CHEAT_CODE_MAX 16
+
+struct cheat {
+    uint16_t addr;
+    uint8_t value;
+    uint8_t compare;     // Only patch while the real data matches this...
+    uint8_t has_compare; // ...if set
+};
+
+struct cheat_table {
+    uint32_t pages[256 / 32]; // One bit per CPU page with a patch
+    uint8_t count;
+    struct cheat patch[CHEAT_MAX]; // Sorted by address
+};
+
+// Decode a 6 or 8 letter Game Genie code, or a raw AAAA:VV[:CC] patch
+// (hex address, value and optional compare). 0, or -EINVAL.
+int cheat_decode(const char *code, struct cheat *cheat);
+
+// Add a patch, replacing one for the same address and compare value.
+// 0, or -ENOSPC.
+int cheat_add(struct cheat_table *table, const struct cheat *cheat);
+
+// Add the codes in filename, one per line, each optionally followed by a
+// description. Blank lines and lines starting with '#' are skipped.
+// The number of codes added, or -errno.
+int cheat_load(struct cheat_table *table, const char *filename);
+
+static inline int cheat_page_active(const struct cheat_table *table,
+                                    uint8_t page) {
+    return (table->pages[page >> 5] >> (page & 31)) & 1;
+}
+
+// Data the CPU sees at addr when the bus returns data
+uint8_t cheat_apply(const struct cheat_table *table, uint16_t addr,
+                    uint8_t data);
+
+#endif /* __CHEAT_H__ */
\ No newline at end of file
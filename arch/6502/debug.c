@@ -6,9 +6,19 @@
 void hex_dump(const void *data, size_t size) {
     char ascii[17];
     size_t i, j;
+
+#ifdef DEBUG
+    // The ASCII column lives on the stack and the log formats its records
+    // later, so the dump is printed directly, when the CPU trace is on
+    if (log_levels[LOG_CPU] < LOG_LEVEL_TRACE) {
+        return;
+    }
+#else
+    return;
+#endif
     ascii[16] = '\0';
     for (i = 0; i < size; ++i) {
-        log_print("%02X ", ((unsigned char *)data)[i]);
+        printf("%02X ", ((unsigned char *)data)[i]);
         if (((unsigned char *)data)[i] >= ' ' &&
             ((unsigned char *)data)[i] <= '~') {
             ascii[i % 16] = ((unsigned char *)data)[i];
@@ -16,18 +26,18 @@ void hex_dump(const void *data, size_t size) {
             ascii[i % 16] = '.';
         }
         if ((i + 1) % 8 == 0 || i + 1 == size) {
-            log_print(" ");
+            printf(" ");
             if ((i + 1) % 16 == 0) {
-                log_print("|  %s \n", ascii);
+                printf("|  %s \n", ascii);
             } else if (i + 1 == size) {
                 ascii[(i + 1) % 16] = '\0';
                 if ((i + 1) % 16 <= 8) {
-                    log_print(" ");
+                    printf(" ");
                 }
                 for (j = (i + 1) % 16; j < 16; ++j) {
-                    log_print("   ");
+                    printf("   ");
                 }
-                log_print("|  %s \n", ascii);
+                printf("|  %s \n", ascii);
             }
         }
     }
@@ -1,11 +1,12 @@
 
 #include <stdio.h>
 
+#include "logger.h"
+
+// Built with -DDEBUG, the CPU trace is logged as the cpu category at the
+// trace level
 #ifdef DEBUG
-#define log_print(...)                                                         \
-    do {                                                                       \
-        fprintf(stdout, __VA_ARGS__);                                          \
-    } while (0)
+#define log_print(...) LOG(LOG_CPU, LOG_LEVEL_TRACE, __VA_ARGS__)
 #else
 #define log_print(...)                                                         \
     do {                                                                       \
@@ -0,0 +1,195 @@
+// Host time per emulator subsystem
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "host_timer.h"
+
+#define HOST_TIMER_THREADS 16
+
+uint8_t host_timer_enabled;
+__thread struct host_timer_thread *host_timer_self;
+
+static const char *phase_names[HOST_PHASE_COUNT] = {
+    "cpu",         "ppu",   "bus",    "mapper",  "render",
+    "render_wait", "input", "upload", "present",
+};
+
+static struct {
+    // Slots handed out to threads as they first enter a scope. A slot is
+    // never given back, so a thread's counts outlive it. Threads past the
+    // last slot are not timed; their scopes are only counted as dropped.
+    struct host_timer_thread threads[HOST_TIMER_THREADS];
+    uint32_t thread_count;
+    uint64_t dropped;
+
+    // Each slot's counts when the last frame was folded in
+    uint64_t seen[HOST_TIMER_THREADS][HOST_PHASE_COUNT];
+
+    double ns_per_tick;
+    uint64_t frame_start;
+    uint64_t frames;
+    uint64_t wall;
+    uint64_t total[HOST_PHASE_COUNT];
+    uint64_t max[HOST_PHASE_COUNT];
+    // Time of the emulation thread outside every scope
+    uint64_t other;
+    uint64_t other_max;
+
+    FILE *csv;
+} ht;
+
+struct host_timer_thread *host_timer_register(void) {
+    uint32_t slot = __atomic_load_n(&ht.thread_count, __ATOMIC_RELAXED);
+
+    if (slot < HOST_TIMER_THREADS) {
+        slot = __atomic_fetch_add(&ht.thread_count, 1, __ATOMIC_RELAXED);
+    }
+    if (slot >= HOST_TIMER_THREADS) {
+        __atomic_fetch_add(&ht.dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    host_timer_self = &ht.threads[slot];
+    return host_timer_self;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Ticks of host_timer_now() against the monotonic clock over 20ms
+static double calibrate(void) {
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 20000000};
+    uint64_t ns = monotonic_ns();
+    uint64_t ticks = host_timer_now();
+
+    nanosleep(&pause, NULL);
+    ns = monotonic_ns() - ns;
+    ticks = host_timer_now() - ticks;
+
+    return ticks ? (double)ns / ticks : 1.0;
+}
+
+int host_timer_start(const char *csv_file) {
+    if (csv_file) {
+        ht.csv = fopen(csv_file, "w");
+        if (!ht.csv) {
+            int err = errno;
+
+            printf("Cannot write %s: %s\n", csv_file, strerror(err));
+            return -err;
+        }
+
+        fprintf(ht.csv, "frame,wall_us");
+        for (int p = 0; p < HOST_PHASE_COUNT; p++) {
+            fprintf(ht.csv, ",%s_us", phase_names[p]);
+        }
+        fprintf(ht.csv, ",other_us\n");
+    }
+
+    ht.ns_per_tick = calibrate();
+    ht.frame_start = host_timer_now();
+    host_timer_enabled = 1;
+    return 0;
+}
+
+static double us(uint64_t ticks) { return ticks * ht.ns_per_tick / 1000.0; }
+
+void host_timer_frame(void) {
+    struct host_timer_thread *self = host_timer_self;
+    uint64_t frame[HOST_PHASE_COUNT] = {0};
+    uint64_t now = host_timer_now();
+    uint64_t wall = now - ht.frame_start;
+    uint64_t timed = 0;
+    uint64_t other;
+    uint32_t count;
+
+    if (!host_timer_enabled) {
+        return;
+    }
+    ht.frame_start = now;
+
+    count = __atomic_load_n(&ht.thread_count, __ATOMIC_RELAXED);
+    if (count > HOST_TIMER_THREADS) {
+        count = HOST_TIMER_THREADS;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        struct host_timer_thread *t = &ht.threads[i];
+
+        for (int p = 0; p < HOST_PHASE_COUNT; p++) {
+            uint64_t ticks = __atomic_load_n(&t->ticks[p], __ATOMIC_RELAXED);
+            uint64_t delta = ticks - ht.seen[i][p];
+
+            ht.seen[i][p] = ticks;
+            frame[p] += delta;
+            if (t == self) {
+                timed += delta;
+            }
+        }
+    }
+    other = wall > timed ? wall - timed : 0;
+
+    ht.frames++;
+    ht.wall += wall;
+    ht.other += other;
+    if (other > ht.other_max) {
+        ht.other_max = other;
+    }
+    for (int p = 0; p < HOST_PHASE_COUNT; p++) {
+        ht.total[p] += frame[p];
+        if (frame[p] > ht.max[p]) {
+            ht.max[p] = frame[p];
+        }
+    }
+
+    if (ht.csv) {
+        fprintf(ht.csv, "%llu,%.1f", (unsigned long long)ht.frames, us(wall));
+        for (int p = 0; p < HOST_PHASE_COUNT; p++) {
+            fprintf(ht.csv, ",%.1f", us(frame[p]));
+        }
+        fprintf(ht.csv, ",%.1f\n", us(other));
+    }
+}
+
+static void report_line(FILE *f, const char *name, uint64_t total,
+                        uint64_t max) {
+    fprintf(f, "  %-12s %10.1f %7.2f%% %12.1f %12.1f\n", name,
+            us(total) / 1000.0, ht.wall ? 100.0 * total / ht.wall : 0.0,
+            us(total) / ht.frames, us(max));
+}
+
+void host_timer_report(FILE *f) {
+    uint32_t threads = __atomic_load_n(&ht.thread_count, __ATOMIC_RELAXED);
+    uint64_t dropped = __atomic_load_n(&ht.dropped, __ATOMIC_RELAXED);
+
+    if (!ht.frames) {
+        return;
+    }
+    if (threads > HOST_TIMER_THREADS) {
+        threads = HOST_TIMER_THREADS;
+    }
+
+    fprintf(f, "\nHost time: %llu frames, %.3f s, %.1f us/frame, %u threads\n",
+            (unsigned long long)ht.frames, us(ht.wall) / 1e6,
+            us(ht.wall) / ht.frames, threads);
+    if (dropped) {
+        fprintf(f, "  %llu scopes not timed: more than %d threads\n",
+                (unsigned long long)dropped, HOST_TIMER_THREADS);
+    }
+    fprintf(f, "\n  %-12s %10s %8s %12s %12s\n", "phase", "total ms", "% wall",
+            "avg us/frame", "max us/frame");
+    for (int p = 0; p < HOST_PHASE_COUNT; p++) {
+        if (ht.total[p]) {
+            report_line(f, phase_names[p], ht.total[p], ht.max[p]);
+        }
+    }
+    report_line(f, "other", ht.other, ht.other_max);
+
+    if (ht.csv) {
+        fflush(ht.csv);
+    }
+}
\ No newline at end of file
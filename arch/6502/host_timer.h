@@ -0,0 +1,140 @@
+// host_timer.h
+//
+// Where host time goes, per emulator subsystem. Built with -DHOST_PROFILE
+// (the NES_HOST_PROFILE CMake option) the HOST_TIMER_* scopes read the
+// time stamp counter while host_timer_enabled is set; without it they
+// compile to nothing.
+//
+// Scopes nest, and entering one stops the clock of the one it interrupts,
+// so every phase is charged only its own time: the CPU does not include
+// the bus accesses it makes, nor the bus the mapper behind it. Each thread
+// counts into its own slot, and the emulation thread folds all of them
+// into a row per frame. Threads that find every slot taken are not timed,
+// and the report counts the scopes they entered.
+
+#ifndef __HOST_TIMER_H__
+#define __HOST_TIMER_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum host_phase {
+    HOST_PHASE_CPU,         // Instruction fetch and execution
+    HOST_PHASE_PPU,         // PPU dots and the frame loop around them
+    HOST_PHASE_BUS,         // CPU accesses to registers (MMIO dispatch)
+    HOST_PHASE_MAPPER,      // Mapper reads, writes and scanline counters
+    HOST_PHASE_RENDER,      // Drawing pixels from the frame log
+    HOST_PHASE_RENDER_WAIT, // Waiting for the render thread
+    HOST_PHASE_INPUT,       // Polling window events and controllers
+    HOST_PHASE_UPLOAD,      // Copying the frame to the display texture
+    HOST_PHASE_PRESENT,     // Presenting it, including the vsync wait
+    HOST_PHASE_COUNT
+};
+
+#ifdef HOST_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define HOST_TIMER_DEPTH 16
+
+// One per thread that enters a scope. Only that thread writes to it.
+struct host_timer_thread {
+    uint64_t ticks[HOST_PHASE_COUNT];
+    uint64_t since;
+    uint8_t stack[HOST_TIMER_DEPTH];
+    uint8_t depth;
+};
+
+extern uint8_t host_timer_enabled;
+extern __thread struct host_timer_thread *host_timer_self;
+
+// The calling thread's slot, or NULL if none is left
+struct host_timer_thread *host_timer_register(void);
+
+static inline uint64_t host_timer_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Charge the time since the last switch to the phase that was running
+static inline void host_timer_switch(struct host_timer_thread *t,
+                                     uint64_t now) {
+    if (t->depth) {
+        uint8_t phase = t->stack[t->depth - 1];
+
+        __atomic_store_n(&t->ticks[phase], t->ticks[phase] + now - t->since,
+                         __ATOMIC_RELAXED);
+    }
+    t->since = now;
+}
+
+static inline void host_timer_enter(enum host_phase phase) {
+    struct host_timer_thread *t = host_timer_self;
+
+    if (!t) {
+        t = host_timer_register();
+        if (!t) {
+            return;
+        }
+    }
+    host_timer_switch(t, host_timer_now());
+    if (t->depth < HOST_TIMER_DEPTH) {
+        t->stack[t->depth++] = phase;
+    }
+}
+
+static inline void host_timer_leave(void) {
+    struct host_timer_thread *t = host_timer_self;
+
+    if (t && t->depth) {
+        host_timer_switch(t, host_timer_now());
+        t->depth--;
+    }
+}
+
+#define HOST_TIMER_ENTER(phase)                                                \
+    do {                                                                       \
+        if (host_timer_enabled) {                                              \
+            host_timer_enter(phase);                                           \
+        }                                                                      \
+    } while (0)
+
+#define HOST_TIMER_LEAVE()                                                     \
+    do {                                                                       \
+        if (host_timer_enabled) {                                              \
+            host_timer_leave();                                                \
+        }                                                                      \
+    } while (0)
+
+// Calibrate the counter and start timing. With csv_file, also write one
+// line per frame with the microseconds each phase took. 0, or -errno.
+int host_timer_start(const char *csv_file);
+
+// Called by the emulation thread between frames, outside any scope
+void host_timer_frame(void);
+
+// Totals, averages and worst frames per phase
+void host_timer_report(FILE *f);
+
+#else
+
+#define HOST_TIMER_ENTER(phase)                                                \
+    do {                                                                       \
+    } while (0)
+#define HOST_TIMER_LEAVE()                                                     \
+    do {                                                                       \
+    } while (0)
+
+#endif
+
+#endif /* __HOST_TIMER_H__ */
\ No newline at end of file
@@ -0,0 +1,448 @@
+// Log records by category, formatted on a background thread
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logger.h"
+
+#define LOG_RING_SIZE 8192 // Records, a power of two
+#define LOG_SPEC_MAX 32
+#define LOG_LINE_MAX 512
+
+// How an argument was passed, from its conversion
+enum log_arg {
+    LOG_ARG_NONE, // %% or not a conversion
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTR, // %p and %s
+    LOG_ARG_DOUBLE,
+};
+
+// A record in the ring. seq is the position it may be written at next,
+// plus one once it has been written.
+struct log_entry {
+    uint64_t seq;
+    const struct log_site *site;
+    const char *fmt;
+    uint64_t time;
+    uint64_t args[LOG_MAX_ARGS];
+};
+
+uint8_t log_levels[LOG_CATEGORY_COUNT];
+
+static const char *category_names[LOG_CATEGORY_COUNT] = {
+    "cpu", "ppu", "bus", "mapper", "input", "display",
+};
+
+static const char *level_names[] = {
+    "off", "error", "warn", "info", "debug", "trace",
+};
+
+static struct {
+    struct log_entry *ring;
+    uint64_t head; // Next position to claim, shared by the producers
+    uint64_t tail; // Next position to write out, the writer's own
+    uint64_t dropped;
+
+    FILE *out;
+    pthread_t thread;
+    uint8_t running;
+    uint64_t epoch;
+} lg;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Copy the conversion at p, which points to a '%', to spec, and find the
+// type of its argument. Returns the text after it.
+static const char *parse_spec(const char *p, char *spec, uint8_t *type) {
+    const char *s = p + 1;
+    uint8_t longs = 0;
+    uint8_t size = 0;
+    size_t n;
+
+    while (*s && strchr("-+ #0123456789.hlLzjt", *s)) {
+        if (*s == 'l') {
+            longs++;
+        } else if (*s == 'z' || *s == 'j' || *s == 't') {
+            size = 1;
+        }
+        s++;
+    }
+
+    switch (*s) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        if (size) {
+            *type = LOG_ARG_SIZE;
+        } else if (longs > 1) {
+            *type = LOG_ARG_LLONG;
+        } else if (longs) {
+            *type = LOG_ARG_LONG;
+        } else {
+            *type = LOG_ARG_INT;
+        }
+        break;
+    case 'p':
+    case 's':
+        *type = LOG_ARG_PTR;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *type = LOG_ARG_DOUBLE;
+        break;
+    default:
+        *type = LOG_ARG_NONE;
+        break;
+    }
+    if (*s) {
+        s++;
+    }
+
+    n = s - p;
+    if (n >= LOG_SPEC_MAX) {
+        n = LOG_SPEC_MAX - 1;
+        *type = LOG_ARG_NONE;
+    }
+    memcpy(spec, p, n);
+    spec[n] = '\0';
+    return s;
+}
+
+static void parse_site(struct log_site *site, const char *fmt) {
+    char spec[LOG_SPEC_MAX];
+    uint8_t nargs = 0;
+    uint8_t type;
+
+    for (const char *p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+        p = parse_spec(p, spec, &type);
+        if (type != LOG_ARG_NONE && nargs < LOG_MAX_ARGS) {
+            site->types[nargs++] = type;
+        }
+    }
+    site->nargs = nargs;
+    __atomic_store_n(&site->parsed, 1, __ATOMIC_RELEASE);
+}
+
+void log_record(struct log_site *site, const char *fmt, ...) {
+    struct log_entry *e;
+    uint64_t pos;
+    va_list ap;
+
+    if (!lg.ring) {
+        return;
+    }
+    if (!__atomic_load_n(&site->parsed, __ATOMIC_ACQUIRE)) {
+        parse_site(site, fmt);
+    }
+
+    // Claim a slot the writer is done with, or drop the record
+    pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+    for (;;) {
+        int64_t diff;
+
+        e = &lg.ring[pos & (LOG_RING_SIZE - 1)];
+        diff = (int64_t)(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&lg.head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&lg.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&lg.head, __ATOMIC_RELAXED);
+        }
+    }
+
+    e->site = site;
+    e->fmt = fmt;
+    e->time = now_ns();
+    va_start(ap, fmt);
+    for (uint8_t i = 0; i < site->nargs; i++) {
+        double d;
+
+        switch (site->types[i]) {
+        case LOG_ARG_INT:
+            e->args[i] = (uint64_t)va_arg(ap, int);
+            break;
+        case LOG_ARG_LONG:
+            e->args[i] = (uint64_t)va_arg(ap, long);
+            break;
+        case LOG_ARG_LLONG:
+            e->args[i] = (uint64_t)va_arg(ap, long long);
+            break;
+        case LOG_ARG_SIZE:
+            e->args[i] = (uint64_t)va_arg(ap, size_t);
+            break;
+        case LOG_ARG_PTR:
+            e->args[i] = (uintptr_t)va_arg(ap, void *);
+            break;
+        case LOG_ARG_DOUBLE:
+            d = va_arg(ap, double);
+            memcpy(&e->args[i], &d, sizeof(d));
+            break;
+        }
+    }
+    va_end(ap);
+
+    __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+// Format one argument with its conversion spec
+static int format_arg(char *buf, size_t size, const char *spec, uint8_t type,
+                      uint64_t arg) {
+    double d;
+
+    switch (type) {
+    case LOG_ARG_INT:
+        return snprintf(buf, size, spec, (int)arg);
+    case LOG_ARG_LONG:
+        return snprintf(buf, size, spec, (long)arg);
+    case LOG_ARG_LLONG:
+        return snprintf(buf, size, spec, (long long)arg);
+    case LOG_ARG_SIZE:
+        return snprintf(buf, size, spec, (size_t)arg);
+    case LOG_ARG_PTR:
+        if (!arg && spec[strlen(spec) - 1] == 's') {
+            return snprintf(buf, size, "(null)");
+        }
+        return snprintf(buf, size, spec, (void *)(uintptr_t)arg);
+    case LOG_ARG_DOUBLE:
+        memcpy(&d, &arg, sizeof(d));
+        return snprintf(buf, size, spec, d);
+    }
+    return 0;
+}
+
+static void write_entry(const struct log_entry *e) {
+    const struct log_site *site = e->site;
+    char line[LOG_LINE_MAX];
+    char spec[LOG_SPEC_MAX];
+    const char *p = e->fmt;
+    size_t len = 0;
+    uint8_t arg = 0;
+    uint8_t type;
+
+    while (*p && len < sizeof(line) - 1) {
+        const char *pct = strchr(p, '%');
+        size_t n = pct ? (size_t)(pct - p) : strlen(p);
+        int ret;
+
+        if (n > sizeof(line) - 1 - len) {
+            n = sizeof(line) - 1 - len;
+        }
+        memcpy(line + len, p, n);
+        len += n;
+        if (!pct) {
+            break;
+        }
+
+        p = parse_spec(pct, spec, &type);
+        if (strcmp(spec, "%%") == 0) {
+            ret = snprintf(line + len, sizeof(line) - len, "%%");
+        } else if (type == LOG_ARG_NONE || arg >= site->nargs) {
+            ret = snprintf(line + len, sizeof(line) - len, "%s", spec);
+        } else {
+            ret = format_arg(line + len, sizeof(line) - len, spec, type,
+                             e->args[arg++]);
+        }
+        if (ret > 0) {
+            len += ret;
+        }
+        if (len > sizeof(line) - 1) {
+            len = sizeof(line) - 1;
+        }
+    }
+
+    // Lines end here, messages written for printf may have their own
+    while (len && line[len - 1] == '\n') {
+        len--;
+    }
+    line[len] = '\0';
+
+    fprintf(lg.out, "[%11.6f] %s: %s\n", (e->time - lg.epoch) / 1e9,
+            category_names[site->category], line);
+}
+
+// Write out every record in the ring. The number written.
+static uint32_t drain(void) {
+    uint32_t count = 0;
+    uint64_t dropped;
+
+    for (;;) {
+        struct log_entry *e = &lg.ring[lg.tail & (LOG_RING_SIZE - 1)];
+
+        if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != lg.tail + 1) {
+            break;
+        }
+        write_entry(e);
+        __atomic_store_n(&e->seq, lg.tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        lg.tail++;
+        count++;
+    }
+
+    dropped = __atomic_exchange_n(&lg.dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        fprintf(lg.out, "[%11.6f] log: %llu records dropped\n",
+                (now_ns() - lg.epoch) / 1e9, (unsigned long long)dropped);
+    }
+    return count;
+}
+
+static void *writer_thread(void *arg) {
+    const struct timespec idle = {0, 2000000};
+
+    (void)arg;
+    while (__atomic_load_n(&lg.running, __ATOMIC_ACQUIRE)) {
+        if (!drain()) {
+            fflush(lg.out);
+            nanosleep(&idle, NULL);
+        }
+    }
+    drain();
+    fflush(lg.out);
+
+    return NULL;
+}
+
+int log_start(const char *filename) {
+    int ret;
+
+    if (lg.running) {
+        return -EBUSY;
+    }
+
+    lg.out = stderr;
+    if (filename) {
+        lg.out = fopen(filename, "w");
+        if (!lg.out) {
+            int err = errno;
+
+            printf("Cannot write %s: %s\n", filename, strerror(err));
+            return -err;
+        }
+    }
+
+    if (!lg.ring) {
+        lg.ring = malloc(LOG_RING_SIZE * sizeof(struct log_entry));
+        if (!lg.ring) {
+            ret = -ENOMEM;
+            goto err;
+        }
+        for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+            lg.ring[i].seq = i;
+        }
+    }
+
+    lg.epoch = now_ns();
+    lg.running = 1;
+    ret = -pthread_create(&lg.thread, NULL, writer_thread, NULL);
+    if (ret < 0) {
+        lg.running = 0;
+        goto err;
+    }
+
+    memset(log_levels, LOG_LEVEL_INFO, sizeof(log_levels));
+    return 0;
+
+err:
+    if (lg.out != stderr) {
+        fclose(lg.out);
+    }
+    lg.out = NULL;
+    return ret;
+}
+
+static int find_name(const char *const *names, int count, const char *name,
+                     size_t len) {
+    for (int i = 0; i < count; i++) {
+        if (strlen(names[i]) == len && strncmp(names[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int log_set_levels(const char *spec) {
+    uint8_t levels[LOG_CATEGORY_COUNT];
+    const char *p = spec;
+
+    memcpy(levels, log_levels, sizeof(levels));
+    while (*p) {
+        const char *end = strchr(p, ',');
+        const char *eq = strchr(p, '=');
+        int category = -1;
+        int level;
+
+        if (!end) {
+            end = p + strlen(p);
+        }
+        if (eq && eq < end) {
+            category = find_name(category_names, LOG_CATEGORY_COUNT, p, eq - p);
+            if (category < 0) {
+                printf("Unknown log category in %s\n", spec);
+                return -EINVAL;
+            }
+            p = eq + 1;
+        }
+
+        level = find_name(level_names,
+                          sizeof(level_names) / sizeof(level_names[0]), p,
+                          end - p);
+        if (level < 0) {
+            printf("Unknown log level in %s\n", spec);
+            return -EINVAL;
+        }
+
+        if (category < 0) {
+            memset(levels, level, sizeof(levels));
+        } else {
+            levels[category] = level;
+        }
+        p = *end ? end + 1 : end;
+    }
+
+    memcpy(log_levels, levels, sizeof(levels));
+    return 0;
+}
+
+void log_stop(void) {
+    if (!lg.running) {
+        return;
+    }
+
+    // The ring stays, for threads that still have a record in flight
+    memset(log_levels, LOG_LEVEL_OFF, sizeof(log_levels));
+    __atomic_store_n(&lg.running, 0, __ATOMIC_RELEASE);
+    pthread_join(lg.thread, NULL);
+
+    if (lg.out != stderr) {
+        fclose(lg.out);
+    }
+    lg.out = NULL;
+}
\ No newline at end of file
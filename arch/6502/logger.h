@@ -0,0 +1,77 @@
+// logger.h
+//
+// Log records by category, each with its own level set at run time. A LOG()
+// whose category is below its level costs one compare of a global byte.
+// Otherwise only the format string and the raw arguments go into a ring
+// buffer, without a lock; a background thread formats them and writes them
+// out, so the emulation thread never waits on stdio.
+//
+// Arguments are formatted after the call returns: %s must point to a
+// string that lives on (a string constant), and the * width and precision
+// are not supported. At most LOG_MAX_ARGS arguments. When the ring is full
+// records are dropped, and the writer reports how many.
+
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <stdint.h>
+
+#define LOG_MAX_ARGS 8
+
+enum log_category {
+    LOG_CPU,
+    LOG_PPU,
+    LOG_BUS,
+    LOG_MAPPER,
+    LOG_INPUT,
+    LOG_DISPLAY,
+    LOG_CATEGORY_COUNT
+};
+
+enum log_level {
+    LOG_LEVEL_OFF,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_TRACE,
+};
+
+// Most verbose level recorded per category. Everything is off until
+// log_start().
+extern uint8_t log_levels[LOG_CATEGORY_COUNT];
+
+// A LOG() call site. Its format is parsed once, on the first record.
+struct log_site {
+    uint8_t category;
+    uint8_t level;
+    uint8_t parsed;
+    uint8_t nargs;
+    uint8_t types[LOG_MAX_ARGS];
+};
+
+void log_record(struct log_site *site, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Log a line; fmt and the arguments as for printf, without the newline
+#define LOG(category, level, ...)                                              \
+    do {                                                                       \
+        if (log_levels[category] >= (level)) {                                 \
+            static struct log_site log_site_ = {(category), (level), 0, 0,    \
+                                                {0}};                          \
+            log_record(&log_site_, __VA_ARGS__);                               \
+        }                                                                      \
+    } while (0)
+
+// Start the writer thread on filename, or stderr if NULL, with every
+// category at LOG_LEVEL_INFO. 0, or -errno.
+int log_start(const char *filename);
+
+// Set levels from a list like "ppu=debug,cpu=trace"; a level alone sets
+// every category. 0, or -EINVAL.
+int log_set_levels(const char *spec);
+
+// Write out what is left and stop the writer thread
+void log_stop(void);
+
+#endif /* __LOGGER_H__ */
\ No newline at end of file
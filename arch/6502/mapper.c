@@ -2,45 +2,241 @@
 
 #include "mapper_000.h"
 #include "mapper_001.h"
-#include "mapper_002.h"
-#include "mapper_003.h"
+#include "mapper_004.h"
+#include "mapper_discrete.h"
 
-static struct mapper map = {0};
+#include "6502.h"
+#include "logger.h"
+#include "nes_state.h"
+#include "probes.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest power of two that holds count banks, minus one
+static uint16_t bank_mask(uint16_t count) {
+    uint16_t mask = 0;
+
+    while (mask + 1 < count) {
+        mask = (mask << 1) | 1;
+    }
+    return mask;
+}
+
+static uint8_t *bank_ptr(uint8_t *mem, uint16_t count, uint16_t mask,
+                         uint16_t bank, uint16_t size) {
+    if (!mem || !count) {
+        return mem;
+    }
+
+    bank &= mask;
+    if (bank >= count) {
+        bank %= count; // Bank count is not a power of two
+    }
+    return mem + (uint32_t)bank * size;
+}
+
+// Tell the bus which CPU window to re-point
+static void prg_switched(struct mapper *map, uint16_t addr) {
+    struct nes_cartridge *cart = map->cartridge;
+
+    if (cart->prg_switched) {
+        cart->prg_switched(cart, addr);
+    }
+}
+
+void mapper_map_prg_8k(struct mapper *map, uint8_t slot, uint16_t bank) {
+    map->prg[slot & 0x03] =
+        bank_ptr(map->cartridge->prg_rom, map->prg_banks, map->prg_mask,
+                 bank, MAPPER_PRG_BANK_SIZE);
+    NES_PROBE2(prg__bank, slot & 0x03, bank);
+    LOG(LOG_MAPPER, LOG_LEVEL_TRACE, "PRG $%04X: bank %u",
+        0x8000 + (slot & 0x03) * MAPPER_PRG_BANK_SIZE, bank);
+    prg_switched(map, 0x8000 + (slot & 0x03) * MAPPER_PRG_BANK_SIZE);
+}
+
+void mapper_map_prg_16k(struct mapper *map, uint8_t slot, uint16_t bank) {
+    mapper_map_prg_8k(map, slot, bank * 2);
+    mapper_map_prg_8k(map, slot + 1, bank * 2 + 1);
+}
+
+void mapper_map_prg_32k(struct mapper *map, uint16_t bank) {
+    mapper_map_prg_16k(map, 0, bank * 2);
+    mapper_map_prg_16k(map, 2, bank * 2 + 1);
+}
+
+void mapper_map_prg_ram(struct mapper *map, uint8_t readable,
+                        uint8_t writable) {
+    map->prg_ram_read = readable ? map->prg_ram : NULL;
+    map->prg_ram_write = writable ? map->prg_ram : NULL;
+    prg_switched(map, 0x6000);
+}
+
+void mapper_map_chr_1k(struct mapper *map, uint8_t slot, uint16_t bank) {
+    map->chr[slot & 0x07] =
+        bank_ptr(map->cartridge->chr_rom, map->chr_banks, map->chr_mask,
+                 bank, MAPPER_CHR_BANK_SIZE);
+    NES_PROBE2(chr__bank, slot & 0x07, bank);
+    LOG(LOG_MAPPER, LOG_LEVEL_TRACE, "CHR $%04X: bank %u",
+        (slot & 0x07) * MAPPER_CHR_BANK_SIZE, bank);
+}
+
+void mapper_map_chr_4k(struct mapper *map, uint8_t slot, uint16_t bank) {
+    for (uint8_t i = 0; i < 4; i++) {
+        mapper_map_chr_1k(map, slot + i, bank * 4 + i);
+    }
+}
+
+void mapper_map_chr_8k(struct mapper *map, uint16_t bank) {
+    mapper_map_chr_4k(map, 0, bank * 2);
+    mapper_map_chr_4k(map, 4, bank * 2 + 1);
+}
 
 struct mapper *mapper_init(struct nes_cartridge *cartridge) {
+    struct mapper *map;
+    int ret;
+
+    map = calloc(1, sizeof(struct mapper));
+    if (!map) {
+        printf("ERROR: Failed to allocate mapper\n");
+        return NULL;
+    }
+
     // Not sure if we need the entire cartridge or just values from it.
     // Saving both for now.
-    map.cartridge = cartridge;
-    map.mapper_id = cartridge->mapper_id;
-    map.num_prg_rom = cartridge->hdr->prg_rom_size;
-    map.num_chr_rom = cartridge->hdr->chr_rom_size;
+    map->cartridge = cartridge;
+    map->arena = cartridge->arena;
+    map->mapper_id = cartridge->mapper_id;
+    map->num_prg_rom = cartridge->hdr->prg_rom_size;
+    map->num_chr_rom = cartridge->hdr->chr_rom_size;
+    map->prg_ram = cartridge->prg_ram;
+
+    map->prg_banks = cartridge->prg_rom_len / MAPPER_PRG_BANK_SIZE;
+    map->prg_mask = bank_mask(map->prg_banks);
+    map->chr_banks = cartridge->chr_rom_len / MAPPER_CHR_BANK_SIZE;
+    map->chr_mask = bank_mask(map->chr_banks);
 
-    switch (map.mapper_id) {
+    switch (map->mapper_id) {
     case 0:
-        map.cpu_read = mapper_000_cpu_read;
-        map.cpu_write = mapper_000_cpu_write;
-        map.ppu_read = mapper_000_ppu_read;
-        map.ppu_write = mapper_000_ppu_write;
+        map->reset = mapper_000_reset;
+        map->cpu_read = mapper_000_cpu_read;
+        map->cpu_write = mapper_000_cpu_write;
+        map->ppu_read = mapper_000_ppu_read;
+        map->ppu_write = mapper_000_ppu_write;
+#ifdef NES_MAPPER_CORES
+        map->cpu_clock = cpu6502_clock_nrom;
+#endif
         break;
     case 1:
-        map.cpu_read = mapper_001_cpu_read;
-        map.cpu_write = mapper_001_cpu_write;
-        map.ppu_read = mapper_001_ppu_read;
-        map.ppu_write = mapper_001_ppu_write;
+        map->init = mapper_001_init;
+        map->reset = mapper_001_reset;
+        map->destroy = mapper_state_free;
+        map->restore = mapper_001_restore;
+        map->cpu_read = mapper_001_cpu_read;
+        map->cpu_write = mapper_001_cpu_write;
+        map->ppu_read = mapper_001_ppu_read;
+        map->ppu_write = mapper_001_ppu_write;
+#ifdef NES_MAPPER_CORES
+        map->cpu_clock = cpu6502_clock_mmc1;
+#endif
         break;
-    case 2:
-        map.cpu_read = mapper_002_cpu_read;
-        map.cpu_write = mapper_002_cpu_write;
-        map.ppu_read = mapper_002_ppu_read;
-        map.ppu_write = mapper_002_ppu_write;
+    case 4:
+        map->init = mapper_004_init;
+        map->reset = mapper_004_reset;
+        map->destroy = mapper_state_free;
+        map->restore = mapper_004_restore;
+        map->cpu_read = mapper_004_cpu_read;
+        map->cpu_write = mapper_004_cpu_write;
+        map->ppu_read = mapper_004_ppu_read;
+        map->ppu_write = mapper_004_ppu_write;
+        map->scanline = mapper_004_scanline;
+#ifdef NES_MAPPER_CORES
+        map->cpu_clock = cpu6502_clock_mmc3;
+#endif
         break;
-    case 3:
-        map.cpu_read = mapper_003_cpu_read;
-        map.cpu_write = mapper_003_cpu_write;
-        map.ppu_read = mapper_003_ppu_read;
-        map.ppu_write = mapper_003_ppu_write;
+    default:
+        // Everything else is one of the table-driven discrete boards
+        map->init = mapper_discrete_init;
+        map->reset = mapper_discrete_reset;
+        map->destroy = mapper_state_free;
+        map->restore = mapper_discrete_restore;
+        map->cpu_read = mapper_discrete_cpu_read;
+        map->cpu_write = mapper_discrete_cpu_write;
+        map->ppu_read = mapper_discrete_ppu_read;
+        map->ppu_write = mapper_discrete_ppu_write;
+#ifdef NES_MAPPER_CORES
+        map->cpu_clock = cpu6502_clock_discrete;
+#endif
         break;
     }
 
-    return &map;
+    ret = map->init ? map->init(map) : 0;
+    if (ret < 0) {
+        if (ret == -ENOTSUP) {
+            printf("Unsupported mapper %d\n", map->mapper_id);
+        } else {
+            printf("Failed to set up mapper %d: %s\n", map->mapper_id,
+                   strerror(-ret));
+        }
+        free(map);
+        return NULL;
+    }
+
+    mapper_reset(map);
+
+    return map;
+}
+
+void mapper_reset(struct mapper *map) {
+    struct nes_cartridge *cart = map->cartridge;
+
+    // Power-on mapping: the first 32KB of PRG (16KB carts are mirrored by
+    // the mask) and the first 8KB of CHR, and PRG-RAM left to the mapper.
+    // Mappers remap from there.
+    mapper_map_prg_32k(map, 0);
+    mapper_map_chr_8k(map, 0);
+    mapper_map_prg_ram(map, 0, 0);
+    map->arena->mirroring = cart->hdr->flags6.mirroring;
+    map->arena->irq = 0;
+
+    if (map->reset) {
+        map->reset(map);
+    }
+
+    // Only set once the PPU is connected
+    if (cart->chr_switched) {
+        cart->chr_switched(cart);
+    }
+    if (cart->mirroring_switched) {
+        cart->mirroring_switched(cart);
+    }
+}
+
+void *mapper_state_alloc(struct mapper *map, size_t size) {
+    if (size > sizeof(map->arena->mapper)) {
+        return NULL;
+    }
+
+    memset(map->arena->mapper, 0, size);
+    return map->arena->mapper;
+}
+
+void mapper_state_free(struct mapper *map) {
+    memset(map->arena->mapper, 0, sizeof(map->arena->mapper));
+    map->state = NULL;
+}
+
+void mapper_restore(struct mapper *map) {
+    if (map->restore) {
+        map->restore(map);
+    }
+}
+
+void mapper_destroy(struct mapper *map) {
+    if (map->destroy) {
+        map->destroy(map);
+    }
+    free(map);
 }
\ No newline at end of file
@@ -1,27 +1,109 @@
 #ifndef __MAPPER_H__
 #define __MAPPER_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "cartridge.h"
 
 struct mapper;
+struct nes_state;
+
+#define MAPPER_PRG_BANK_SIZE 0x2000 // 8KB, four banks at $8000-$FFFF
+#define MAPPER_CHR_BANK_SIZE 0x0400 // 1KB, eight banks at $0000-$1FFF
 
 typedef uint8_t (*fp_mapper_read)(struct mapper *map, uint16_t addr);
 typedef void (*fp_mapper_write)(struct mapper *map, uint16_t addr,
                                 uint8_t data);
+typedef void (*fp_mapper_scanline)(struct mapper *map);
+typedef int (*fp_mapper_init)(struct mapper *map);
+typedef void (*fp_mapper_reset)(struct mapper *map);
+typedef void (*fp_mapper_destroy)(struct mapper *map);
+typedef void (*fp_mapper_restore)(struct mapper *map);
+typedef void (*fp_mapper_cpu_clock)(void);
 
 struct mapper {
     uint8_t mapper_id;
+    // Claim state (0, or -errno), set the power-on registers and bank
+    // tables, release anything init took. All optional.
+    fp_mapper_init init;
+    fp_mapper_reset reset;
+    fp_mapper_destroy destroy;
+    // Rebuild the bank tables from state, after a snapshot was loaded
+    fp_mapper_restore restore;
     fp_mapper_read cpu_read;
     fp_mapper_write cpu_write;
     fp_mapper_read ppu_read;
     fp_mapper_write ppu_write;
+    // Clocked on each rising edge of PPU A12 while rendering, NULL for
+    // mappers without a scanline counter
+    fp_mapper_scanline scanline;
+    // CPU core specialized for this mapper, NULL to use the generic one
+    fp_mapper_cpu_clock cpu_clock;
+    // Mapper-specific registers, this mapper's slice of the arena
+    void *state;
+    // The cartridge's machine state arena (nes_state.h), which also holds
+    // the mirroring and the IRQ line
+    struct nes_state *arena;
     struct nes_cartridge *cartridge;
     uint8_t num_prg_rom;
     uint8_t num_chr_rom;
+
+    // Banks currently mapped, recomputed only when a bank register changes.
+    // Reads are prg[(addr >> 13) & 3][addr & 0x1fff] and
+    // chr[addr >> 10][addr & 0x3ff].
+    uint8_t *prg[4];
+    uint8_t *chr[8];
+
+    // Work RAM at $6000-$7FFF, the first 8KB of the cartridge's PRG-RAM
+    uint8_t *prg_ram;
+
+    // prg_ram where the CPU may read or write it without asking the mapper,
+    // NULL otherwise. Set through mapper_map_prg_ram().
+    uint8_t *prg_ram_read;
+    uint8_t *prg_ram_write;
+
+    // Bank counts in 8KB / 1KB units, and the power-of-two masks that wrap
+    // bank numbers into them
+    uint16_t prg_banks;
+    uint16_t prg_mask;
+    uint16_t chr_banks;
+    uint16_t chr_mask;
 };
 
+// Create the mapper for a cartridge, in its power-on state. Returns NULL if
+// the mapper is not supported.
 struct mapper *mapper_init(struct nes_cartridge *cartridge);
 
+// Back to the power-on banks and registers
+void mapper_reset(struct mapper *map);
+
+void mapper_destroy(struct mapper *map);
+
+// Room for size bytes of mapper registers in the cartridge's arena, for the
+// init hooks. Returns NULL if they do not fit.
+void *mapper_state_alloc(struct mapper *map, size_t size);
+
+// Give the room back, clearing it, as a destroy hook
+void mapper_state_free(struct mapper *map);
+
+// Rebuild the bank tables after a snapshot was loaded into the arena
+void mapper_restore(struct mapper *map);
+
+// Map PRG-ROM bank `bank`, counted in units of the given size, at the 8KB
+// slot(s) starting at `slot`
+void mapper_map_prg_8k(struct mapper *map, uint8_t slot, uint16_t bank);
+void mapper_map_prg_16k(struct mapper *map, uint8_t slot, uint16_t bank);
+void mapper_map_prg_32k(struct mapper *map, uint16_t bank);
+
+// Expose PRG-RAM at $6000-$7FFF for plain reads and/or writes. Accesses
+// that are not enabled go to the mapper's cpu_read/cpu_write.
+void mapper_map_prg_ram(struct mapper *map, uint8_t readable,
+                        uint8_t writable);
+
+// Same for CHR, in 1KB slots
+void mapper_map_chr_1k(struct mapper *map, uint8_t slot, uint16_t bank);
+void mapper_map_chr_4k(struct mapper *map, uint8_t slot, uint16_t bank);
+void mapper_map_chr_8k(struct mapper *map, uint16_t bank);
+
 #endif /* __MAPPER_H__ */
\ No newline at end of file
@@ -1,12 +1,24 @@
 #include "mapper_000.h"
 #include <stdio.h>
 
+void mapper_000_reset(struct mapper *map) {
+    // Work RAM, when the board has it, is always enabled
+    mapper_map_prg_ram(map, 1, 1);
+}
+
 uint8_t mapper_000_cpu_read(struct mapper *map, uint16_t addr) {
     // If one bank, the memory at 0x8000 is mirrored at 0xc000
-    // otherwise its fully mapped at 0x8000
-    uint16_t map_addr = addr & ((map->num_prg_rom > 1) ? 0x7fff : 0x3fff);
-    uint8_t data = map->cartridge->prg_rom[map_addr];
-    return data;
+    // otherwise its fully mapped at 0x8000. The bank table set up by
+    // mapper_init() already does both.
+    if (addr >= 0x8000) {
+        return map->prg[(addr >> 13) & 0x03][addr & 0x1fff];
+    }
+
+    // Work RAM (Family BASIC), open bus below it
+    if (addr >= 0x6000) {
+        return map->prg_ram[addr & 0x1fff];
+    }
+    return 0;
 }
 
 void mapper_000_cpu_write(struct mapper *map, uint16_t addr, uint8_t data) {
@@ -14,20 +26,14 @@ void mapper_000_cpu_write(struct mapper *map, uint16_t addr, uint8_t data) {
     // On real NES hardware, writes to $8000-$FFFF are ignored (ROM is read-only)
     // Some test ROMs write to ROM addresses to verify CPU instruction behavior
     // Attempting to write to mmap'd ROM causes SIGSEGV, so we ignore these writes
-    (void)map;
-    (void)addr;
-    (void)data;
+    if (addr >= 0x6000 && addr < 0x8000) {
+        map->prg_ram[addr & 0x1fff] = data;
+    }
     return;
 }
 
 uint8_t mapper_000_ppu_read(struct mapper *map, uint16_t addr) {
-    uint8_t data = 0;
-
-    if (map->cartridge->chr_rom) {
-        data = map->cartridge->chr_rom[addr];
-    }
-
-    return data;
+    return map->chr[(addr >> 10) & 0x07][addr & 0x03ff];
 }
 
 void mapper_000_ppu_write(struct mapper *map, uint16_t addr, uint8_t data) {
@@ -43,9 +49,7 @@ void mapper_000_ppu_write(struct mapper *map, uint16_t addr, uint8_t data) {
         return;
     }
 
-    // This is CHR-RAM, allow writes with bounds checking
-    if (map->cartridge->chr_rom && addr < map->cartridge->chr_rom_len) {
-        map->cartridge->chr_rom[addr] = data;
-    }
+    // This is CHR-RAM, allow writes
+    map->chr[(addr >> 10) & 0x07][addr & 0x03ff] = data;
     return;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "mapper_001.h"
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // MMC1 (Mapper 1) Internal State
@@ -20,175 +22,155 @@ struct mmc1_state {
     uint8_t chr_mode;        // 0=8KB mode, 1=4KB mode
 };
 
-// Global MMC1 state (one per mapper instance)
-// TODO: This should be stored in the mapper struct itself
-static struct mmc1_state mmc1 = {0};
+// Update cached values from control register
+static void mmc1_update_control(struct mmc1_state *mmc1) {
+    mmc1->mirroring = mmc1->control & 0x03;
+    mmc1->prg_mode = (mmc1->control >> 2) & 0x03;
+    mmc1->chr_mode = (mmc1->control >> 4) & 0x01;
+}
 
-// Initialize MMC1 state
-static void mmc1_init(void) {
-    memset(&mmc1, 0, sizeof(struct mmc1_state));
-    // Power-up state: control register starts at 0x0C
-    // (PRG mode 3: fix last bank, CHR mode 0: 8KB)
-    mmc1.control = 0x0C;
-    mmc1.prg_mode = 3;
-    mmc1.chr_mode = 0;
-    mmc1.mirroring = 0;
+// Recompute the bank tables from the registers
+static void mmc1_update_banks(struct mapper *map) {
+    struct mmc1_state *mmc1 = map->state;
+    uint8_t prg_bank = mmc1->prg_bank & 0x0F;
+
+    switch (mmc1->prg_mode) {
+    case 0:
+    case 1:
+        // 32KB mode: Ignore low bit of PRG bank
+        mapper_map_prg_32k(map, prg_bank >> 1);
+        break;
+    case 2:
+        // Fix first bank at $8000, switch second bank at $C000
+        mapper_map_prg_16k(map, 0, 0);
+        mapper_map_prg_16k(map, 2, prg_bank);
+        break;
+    default:
+        // Switch first bank at $8000, fix last bank at $C000
+        mapper_map_prg_16k(map, 0, prg_bank);
+        mapper_map_prg_16k(map, 2, map->num_prg_rom - 1);
+        break;
+    }
+
+    if (map->num_chr_rom == 0 || map->cartridge->chr_ram_allocated) {
+        // CHR-RAM: Direct addressing, no banking
+        mapper_map_chr_8k(map, 0);
+    } else if (mmc1->chr_mode == 0) {
+        // 8KB mode: Ignore low bit of CHR bank 0
+        mapper_map_chr_8k(map, (mmc1->chr_bank_0 & 0x1F) >> 1);
+    } else {
+        // 4KB mode: Two separate 4KB banks
+        mapper_map_chr_4k(map, 0, mmc1->chr_bank_0 & 0x1F);
+        mapper_map_chr_4k(map, 4, mmc1->chr_bank_1 & 0x1F);
+    }
 }
 
-// Update cached values from control register
-static void mmc1_update_control(void) {
-    mmc1.mirroring = mmc1.control & 0x03;
-    mmc1.prg_mode = (mmc1.control >> 2) & 0x03;
-    mmc1.chr_mode = (mmc1.control >> 4) & 0x01;
+// Let the PPU know the CHR banks it sees have changed
+static void mmc1_chr_switched(struct mapper *map) {
+    if (map->cartridge->chr_switched) {
+        map->cartridge->chr_switched(map->cartridge);
+    }
 }
 
 // Handle serial write to MMC1
 static void mmc1_write_register(struct mapper *map, uint16_t addr, uint8_t data) {
+    struct mmc1_state *mmc1 = map->state;
+
     // Check for reset (bit 7 set)
     if (data & 0x80) {
-        mmc1.shift_register = 0;
-        mmc1.write_count = 0;
-        mmc1.control |= 0x0C;  // Set to mode 3 (fix last bank)
-        mmc1_update_control();
+        mmc1->shift_register = 0;
+        mmc1->write_count = 0;
+        mmc1->control |= 0x0C;  // Set to mode 3 (fix last bank)
+        mmc1_update_control(mmc1);
+        mmc1_update_banks(map);
         return;
     }
 
     // Shift in bit 0
-    mmc1.shift_register = (mmc1.shift_register >> 1) | ((data & 0x01) << 4);
-    mmc1.write_count++;
+    mmc1->shift_register = (mmc1->shift_register >> 1) | ((data & 0x01) << 4);
+    mmc1->write_count++;
 
     // After 5 writes, update the target register
-    if (mmc1.write_count == 5) {
-        uint8_t register_value = mmc1.shift_register;
+    if (mmc1->write_count == 5) {
+        uint8_t register_value = mmc1->shift_register;
 
         // Determine which register to update based on address
         if (addr >= 0x8000 && addr <= 0x9FFF) {
             // Control register
-            mmc1.control = register_value;
-            mmc1_update_control();
+            mmc1->control = register_value;
+            mmc1_update_control(mmc1);
+            mmc1_update_banks(map);
+            mmc1_chr_switched(map);
         } else if (addr >= 0xA000 && addr <= 0xBFFF) {
             // CHR bank 0
-            mmc1.chr_bank_0 = register_value;
+            mmc1->chr_bank_0 = register_value;
+            mmc1_update_banks(map);
+            mmc1_chr_switched(map);
         } else if (addr >= 0xC000 && addr <= 0xDFFF) {
             // CHR bank 1
-            mmc1.chr_bank_1 = register_value;
+            mmc1->chr_bank_1 = register_value;
+            mmc1_update_banks(map);
+            mmc1_chr_switched(map);
         } else if (addr >= 0xE000 && addr <= 0xFFFF) {
             // PRG bank
-            mmc1.prg_bank = register_value;
+            mmc1->prg_bank = register_value;
+            mmc1_update_banks(map);
         }
 
         // Reset shift register
-        mmc1.shift_register = 0;
-        mmc1.write_count = 0;
+        mmc1->shift_register = 0;
+        mmc1->write_count = 0;
     }
 }
 
-uint8_t mapper_001_cpu_read(struct mapper *map, uint16_t addr) {
-    // PRG-ROM is mapped to $8000-$FFFF (32KB window)
-    // Depending on PRG mode, different banks are selected
-
-    uint32_t prg_rom_offset = 0;
-    uint8_t num_banks = map->num_prg_rom;  // Each bank is 16KB
-
-    if (mmc1.prg_mode == 0 || mmc1.prg_mode == 1) {
-        // 32KB mode: Ignore low bit of PRG bank, map $8000-$FFFF to consecutive 16KB banks
-        uint8_t bank = (mmc1.prg_bank >> 1) & 0x0F;
-        bank = bank % num_banks;  // Wrap if exceeds available banks
-        prg_rom_offset = (bank * 0x4000) + (addr & 0x7FFF);
-    } else if (mmc1.prg_mode == 2) {
-        // Fix first bank at $8000, switch second bank at $C000
-        if (addr >= 0x8000 && addr <= 0xBFFF) {
-            // First 16KB: bank 0
-            prg_rom_offset = (addr & 0x3FFF);
-        } else {
-            // Second 16KB: switchable
-            uint8_t bank = mmc1.prg_bank & 0x0F;
-            bank = bank % num_banks;
-            prg_rom_offset = (bank * 0x4000) + (addr & 0x3FFF);
-        }
-    } else {  // mode 3
-        // Switch first bank at $8000, fix last bank at $C000
-        if (addr >= 0x8000 && addr <= 0xBFFF) {
-            // First 16KB: switchable
-            uint8_t bank = mmc1.prg_bank & 0x0F;
-            bank = bank % num_banks;
-            prg_rom_offset = (bank * 0x4000) + (addr & 0x3FFF);
-        } else {
-            // Second 16KB: last bank
-            prg_rom_offset = ((num_banks - 1) * 0x4000) + (addr & 0x3FFF);
-        }
+int mapper_001_init(struct mapper *map) {
+    map->state = mapper_state_alloc(map, sizeof(struct mmc1_state));
+    if (!map->state) {
+        return -ENOSPC;
     }
-
-    return map->cartridge->prg_rom[prg_rom_offset];
+    return 0;
 }
 
-void mapper_001_cpu_write(struct mapper *map, uint16_t addr, uint8_t data) {
-    // CPU writes to $8000-$FFFF go to MMC1 registers (serial write interface)
-    if (addr >= 0x8000) {
-        // Initialize MMC1 state on first write
-        static int initialized = 0;
-        if (!initialized) {
-            mmc1_init();
-            initialized = 1;
-        }
+void mapper_001_reset(struct mapper *map) {
+    struct mmc1_state *mmc1 = map->state;
 
-        mmc1_write_register(map, addr, data);
-    }
+    memset(mmc1, 0, sizeof(struct mmc1_state));
+    // Power-up state: control register starts at 0x0C
+    // (PRG mode 3: fix last bank, CHR mode 0: 8KB)
+    mmc1->control = 0x0C;
+    mmc1_update_control(mmc1);
+    mmc1_update_banks(map);
+    mapper_map_prg_ram(map, 1, 1);
 }
 
-uint8_t mapper_001_ppu_read(struct mapper *map, uint16_t addr) {
-    // CHR-ROM/RAM is mapped to $0000-$1FFF (8KB window)
-    // Depending on CHR mode, different banks are selected
+void mapper_001_restore(struct mapper *map) { mmc1_update_banks(map); }
 
-    if (!map->cartridge->chr_rom) {
-        return 0;  // No CHR-ROM/RAM
+uint8_t mapper_001_cpu_read(struct mapper *map, uint16_t addr) {
+    // Work RAM at $6000-$7FFF
+    if (addr < 0x8000) {
+        return addr >= 0x6000 ? map->prg_ram[addr & 0x1FFF] : 0;
     }
 
-    // For CHR-RAM (when chr_rom_size=0), treat as single 8KB bank
-    // For CHR-ROM, use banking as normal
-    uint32_t chr_rom_offset = 0;
+    // PRG-ROM is mapped to $8000-$FFFF (32KB window), in the banks selected
+    // by the last register writes
+    return map->prg[(addr >> 13) & 0x03][addr & 0x1FFF];
+}
 
-    // If this is CHR-RAM (no ROM banks), ignore banking and use direct addressing
-    if (map->num_chr_rom == 0 || map->cartridge->chr_ram_allocated) {
-        // CHR-RAM: Direct addressing, no banking
-        chr_rom_offset = addr & 0x1FFF;
-    } else {
-        // CHR-ROM: Use MMC1 banking
-        uint8_t num_banks = map->num_chr_rom;  // Each bank is 4KB
-
-        if (mmc1.chr_mode == 0) {
-            // 8KB mode: Ignore low bit of CHR bank 0, map $0000-$1FFF to consecutive 4KB banks
-            uint8_t bank = (mmc1.chr_bank_0 >> 1) & 0x1F;
-            if (num_banks > 0) {
-                bank = bank % (num_banks * 2);  // *2 because we're treating as 4KB banks
-            }
-            chr_rom_offset = (bank * 0x1000) + (addr & 0x1FFF);
-        } else {
-            // 4KB mode: Two separate 4KB banks
-            if (addr >= 0x0000 && addr <= 0x0FFF) {
-                // First 4KB: CHR bank 0
-                uint8_t bank = mmc1.chr_bank_0 & 0x1F;
-                if (num_banks > 0) {
-                    bank = bank % (num_banks * 2);
-                }
-                chr_rom_offset = (bank * 0x1000) + (addr & 0x0FFF);
-            } else {
-                // Second 4KB: CHR bank 1
-                uint8_t bank = mmc1.chr_bank_1 & 0x1F;
-                if (num_banks > 0) {
-                    bank = bank % (num_banks * 2);
-                }
-                chr_rom_offset = (bank * 0x1000) + (addr & 0x0FFF);
-            }
-        }
+void mapper_001_cpu_write(struct mapper *map, uint16_t addr, uint8_t data) {
+    if (addr >= 0x6000 && addr < 0x8000) {
+        map->prg_ram[addr & 0x1FFF] = data;
+        return;
     }
 
-    // Bounds check
-    if (chr_rom_offset < map->cartridge->chr_rom_len) {
-        return map->cartridge->chr_rom[chr_rom_offset];
+    // CPU writes to $8000-$FFFF go to MMC1 registers (serial write interface)
+    if (addr >= 0x8000) {
+        mmc1_write_register(map, addr, data);
     }
+}
 
-    return 0;
+uint8_t mapper_001_ppu_read(struct mapper *map, uint16_t addr) {
+    // CHR-ROM/RAM is mapped to $0000-$1FFF (8KB window)
+    return map->chr[(addr >> 10) & 0x07][addr & 0x03FF];
 }
 
 void mapper_001_ppu_write(struct mapper *map, uint16_t addr, uint8_t data) {
@@ -202,41 +184,5 @@ void mapper_001_ppu_write(struct mapper *map, uint16_t addr, uint8_t data) {
         return;  // CHR-ROM is read-only
     }
 
-    // For CHR-RAM, use same logic as read
-    uint32_t chr_rom_offset = 0;
-
-    // CHR-RAM: Direct addressing (no banking)
-    if (map->num_chr_rom == 0 || map->cartridge->chr_ram_allocated) {
-        chr_rom_offset = addr & 0x1FFF;
-    } else {
-        // CHR-ROM with banking (shouldn't write here, but handle it anyway)
-        uint8_t num_banks = map->num_chr_rom;
-
-        if (mmc1.chr_mode == 0) {
-            uint8_t bank = (mmc1.chr_bank_0 >> 1) & 0x1F;
-            if (num_banks > 0) {
-                bank = bank % (num_banks * 2);
-            }
-            chr_rom_offset = (bank * 0x1000) + (addr & 0x1FFF);
-        } else {
-            if (addr >= 0x0000 && addr <= 0x0FFF) {
-                uint8_t bank = mmc1.chr_bank_0 & 0x1F;
-                if (num_banks > 0) {
-                    bank = bank % (num_banks * 2);
-                }
-                chr_rom_offset = (bank * 0x1000) + (addr & 0x0FFF);
-            } else {
-                uint8_t bank = mmc1.chr_bank_1 & 0x1F;
-                if (num_banks > 0) {
-                    bank = bank % (num_banks * 2);
-                }
-                chr_rom_offset = (bank * 0x1000) + (addr & 0x0FFF);
-            }
-        }
-    }
-
-    // Bounds check and write
-    if (map->cartridge->chr_rom && chr_rom_offset < map->cartridge->chr_rom_len) {
-        map->cartridge->chr_rom[chr_rom_offset] = data;
-    }
+    map->chr[(addr >> 10) & 0x07][addr & 0x03FF] = data;
 }
\ No newline at end of file
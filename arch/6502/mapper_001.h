@@ -5,6 +5,12 @@
 
 #include "mapper.h"
 
+int mapper_001_init(struct mapper *map);
+
+void mapper_001_reset(struct mapper *map);
+
+void mapper_001_restore(struct mapper *map);
+
 uint8_t mapper_001_cpu_read(struct mapper *map, uint16_t addr);
 
 void mapper_001_cpu_write(struct mapper *map, uint16_t addr, uint8_t data);
@@ -0,0 +1,209 @@
+#include "mapper_004.h"
+#include "nes_state.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MMC3 (Mapper 4) Internal State
+// Eight bank registers selected through $8000, mirroring and PRG-RAM
+// control at $A000, and a scanline counter raising IRQs at $C000-$FFFF.
+struct mmc3_state {
+    uint8_t bank_select;     // $8000: target register, PRG and CHR modes
+    uint8_t regs[8];         // R0-R1: 2KB CHR, R2-R5: 1KB CHR, R6-R7: 8KB PRG
+    uint8_t prg_ram_protect; // $A001: bit 7 enable, bit 6 deny writes
+
+    // Scanline counter
+    uint8_t irq_latch;   // $C000: value the counter reloads from
+    uint8_t irq_counter;
+    uint8_t irq_reload;  // $C001: reload on the next clock
+    uint8_t irq_enabled; // $E000 disables (and acknowledges), $E001 enables
+};
+
+#define MMC3_PRG_MODE 0x40 // $C000 switchable, $8000 fixed to second-last
+#define MMC3_CHR_MODE 0x80 // 1KB banks at $0000, 2KB banks at $1000
+
+// Recompute the bank tables from the registers
+static void mmc3_update_banks(struct mapper *map) {
+    struct mmc3_state *mmc3 = map->state;
+    uint16_t second_last = map->prg_banks - 2;
+    uint8_t chr_2k = (mmc3->bank_select & MMC3_CHR_MODE) ? 4 : 0;
+    uint8_t chr_1k = chr_2k ^ 4;
+
+    if (mmc3->bank_select & MMC3_PRG_MODE) {
+        mapper_map_prg_8k(map, 0, second_last);
+        mapper_map_prg_8k(map, 2, mmc3->regs[6] & 0x3F);
+    } else {
+        mapper_map_prg_8k(map, 0, mmc3->regs[6] & 0x3F);
+        mapper_map_prg_8k(map, 2, second_last);
+    }
+    mapper_map_prg_8k(map, 1, mmc3->regs[7] & 0x3F);
+    mapper_map_prg_8k(map, 3, map->prg_banks - 1);
+
+    // The 2KB banks ignore the low bit of their register
+    for (uint8_t i = 0; i < 2; i++) {
+        mapper_map_chr_1k(map, chr_2k + i * 2, mmc3->regs[i] & 0xFE);
+        mapper_map_chr_1k(map, chr_2k + i * 2 + 1, mmc3->regs[i] | 0x01);
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        mapper_map_chr_1k(map, chr_1k + i, mmc3->regs[2 + i]);
+    }
+}
+
+// Recompute the bank tables, telling the PPU if the CHR banks it sees moved
+static void mmc3_switch_banks(struct mapper *map) {
+    uint8_t *chr[8];
+
+    memcpy(chr, map->chr, sizeof(chr));
+    mmc3_update_banks(map);
+
+    if (memcmp(chr, map->chr, sizeof(chr)) && map->cartridge->chr_switched) {
+        map->cartridge->chr_switched(map->cartridge);
+    }
+}
+
+// PRG-RAM is readable while enabled and writable unless also protected
+static void mmc3_map_prg_ram(struct mapper *map) {
+    struct mmc3_state *mmc3 = map->state;
+
+    mapper_map_prg_ram(map, mmc3->prg_ram_protect & 0x80,
+                       (mmc3->prg_ram_protect & 0xC0) == 0x80);
+}
+
+static void mmc3_set_mirroring(struct mapper *map, uint8_t data) {
+    struct nes_cartridge *cart = map->cartridge;
+    uint8_t mirroring =
+        (data & 0x01) ? NES_MIRROR_HORIZONTAL : NES_MIRROR_VERTICAL;
+
+    if (mirroring == map->arena->mirroring) {
+        return;
+    }
+
+    map->arena->mirroring = mirroring;
+    if (cart->mirroring_switched) {
+        cart->mirroring_switched(cart);
+    }
+}
+
+int mapper_004_init(struct mapper *map) {
+    map->state = mapper_state_alloc(map, sizeof(struct mmc3_state));
+    if (!map->state) {
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+void mapper_004_reset(struct mapper *map) {
+    // Power-up state: registers are undefined on hardware; these give
+    // distinct banks and PRG-RAM enabled, which is what games expect
+    static const uint8_t regs[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+    struct mmc3_state *mmc3 = map->state;
+
+    memset(mmc3, 0, sizeof(struct mmc3_state));
+    memcpy(mmc3->regs, regs, sizeof(mmc3->regs));
+    mmc3->prg_ram_protect = 0x80;
+
+    mmc3_update_banks(map);
+    mmc3_map_prg_ram(map);
+}
+
+void mapper_004_restore(struct mapper *map) {
+    mmc3_update_banks(map);
+    mmc3_map_prg_ram(map);
+}
+
+uint8_t mapper_004_cpu_read(struct mapper *map, uint16_t addr) {
+    struct mmc3_state *mmc3 = map->state;
+
+    if (addr >= 0x8000) {
+        return map->prg[(addr >> 13) & 0x03][addr & 0x1FFF];
+    }
+
+    if (addr >= 0x6000 && (mmc3->prg_ram_protect & 0x80)) {
+        return map->prg_ram[addr & 0x1FFF];
+    }
+
+    return 0; // Open bus
+}
+
+void mapper_004_cpu_write(struct mapper *map, uint16_t addr, uint8_t data) {
+    struct mmc3_state *mmc3 = map->state;
+
+    if (addr < 0x6000) {
+        return;
+    }
+
+    if (addr < 0x8000) {
+        // PRG-RAM, unless disabled or write protected
+        if ((mmc3->prg_ram_protect & 0xC0) == 0x80) {
+            map->prg_ram[addr & 0x1FFF] = data;
+        }
+        return;
+    }
+
+    // Registers are decoded from A14-A13 and A0
+    switch (addr & 0xE001) {
+    case 0x8000:
+        mmc3->bank_select = data;
+        mmc3_switch_banks(map);
+        break;
+    case 0x8001:
+        mmc3->regs[mmc3->bank_select & 0x07] = data;
+        mmc3_switch_banks(map);
+        break;
+    case 0xA000:
+        // Four-screen boards have their own nametable wiring
+        if (!map->cartridge->hdr->flags6.ignore_mirroring) {
+            mmc3_set_mirroring(map, data);
+        }
+        break;
+    case 0xA001:
+        mmc3->prg_ram_protect = data;
+        mmc3_map_prg_ram(map);
+        break;
+    case 0xC000:
+        mmc3->irq_latch = data;
+        break;
+    case 0xC001:
+        mmc3->irq_counter = 0;
+        mmc3->irq_reload = 1;
+        break;
+    case 0xE000:
+        // Disabling also acknowledges a pending IRQ
+        mmc3->irq_enabled = 0;
+        map->arena->irq = 0;
+        break;
+    case 0xE001:
+        mmc3->irq_enabled = 1;
+        break;
+    }
+}
+
+uint8_t mapper_004_ppu_read(struct mapper *map, uint16_t addr) {
+    return map->chr[(addr >> 10) & 0x07][addr & 0x03FF];
+}
+
+void mapper_004_ppu_write(struct mapper *map, uint16_t addr, uint8_t data) {
+    // Only write if CHR-RAM was allocated (not ROM)
+    if (!map->cartridge->chr_ram_allocated) {
+        return;
+    }
+
+    map->chr[(addr >> 10) & 0x07][addr & 0x03FF] = data;
+}
+
+void mapper_004_scanline(struct mapper *map) {
+    struct mmc3_state *mmc3 = map->state;
+
+    if (mmc3->irq_counter == 0 || mmc3->irq_reload) {
+        mmc3->irq_counter = mmc3->irq_latch;
+        mmc3->irq_reload = 0;
+    } else {
+        mmc3->irq_counter--;
+    }
+
+    // The IRQ line stays asserted until $E000 acknowledges it
+    if (mmc3->irq_counter == 0 && mmc3->irq_enabled) {
+        map->arena->irq = 1;
+    }
+}
\ No newline at end of file
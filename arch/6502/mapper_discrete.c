@@ -0,0 +1,213 @@
+#include "mapper_discrete.h"
+#include "nes_state.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// PRG window switched by the latch
+enum discrete_prg {
+    DISCRETE_PRG_FIXED, // 32KB, never switched
+    DISCRETE_PRG_16K,   // 16KB at $8000, last bank fixed at $C000
+    DISCRETE_PRG_32K,   // 32KB at $8000
+};
+
+struct discrete_board {
+    uint8_t mapper_id;
+    const char *name;
+
+    // The latch is written when (addr & reg_mask) == reg_match
+    uint16_t reg_mask;
+    uint16_t reg_match;
+
+    // Bank number = (latch >> shift) & mask
+    uint8_t prg_window;
+    uint8_t prg_shift;
+    uint8_t prg_mask;
+    uint8_t chr_shift;
+    uint8_t chr_mask; // 8KB banks, 0 if CHR is not switched
+
+    // Latch bit choosing the upper single-screen nametable, 0 if the header
+    // mirroring is hardwired
+    uint8_t mirroring_mask;
+
+    // The ROM drives the data bus during the write, so the latch sees the
+    // written value ANDed with the ROM byte at that address
+    uint8_t bus_conflicts;
+};
+
+static const struct discrete_board boards[] = {
+    {
+        .mapper_id = 2,
+        .name = "UxROM",
+        .reg_mask = 0x8000,
+        .reg_match = 0x8000,
+        .prg_window = DISCRETE_PRG_16K,
+        .prg_mask = 0x0f,
+        .bus_conflicts = 1,
+    },
+    {
+        .mapper_id = 3,
+        .name = "CNROM",
+        .reg_mask = 0x8000,
+        .reg_match = 0x8000,
+        .prg_window = DISCRETE_PRG_FIXED,
+        .chr_mask = 0x03,
+        .bus_conflicts = 1,
+    },
+    {
+        .mapper_id = 7,
+        .name = "AxROM",
+        .reg_mask = 0x8000,
+        .reg_match = 0x8000,
+        .prg_window = DISCRETE_PRG_32K,
+        .prg_mask = 0x07,
+        .mirroring_mask = 0x10,
+    },
+    {
+        .mapper_id = 11,
+        .name = "Color Dreams",
+        .reg_mask = 0x8000,
+        .reg_match = 0x8000,
+        .prg_window = DISCRETE_PRG_32K,
+        .prg_mask = 0x03,
+        .chr_shift = 4,
+        .chr_mask = 0x0f,
+        .bus_conflicts = 1,
+    },
+    {
+        .mapper_id = 66,
+        .name = "GxROM",
+        .reg_mask = 0x8000,
+        .reg_match = 0x8000,
+        .prg_window = DISCRETE_PRG_32K,
+        .prg_shift = 4,
+        .prg_mask = 0x03,
+        .chr_mask = 0x03,
+        .bus_conflicts = 1,
+    },
+};
+
+struct discrete_state {
+    uint8_t board; // Index in boards[]
+    uint8_t latch;
+};
+
+// Point the bank tables at whatever the latch selects
+static void discrete_update_banks(struct mapper *map) {
+    struct discrete_state *discrete = map->state;
+    const struct discrete_board *board = &boards[discrete->board];
+    uint8_t prg = (discrete->latch >> board->prg_shift) & board->prg_mask;
+    uint8_t chr = (discrete->latch >> board->chr_shift) & board->chr_mask;
+
+    switch (board->prg_window) {
+    case DISCRETE_PRG_16K:
+        mapper_map_prg_16k(map, 0, prg);
+        mapper_map_prg_16k(map, 2, map->prg_banks / 2 - 1);
+        break;
+    case DISCRETE_PRG_32K:
+        mapper_map_prg_32k(map, prg);
+        break;
+    }
+
+    if (board->chr_mask) {
+        mapper_map_chr_8k(map, chr);
+    }
+
+    if (board->mirroring_mask) {
+        map->arena->mirroring = (discrete->latch & board->mirroring_mask)
+                                  ? NES_MIRROR_SINGLE_UPPER
+                                  : NES_MIRROR_SINGLE_LOWER;
+    }
+}
+
+int mapper_discrete_init(struct mapper *map) {
+    struct discrete_state *discrete;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(boards) / sizeof(boards[0]); i++) {
+        if (boards[i].mapper_id == map->mapper_id) {
+            break;
+        }
+    }
+
+    if (i == sizeof(boards) / sizeof(boards[0])) {
+        return -ENOTSUP;
+    }
+
+    discrete = mapper_state_alloc(map, sizeof(struct discrete_state));
+    if (!discrete) {
+        return -ENOSPC;
+    }
+
+    printf("Mapper %d: %s\n", map->mapper_id, boards[i].name);
+
+    discrete->board = i;
+    map->state = discrete;
+    return 0;
+}
+
+void mapper_discrete_reset(struct mapper *map) {
+    struct discrete_state *discrete = map->state;
+
+    discrete->latch = 0;
+    discrete_update_banks(map);
+}
+
+void mapper_discrete_restore(struct mapper *map) {
+    discrete_update_banks(map);
+}
+
+uint8_t mapper_discrete_cpu_read(struct mapper *map, uint16_t addr) {
+    // No PRG-RAM on these boards, open bus below the ROM
+    if (addr < 0x8000) {
+        return 0;
+    }
+    return map->prg[(addr >> 13) & 0x03][addr & 0x1fff];
+}
+
+void mapper_discrete_cpu_write(struct mapper *map, uint16_t addr,
+                               uint8_t data) {
+    struct discrete_state *discrete = map->state;
+    const struct discrete_board *board = &boards[discrete->board];
+    struct nes_cartridge *cart = map->cartridge;
+    uint8_t *chr = map->chr[0];
+    uint8_t mirroring = map->arena->mirroring;
+
+    if ((addr & board->reg_mask) != board->reg_match) {
+        return;
+    }
+
+    if (board->bus_conflicts) {
+        data &= map->prg[(addr >> 13) & 0x03][addr & 0x1fff];
+    }
+
+    if (data == discrete->latch) {
+        return;
+    }
+
+    discrete->latch = data;
+    discrete_update_banks(map);
+
+    // Only a real change has to reach the renderer
+    if (map->chr[0] != chr && cart->chr_switched) {
+        cart->chr_switched(cart);
+    }
+    if (map->arena->mirroring != mirroring && cart->mirroring_switched) {
+        cart->mirroring_switched(cart);
+    }
+}
+
+uint8_t mapper_discrete_ppu_read(struct mapper *map, uint16_t addr) {
+    return map->chr[(addr >> 10) & 0x07][addr & 0x03ff];
+}
+
+void mapper_discrete_ppu_write(struct mapper *map, uint16_t addr,
+                               uint8_t data) {
+    // Only CHR-RAM boards can be written
+    if (!map->cartridge->chr_ram_allocated) {
+        return;
+    }
+
+    map->chr[(addr >> 10) & 0x07][addr & 0x03ff] = data;
+}
\ No newline at end of file
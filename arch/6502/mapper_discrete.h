@@ -0,0 +1,30 @@
+#ifndef __MAPPER_DISCRETE_H__
+#define __MAPPER_DISCRETE_H__
+
+#include <stdint.h>
+
+#include "mapper.h"
+
+// Boards built from discrete logic: a single latch written through
+// $8000-$FFFF whose bits pick the PRG bank, the CHR bank and, on some boards,
+// the mirroring. They only differ in which bits do what, so each one is a
+// descriptor run by one engine.
+
+// Select the board for map->mapper_id. Returns -ENOTSUP if there is none.
+int mapper_discrete_init(struct mapper *map);
+
+void mapper_discrete_reset(struct mapper *map);
+
+void mapper_discrete_restore(struct mapper *map);
+
+uint8_t mapper_discrete_cpu_read(struct mapper *map, uint16_t addr);
+
+void mapper_discrete_cpu_write(struct mapper *map, uint16_t addr,
+                               uint8_t data);
+
+uint8_t mapper_discrete_ppu_read(struct mapper *map, uint16_t addr);
+
+void mapper_discrete_ppu_write(struct mapper *map, uint16_t addr,
+                               uint8_t data);
+
+#endif /* __MAPPER_DISCRETE_H__ */
\ No newline at end of file
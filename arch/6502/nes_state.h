@@ -0,0 +1,71 @@
+#ifndef __NES_STATE_H__
+#define __NES_STATE_H__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "2c02.h"
+#include "6502.h"
+#include "controller.h"
+
+// Machine state arena
+//
+// Every mutable piece of emulated state for the machine lives in this one
+// block: CPU and PPU registers, RAM, VRAM, OAM, controllers, CHR-RAM and
+// the mapper's registers. It holds no pointers, only values, so a snapshot
+// is a memcpy of the whole struct and restoring one is a memcpy back
+// followed by nesbus load_state() rebuilding what is derived from it (the
+// mapper bank tables and the renderer's copy of the PPU).
+//
+// The fields used on every instruction and PPU event come first and share
+// the first cache lines; the bulk memories follow.
+//
+// Not included: ROM, which never changes, and PRG-RAM, which stays with the
+// cartridge because it may be the mapped .sav file. nesbus save_state()
+// copies it after the arena, so a snapshot is state_size() bytes, not
+// NES_STATE_SIZE.
+//
+// Each machine has its own arena from nes_state_alloc(). A cartridge is
+// loaded into one, where its CHR-RAM and mapper registers go, and the bus
+// runs the CPU and PPU on one. Cloning a machine is a copy of its arena.
+
+#define NES_STATE_ALIGN 64
+
+#define NES_RAM_SIZE (2 * 1024)
+#define NES_CHR_RAM_SIZE (8 * 1024)
+
+// Room for the largest mapper's registers (see the mapper_*_init hooks)
+#define NES_MAPPER_STATE_SIZE 64
+
+struct nes_state {
+    // Hot
+    struct cpu6502_regs cpu_regs;
+    uint8_t irq; // Cartridge IRQ line, held by the mapper until acknowledged
+    struct ppu2c02_regs ppu_regs;
+    uint8_t ram[NES_RAM_SIZE] __attribute__((aligned(NES_STATE_ALIGN)));
+
+    // Cold
+    struct ppu2c02_mem ppu_mem;
+    struct controller controller[2];
+    uint8_t mirroring; // enum nes_mirroring, starts out from the header
+    uint8_t mapper[NES_MAPPER_STATE_SIZE] __attribute__((aligned(8)));
+    uint8_t chr_ram[NES_CHR_RAM_SIZE];
+} __attribute__((aligned(NES_STATE_ALIGN)));
+
+// The CPU and PPU registers share the first cache line
+static_assert(offsetof(struct nes_state, ram) == NES_STATE_ALIGN,
+              "Hot registers spill out of the first cache line");
+
+#define NES_STATE_SIZE sizeof(struct nes_state)
+
+// The arena the CPU, PPU and bus run on, set by nesbus_init()
+extern struct nes_state *nes_state;
+
+// A zeroed arena, or NULL
+struct nes_state *nes_state_alloc(void);
+
+// Free an arena once nothing runs on it and its cartridge is unloaded
+void nes_state_free(struct nes_state *state);
+
+#endif /* __NES_STATE_H__ */
\ No newline at end of file
@@ -5,80 +5,130 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "cheat.h"
+#include "host_timer.h"
+#include "logger.h"
 #include "nesbus.h"
+#include "probes.h"
+#include "nes_state.h"
 
 static struct nesbus bus = {0};
 
-// 2 kilobytes ram fir the NES
-#define NES_RAM_SIZE (2 * 1024)
+// Cheats patching reads, NULL while none are active
+static const struct cheat_table *cheats;
 
-static uint8_t ram[NES_RAM_SIZE] = {0};
+// The read side of each page before cheats. A page with an active patch is
+// taken out of bus.read_page and bus.io_read, so its reads all reach
+// cheat_read(), which gets the real data from here.
+static uint8_t *plain_read_page[NES_PAGES];
+static fp_read plain_io_read[NES_PAGES];
 
-// Controllers
-static struct controller ctrl1 = {0};
-static struct controller ctrl2 = {0};
+// CPU RAM, the controllers and everything else the machine changes
+struct nes_state *nes_state;
+
+struct nes_state *nes_state_alloc(void) {
+    struct nes_state *state = aligned_alloc(NES_STATE_ALIGN, NES_STATE_SIZE);
+
+    if (state) {
+        memset(state, 0, NES_STATE_SIZE);
+    }
+    return state;
+}
+
+void nes_state_free(struct nes_state *state) { free(state); }
 
 static uint8_t read(uint16_t addr) {
+    uint8_t *page = bus.read_page[addr >> NES_PAGE_SHIFT];
     uint8_t data;
 
-    if (addr < 0x800) {
-        data = ram[addr];
-    } else if ((addr >= 0x800) && (addr < 0x2000)) {
-        // mirroring
-        data = ram[addr & 0x7ff];
-    } else if ((addr >= 0x2000) && (addr < 0x3fff)) {
-        // So wrong but need to implement PPU later
-        data = bus.ppu->cpu_read(addr);
-    } else if (addr == 0x3fff) {
-        // ppu read
-    } else if (addr == 0x4016) {
+    if (page) {
+        return page[addr & (NES_PAGE_SIZE - 1)];
+    }
+    HOST_TIMER_ENTER(HOST_PHASE_BUS);
+    data = bus.io_read[addr >> NES_PAGE_SHIFT](addr);
+    HOST_TIMER_LEAVE();
+    return data;
+}
+
+static void write(uint16_t addr, uint8_t data) {
+    uint8_t *page = bus.write_page[addr >> NES_PAGE_SHIFT];
+
+    if (page) {
+        page[addr & (NES_PAGE_SIZE - 1)] = data;
+        return;
+    }
+    HOST_TIMER_ENTER(HOST_PHASE_BUS);
+    bus.io_write[addr >> NES_PAGE_SHIFT](addr, data);
+    HOST_TIMER_LEAVE();
+}
+
+// $2000-$3FFF: the eight PPU registers, mirrored
+static uint8_t ppu_io_read(uint16_t addr) { return bus.ppu->cpu_read(addr); }
+
+static void ppu_io_write(uint16_t addr, uint8_t data) {
+    bus.ppu->cpu_write(addr, data);
+}
+
+// Cartridge space, where the mapper decodes the access
+static uint8_t cart_read(uint16_t addr) {
+    uint8_t data;
+
+    HOST_TIMER_ENTER(HOST_PHASE_MAPPER);
+    data = bus.cart->cpu_read(bus.cart, addr);
+    HOST_TIMER_LEAVE();
+    return data;
+}
+
+static void cart_write(uint16_t addr, uint8_t data) {
+    HOST_TIMER_ENTER(HOST_PHASE_MAPPER);
+    bus.cart->cpu_write(bus.cart, addr, data);
+    HOST_TIMER_LEAVE();
+}
+
+// $4000-$40FF: APU and I/O registers, then cartridge space from $4018
+static uint8_t io_read(uint16_t addr) {
+    uint8_t data;
+
+    if (addr == 0x4016) {
         // Controller 1 read
-        data = controller_read(&ctrl1);
-        // printf("Controller 1 read: bit=0x%02X (buttons=0x%02X)\n", data,
-        // ctrl1.buttons);
+        data = controller_read(&nes_state->controller[0]);
+        LOG(LOG_INPUT, LOG_LEVEL_TRACE, "Controller 1 read: bit=0x%02X", data);
     } else if (addr == 0x4017) {
         // Controller 2 read
-        data = controller_read(&ctrl2);
+        data = controller_read(&nes_state->controller[1]);
     } else if ((addr >= 0x4000) && (addr <= 0x4015)) {
         // APU/other I/O read
         data = 0; // Open bus for now
     } else {
         // remainder of reads like cartridge and open bus?
-        data = bus.cart->cpu_read(bus.cart, addr);
+        data = cart_read(addr);
     }
 
     return data;
 }
 
-static void write(uint16_t addr, uint8_t data) {
-    if (addr < 0x800) {
-        ram[addr] = data;
-    } else if ((addr >= 0x800) && (addr < 0x2000)) {
-        // mirroring
-        ram[addr & 0x7ff] = data;
-    } else if ((addr >= 0x2000) && (addr < 0x3fff)) {
-        // So wrong but need to implement PPU later
-        bus.ppu->cpu_write(addr, data);
-    } else if (addr == 0x3fff) {
-        // ppu write
-        printf("PPU WRITE\n");
-    } else if (addr == 0x4014) {
+static void io_write(uint16_t addr, uint8_t data) {
+    if (addr == 0x4014) {
         // Sprite DMA: Copy 256 bytes from CPU RAM to PPU OAM
         // Data byte = page number (0x00-0xFF)
-        // Copies from $XX00-$XXFF to OAM
+        // Copies from $XX00-$XXFF to OAM through OAMDATA, as the hardware
+        // does, so the PPU sees every byte
         uint16_t src_addr = data << 8; // Page number -> start address
+
+        NES_PROBE1(oam__dma, data);
         for (int i = 0; i < 256; i++) {
-            bus.ppu->oam[i] = read(src_addr + i);
+            bus.ppu->cpu_write(OAMDATA, read(src_addr + i));
         }
         // Note: Real hardware takes 513-514 CPU cycles and halts CPU
         // We're not implementing cycle-accurate DMA timing yet
-        // printf("Sprite DMA: Copied 256 bytes from $%04X to OAM\n", src_addr);
+        LOG(LOG_BUS, LOG_LEVEL_DEBUG, "Sprite DMA: Copied 256 bytes from $%04X",
+            src_addr);
     } else if (addr == 0x4016) {
         // Controller strobe (writes to both controllers)
-        controller_write(&ctrl1, data);
-        controller_write(&ctrl2, data);
-        // printf("Controller strobe write: 0x%02X (buttons=0x%02X)\n", data,
-        // ctrl1.buttons);
+        controller_write(&nes_state->controller[0], data);
+        controller_write(&nes_state->controller[1], data);
+        LOG(LOG_INPUT, LOG_LEVEL_TRACE, "Controller strobe write: 0x%02X",
+            data);
     } else if ((addr >= 0x4000) && (addr <= 0x4015)) {
         // APU/other I/O write
         // Ignore for now
@@ -87,12 +137,107 @@ static void write(uint16_t addr, uint8_t data) {
         // Ignore for now
     } else {
         // remainder of reads like cartridge and open bus?
-        bus.cart->cpu_write(bus.cart, addr, data);
+        cart_write(addr, data);
+    }
+}
+
+static uint8_t cheat_read(uint16_t addr) {
+    uint8_t *page = plain_read_page[addr >> NES_PAGE_SHIFT];
+    uint8_t data;
+
+    if (page) {
+        data = page[addr & (NES_PAGE_SIZE - 1)];
+    } else {
+        data = plain_io_read[addr >> NES_PAGE_SHIFT](addr);
+    }
+    return cheat_apply(cheats, addr, data);
+}
+
+static void update_read_page(uint8_t page) {
+    if (cheats && cheat_page_active(cheats, page)) {
+        bus.read_page[page] = NULL;
+        bus.io_read[page] = cheat_read;
+    } else {
+        bus.read_page[page] = plain_read_page[page];
+        bus.io_read[page] = plain_io_read[page];
+    }
+}
+
+// Point count pages from first at read and write memory (NULL: use the
+// I/O handlers)
+static void map_pages(uint8_t first, uint16_t count, uint8_t *read_mem,
+                      uint8_t *write_mem) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t offset = i * NES_PAGE_SIZE;
+
+        plain_read_page[first + i] = read_mem ? read_mem + offset : NULL;
+        bus.write_page[first + i] = write_mem ? write_mem + offset : NULL;
+        update_read_page(first + i);
+    }
+}
+
+// The mapper moved the 8KB CPU window at addr
+static void prg_switched(struct nes_cartridge *cart, uint16_t addr) {
+    struct mapper *map = cart->map;
+    uint8_t first = addr >> NES_PAGE_SHIFT;
+    uint16_t count = MAPPER_PRG_BANK_SIZE / NES_PAGE_SIZE;
+
+    if (addr < 0x8000) {
+        map_pages(first, count, map->prg_ram_read, map->prg_ram_write);
+    } else {
+        // PRG-ROM writes are mapper registers
+        map_pages(first, count, map->prg[(addr >> 13) & 0x03], NULL);
+    }
+}
+
+static void connect_cartridge(struct nes_cartridge *cart) {
+    bus.cart = cart;
+
+    // Map the cartridge's current windows, then let the mapper keep them
+    // up to date
+    cart->prg_switched = prg_switched;
+    for (uint32_t addr = 0x6000; addr < 0x10000; addr += MAPPER_PRG_BANK_SIZE) {
+        prg_switched(cart, addr);
+    }
+
+    // Switch to the CPU core built for this cartridge's mapper, if any
+    if (cart->map->cpu_clock) {
+        bus.cpu->clock = cart->map->cpu_clock;
     }
-    return;
 }
 
-static void connect_cartridge(struct nes_cartridge *cart) { bus.cart = cart; }
+static void set_cheats(const struct cheat_table *table) {
+    cheats = table && table->count ? table : NULL;
+    for (uint16_t page = 0; page < NES_PAGES; page++) {
+        update_read_page(page);
+    }
+}
+
+static size_t state_size(void) {
+    return NES_STATE_SIZE + (bus.cart ? bus.cart->prg_ram_len : 0);
+}
+
+static void save_state(void *buf) {
+    memcpy(buf, nes_state, NES_STATE_SIZE);
+    if (bus.cart) {
+        memcpy((uint8_t *)buf + NES_STATE_SIZE, bus.cart->prg_ram,
+               bus.cart->prg_ram_len);
+    }
+}
+
+static void load_state(const void *buf) {
+    memcpy(nes_state, buf, NES_STATE_SIZE);
+    if (bus.cart) {
+        memcpy(bus.cart->prg_ram, (const uint8_t *)buf + NES_STATE_SIZE,
+               bus.cart->prg_ram_len);
+    }
+
+    // Everything outside the arena is derived from it
+    if (bus.cart) {
+        mapper_restore(bus.cart->map);
+    }
+    bus.ppu->restore();
+}
 
 static uint8_t *debug_read(uint16_t offset, uint8_t *buf, uint16_t len) {
     for (int i = 0; i < len; i++) {
@@ -101,11 +246,37 @@ static uint8_t *debug_read(uint16_t offset, uint8_t *buf, uint16_t len) {
     return buf;
 }
 
-struct nesbus *nesbus_init(struct cpu6502 *cpu, struct ppu2c02 *ppu) {
+struct nesbus *nesbus_init(struct cpu6502 *cpu, struct ppu2c02 *ppu,
+                           struct nes_state *state) {
+    nes_state = state;
+
     bus.read = read;
     bus.write = write;
     bus.connect_cartridge = connect_cartridge;
     bus.debug_read = debug_read;
+    bus.state_size = state_size;
+    bus.save_state = save_state;
+    bus.load_state = load_state;
+    bus.set_cheats = set_cheats;
+
+    // 2KB of RAM mirrored four times, the PPU registers every 8 bytes, the
+    // I/O page and, until a cartridge is connected, nothing else
+    for (uint16_t page = 0x20; page < NES_PAGES; page++) {
+        plain_io_read[page] = cart_read;
+        bus.io_write[page] = cart_write;
+    }
+    for (uint16_t page = 0x20; page < 0x40; page++) {
+        plain_io_read[page] = ppu_io_read;
+        bus.io_write[page] = ppu_io_write;
+    }
+    plain_io_read[0x40] = io_read;
+    bus.io_write[0x40] = io_write;
+    for (uint16_t page = 0; page < 0x20; page++) {
+        uint8_t *ram = &nes_state->ram[(page & 0x07) << NES_PAGE_SHIFT];
+
+        map_pages(page, 1, ram, ram);
+    }
+    map_pages(0x20, NES_PAGES - 0x20, NULL, NULL);
 
     bus.cpu = cpu;
     cpu->connect_bus(&bus);
@@ -114,10 +285,10 @@ struct nesbus *nesbus_init(struct cpu6502 *cpu, struct ppu2c02 *ppu) {
     ppu->connect_bus(&bus);
 
     // Initialize controllers
-    controller_init(&ctrl1);
-    controller_init(&ctrl2);
-    bus.controller1 = &ctrl1;
-    bus.controller2 = &ctrl2;
+    controller_init(&nes_state->controller[0]);
+    controller_init(&nes_state->controller[1]);
+    bus.controller1 = &nes_state->controller[0];
+    bus.controller2 = &nes_state->controller[1];
 
     return &bus;
 }
\ No newline at end of file
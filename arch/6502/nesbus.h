@@ -1,19 +1,31 @@
 #ifndef __NESBUS_H__
 #define __NESBUS_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "2c02.h"
 #include "6502.h"
 #include "cartridge.h"
+#include "cheat.h"
 #include "controller.h"
 
 struct nesbus;
+struct nes_state;
+
+// The CPU address space, in 256-byte pages
+#define NES_PAGE_SHIFT 8
+#define NES_PAGE_SIZE (1 << NES_PAGE_SHIFT)
+#define NES_PAGES 256
 
 typedef uint8_t (*fp_read)(uint16_t addr);
 typedef void (*fp_write)(uint16_t addr, uint8_t data);
 
 typedef uint8_t *(*fp_debug_read)(uint16_t offset, uint8_t *buf, uint16_t len);
+typedef size_t (*fp_state_size)(void);
+typedef void (*fp_save_state)(void *buf);
+typedef void (*fp_load_state)(const void *buf);
+typedef void (*fp_set_cheats)(const struct cheat_table *table);
 
 struct nesbus {
     fp_read read;
@@ -21,13 +33,38 @@ struct nesbus {
     fp_clock clock;
     fp_connect_cartridge connect_cartridge;
     fp_debug_read debug_read;
+    // Copy the machine state out to buf, and back in from buf: the arena,
+    // then the cartridge's PRG-RAM, battery-backed or not, so rolling back
+    // also rolls back the save. state_size() bytes, which change with the
+    // cartridge.
+    fp_state_size state_size;
+    fp_save_state save_state;
+    fp_load_state load_state;
+    // Patch CPU reads with table, which must outlive the bus, or stop
+    // patching with NULL. Call again after changing the table.
+    fp_set_cheats set_cheats;
     struct cpu6502 *cpu;
     struct ppu2c02 *ppu;
     struct nes_cartridge *cart;
     struct controller *controller1;
     struct controller *controller2;
+
+    // Host memory behind each CPU page, NULL where the access has side
+    // effects. The RAM mirrors and the PRG windows point at the memory they
+    // alias, so a plain access is page[addr >> 8][addr & 0xff] with no
+    // decoding. The mapper keeps the PRG pages current.
+    uint8_t *read_page[NES_PAGES];
+    uint8_t *write_page[NES_PAGES];
+
+    // Handlers for the pages that are NULL above: PPU and I/O registers,
+    // the cartridge, and the cheat lookup for pages with a patch
+    fp_read io_read[NES_PAGES];
+    fp_write io_write[NES_PAGES];
 };
 
-struct nesbus *nesbus_init();
+// Run cpu and ppu on the arena state, which the cartridge connected later
+// must have been loaded into
+struct nesbus *nesbus_init(struct cpu6502 *cpu, struct ppu2c02 *ppu,
+                           struct nes_state *state);
 
 #endif /* __NESBUS_H__ */
\ No newline at end of file
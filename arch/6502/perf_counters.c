@@ -0,0 +1,292 @@
+// Hardware performance counters per emulation phase
+
+#include <errno.h>
+#include <string.h>
+
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define PERF_DEPTH 4
+
+uint8_t perf_counters_enabled;
+
+static const char *phase_names[PERF_PHASE_COUNT] = {
+    "emulate",
+    "render",
+    "present",
+};
+
+static const char *counter_names[PERF_COUNTER_COUNT] = {
+    "instructions", "cycles",     "branch_misses",
+    "l1d_misses",   "llc_misses", "itlb_misses",
+};
+
+// What read() returns for one counter: the raw count, and how long it was
+// enabled and actually counting. Each only ever grows.
+struct perf_reading {
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+};
+
+static struct {
+    // One event per counter, each scheduled on its own so the kernel can
+    // multiplex them when the PMU has too few registers. -1 if unavailable.
+    int fd[PERF_COUNTER_COUNT];
+
+    // Raw readings at the last phase switch
+    struct perf_reading last[PERF_COUNTER_COUNT];
+
+    uint8_t stack[PERF_DEPTH];
+    uint8_t depth;
+
+    uint64_t frame[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+    uint64_t total[PERF_PHASE_COUNT][PERF_COUNTER_COUNT];
+    uint64_t frames;
+    uint64_t emulated_insns;
+
+    FILE *csv;
+} pc;
+
+#ifdef __linux__
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_ITLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+static int open_counter(enum perf_counter counter) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[counter].type;
+    attr.config = events[counter].config;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // This thread only, on whichever CPU it runs
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void read_counters(struct perf_reading *readings) {
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        if (pc.fd[c] < 0 ||
+            read(pc.fd[c], &readings[c], sizeof(readings[c])) !=
+                sizeof(readings[c])) {
+            // Keep the previous reading, so the interval counts nothing
+            readings[c] = pc.last[c];
+        }
+    }
+}
+
+int perf_counters_start(const char *csv_file) {
+    int opened = 0;
+    int err = 0;
+
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        pc.fd[c] = open_counter(c);
+        if (pc.fd[c] < 0) {
+            if (!err) {
+                err = errno;
+            }
+            printf("perf: no %s counter: %s\n", counter_names[c],
+                   strerror(errno));
+            continue;
+        }
+        opened++;
+    }
+    if (!opened) {
+        return -err;
+    }
+
+    if (csv_file) {
+        pc.csv = fopen(csv_file, "w");
+        if (!pc.csv) {
+            printf("Cannot write %s: %s\n", csv_file, strerror(errno));
+        }
+    }
+    if (pc.csv) {
+        fprintf(pc.csv, "frame,emulated_insns");
+        for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+            for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+                fprintf(pc.csv, ",%s_%s", phase_names[p], counter_names[c]);
+            }
+        }
+        fprintf(pc.csv, "\n");
+    }
+
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        if (pc.fd[c] >= 0) {
+            ioctl(pc.fd[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc.fd[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    read_counters(pc.last);
+
+    perf_counters_enabled = 1;
+    return opened;
+}
+
+#else
+
+static void read_counters(struct perf_reading *readings) {
+    memset(readings, 0, PERF_COUNTER_COUNT * sizeof(*readings));
+}
+
+int perf_counters_start(const char *csv_file) {
+    (void)csv_file;
+    return -ENOSYS;
+}
+
+#endif
+
+// Count between two readings, scaled up for the part of the interval the
+// counter was not scheduled. Counts scaled since the start are not
+// monotonic under multiplexing, so only the deltas are scaled.
+static uint64_t scaled_delta(const struct perf_reading *now,
+                             const struct perf_reading *last) {
+    uint64_t value = now->value - last->value;
+    uint64_t enabled = now->enabled - last->enabled;
+    uint64_t running = now->running - last->running;
+
+    if (!running) {
+        return 0;
+    }
+    if (running == enabled) {
+        return value;
+    }
+    return (uint64_t)((double)value * enabled / running);
+}
+
+// Charge the counts since the last switch to the innermost phase
+static void switch_phase(void) {
+    struct perf_reading now[PERF_COUNTER_COUNT];
+
+    read_counters(now);
+    if (pc.depth) {
+        uint8_t phase = pc.stack[pc.depth - 1];
+
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+            pc.frame[phase][c] += scaled_delta(&now[c], &pc.last[c]);
+        }
+    }
+    memcpy(pc.last, now, sizeof(now));
+}
+
+void perf_counters_enter(enum perf_phase phase) {
+    switch_phase();
+    if (pc.depth < PERF_DEPTH) {
+        pc.stack[pc.depth] = phase;
+    }
+    pc.depth++;
+}
+
+void perf_counters_leave(void) {
+    if (!pc.depth) {
+        return;
+    }
+    if (pc.depth <= PERF_DEPTH) {
+        switch_phase();
+    }
+    pc.depth--;
+}
+
+void perf_counters_frame(uint64_t emulated_insns) {
+    if (!perf_counters_enabled) {
+        return;
+    }
+
+    pc.frames++;
+    pc.emulated_insns += emulated_insns;
+
+    if (pc.csv) {
+        fprintf(pc.csv, "%llu,%llu", (unsigned long long)pc.frames,
+                (unsigned long long)emulated_insns);
+    }
+    for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+            pc.total[p][c] += pc.frame[p][c];
+            if (pc.csv) {
+                fprintf(pc.csv, ",%llu", (unsigned long long)pc.frame[p][c]);
+            }
+        }
+    }
+    if (pc.csv) {
+        fprintf(pc.csv, "\n");
+    }
+    memset(pc.frame, 0, sizeof(pc.frame));
+}
+
+// Count per emulated instruction, or a dash for a missing counter
+static void print_per_insn(FILE *f, int p, enum perf_counter c) {
+#ifdef __linux__
+    if (pc.fd[c] >= 0) {
+        fprintf(f, " %10.4f",
+                pc.emulated_insns
+                    ? (double)pc.total[p][c] / pc.emulated_insns
+                    : 0.0);
+        return;
+    }
+#endif
+    (void)p;
+    fprintf(f, " %10s", "-");
+}
+
+void perf_counters_report(FILE *f) {
+    if (!pc.frames) {
+        return;
+    }
+
+    fprintf(f, "\nPerf counters: %llu frames, %llu emulated instructions "
+               "(%.0f per frame)\n",
+            (unsigned long long)pc.frames,
+            (unsigned long long)pc.emulated_insns,
+            (double)pc.emulated_insns / pc.frames);
+    fprintf(f, "\n  %-8s %12s %12s %5s   per emulated instruction:\n", "phase",
+            "insns/frame", "cycles/frame", "IPC");
+    fprintf(f, "  %-8s %12s %12s %5s %10s %10s %10s %10s %10s\n", "", "", "",
+            "", "insns", "br-miss", "L1D miss", "LLC miss", "iTLB miss");
+
+    for (int p = 0; p < PERF_PHASE_COUNT; p++) {
+        uint64_t insns = pc.total[p][PERF_INSTRUCTIONS];
+        uint64_t cycles = pc.total[p][PERF_CYCLES];
+
+        if (!insns && !cycles) {
+            continue;
+        }
+        fprintf(f, "  %-8s %12.0f %12.0f %5.2f", phase_names[p],
+                (double)insns / pc.frames, (double)cycles / pc.frames,
+                cycles ? (double)insns / cycles : 0.0);
+        print_per_insn(f, p, PERF_INSTRUCTIONS);
+        print_per_insn(f, p, PERF_BRANCH_MISSES);
+        print_per_insn(f, p, PERF_L1D_MISSES);
+        print_per_insn(f, p, PERF_LLC_MISSES);
+        print_per_insn(f, p, PERF_ITLB_MISSES);
+        fprintf(f, "\n");
+    }
+
+    if (pc.csv) {
+        fflush(pc.csv);
+    }
+}
\ No newline at end of file
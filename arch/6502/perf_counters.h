@@ -0,0 +1,66 @@
+// perf_counters.h
+//
+// Hardware performance counters of the emulation thread, read through
+// perf_event_open(2) at the boundaries of coarse phases: emulating a frame,
+// rendering it inline and presenting it. The counters are charged to the
+// innermost phase, so rendering at VBlank is not counted as emulation.
+//
+// Each counter is its own event, not a group, so the kernel can multiplex
+// them when the PMU is short of registers; a boundary costs one read() per
+// counter, so the phases are per frame, never per instruction. Linux only; elsewhere perf_counters_start()
+// fails with -ENOSYS.
+
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum perf_phase {
+    PERF_PHASE_EMULATE, // CPU and PPU of a frame
+    PERF_PHASE_RENDER,  // Inline rendering at the end of the frame
+    PERF_PHASE_PRESENT, // Copying the frame to the display and presenting it
+    PERF_PHASE_COUNT
+};
+
+enum perf_counter {
+    PERF_INSTRUCTIONS,
+    PERF_CYCLES,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_ITLB_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+extern uint8_t perf_counters_enabled;
+
+// Open the counters for the calling thread, which must be the one running
+// the phases. Counters the host does not have are left out. With csv_file,
+// also write one line per frame. The number of counters opened, or -errno.
+int perf_counters_start(const char *csv_file);
+
+void perf_counters_enter(enum perf_phase phase);
+void perf_counters_leave(void);
+
+#define PERF_PHASE_ENTER(phase)                                                \
+    do {                                                                       \
+        if (perf_counters_enabled) {                                           \
+            perf_counters_enter(phase);                                        \
+        }                                                                      \
+    } while (0)
+
+#define PERF_PHASE_LEAVE()                                                     \
+    do {                                                                       \
+        if (perf_counters_enabled) {                                           \
+            perf_counters_leave();                                             \
+        }                                                                      \
+    } while (0)
+
+// Called between frames with the instructions the emulated CPU ran
+void perf_counters_frame(uint64_t emulated_insns);
+
+// Per phase: IPC, and misses per emulated instruction
+void perf_counters_report(FILE *f);
+
+#endif /* __PERF_COUNTERS_H__ */
\ No newline at end of file
@@ -0,0 +1,48 @@
+// probes.h
+//
+// USDT static tracepoints of the "nes" provider, for bpftrace, SystemTap
+// and DTrace. With <sys/sdt.h> each probe is a single NOP and a note in
+// the binary until a tracer attaches; without it, or with -DNES_NO_USDT
+// (the NES_USDT CMake option turned off), they compile to nothing.
+//
+//   frame__start()                       emu starts emulating a frame
+//   frame__end(cpu_ticks)                the PPU reached VBlank
+//   present__start(), present__end()     the frame goes to the display
+//   nmi(handler), irq(handler)           the CPU enters an interrupt
+//   oam__dma(page)                       a write to $4014
+//   ppu__write(reg, data, scanline, dot) a CPU write to a PPU register
+//   prg__bank(slot, bank)                an 8KB PRG window is mapped
+//   chr__bank(slot, bank)                a 1KB CHR window is mapped
+//   rom__load(file, mapper, prg, chr)    a cartridge is loaded
+
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+#if !defined(NES_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NES_USDT 1
+#endif
+#endif
+
+#ifdef NES_USDT
+#define NES_PROBE0(name) DTRACE_PROBE(nes, name)
+#define NES_PROBE1(name, a) DTRACE_PROBE1(nes, name, a)
+#define NES_PROBE2(name, a, b) DTRACE_PROBE2(nes, name, a, b)
+#define NES_PROBE4(name, a, b, c, d) DTRACE_PROBE4(nes, name, a, b, c, d)
+#else
+#define NES_PROBE0(name)                                                       \
+    do {                                                                       \
+    } while (0)
+#define NES_PROBE1(name, a)                                                    \
+    do {                                                                       \
+    } while (0)
+#define NES_PROBE2(name, a, b)                                                 \
+    do {                                                                       \
+    } while (0)
+#define NES_PROBE4(name, a, b, c, d)                                           \
+    do {                                                                       \
+    } while (0)
+#endif
+
+#endif /* __PROBES_H__ */
\ No newline at end of file
@@ -0,0 +1,168 @@
+// Chrome trace event timeline of the frame phases
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace_timeline.h"
+
+#define TRACE_THREADS 16
+#define TRACE_EVENTS (1 << 18)
+#define TRACE_DEPTH 8
+
+// A phase, written as a complete ("X") event so a ring that has wrapped
+// never holds an end without its beginning
+struct trace_event {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct trace_thread {
+    const char *name;
+    // Ring of the last TRACE_EVENTS events, NULL if it could not be
+    // allocated. Only the owning thread writes to it.
+    struct trace_event *events;
+    uint64_t count;
+
+    struct {
+        const char *name;
+        uint64_t start;
+    } open[TRACE_DEPTH];
+    uint8_t depth;
+};
+
+uint8_t trace_timeline_enabled;
+
+static __thread struct trace_thread *self;
+static __thread const char *self_name;
+
+static struct {
+    struct trace_thread threads[TRACE_THREADS];
+    uint32_t thread_count;
+    uint64_t epoch;
+} tl;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// The calling thread's slot, NULL once they have all been handed out
+static struct trace_thread *thread_slot(void) {
+    uint32_t slot;
+
+    if (self) {
+        return self;
+    }
+
+    slot = __atomic_fetch_add(&tl.thread_count, 1, __ATOMIC_RELAXED);
+    if (slot >= TRACE_THREADS) {
+        return NULL;
+    }
+    self = &tl.threads[slot];
+    self->name = self_name;
+    self->events = malloc(TRACE_EVENTS * sizeof(struct trace_event));
+    return self;
+}
+
+void trace_timeline_start(void) {
+    tl.epoch = now_ns();
+    trace_timeline_thread_name("emulation");
+    trace_timeline_enabled = 1;
+}
+
+void trace_timeline_thread_name(const char *name) {
+    self_name = name;
+    if (self) {
+        self->name = name;
+    }
+}
+
+void trace_timeline_enter(const char *name) {
+    struct trace_thread *t = thread_slot();
+
+    if (!t) {
+        return;
+    }
+    if (t->depth < TRACE_DEPTH) {
+        t->open[t->depth].name = name;
+        t->open[t->depth].start = now_ns();
+    }
+    t->depth++;
+}
+
+void trace_timeline_leave(void) {
+    struct trace_thread *t = self;
+    struct trace_event *e;
+
+    if (!t || !t->depth) {
+        return;
+    }
+    t->depth--;
+    if (t->depth >= TRACE_DEPTH || !t->events) {
+        return;
+    }
+
+    e = &t->events[t->count % TRACE_EVENTS];
+    e->name = t->open[t->depth].name;
+    e->start = t->open[t->depth].start;
+    e->end = now_ns();
+    __atomic_store_n(&t->count, t->count + 1, __ATOMIC_RELEASE);
+}
+
+static double us(uint64_t ns) { return (double)ns / 1000.0; }
+
+int trace_timeline_write(const char *filename) {
+    uint32_t count = __atomic_load_n(&tl.thread_count, __ATOMIC_RELAXED);
+    FILE *f;
+
+    f = fopen(filename, "w");
+    if (!f) {
+        int err = errno;
+
+        printf("Cannot write %s: %s\n", filename, strerror(err));
+        return -err;
+    }
+
+    if (count > TRACE_THREADS) {
+        count = TRACE_THREADS;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\","
+               "\"args\":{\"name\":\"emu\"}}");
+    for (uint32_t i = 0; i < count; i++) {
+        struct trace_thread *t = &tl.threads[i];
+        uint64_t events = __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+        uint64_t first = events > TRACE_EVENTS ? events - TRACE_EVENTS : 0;
+
+        fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                   "\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                i, t->name ? t->name : "thread");
+        fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                   "\"name\":\"thread_sort_index\","
+                   "\"args\":{\"sort_index\":%u}}",
+                i, i);
+        if (!t->events) {
+            continue;
+        }
+
+        for (uint64_t n = first; n < events; n++) {
+            struct trace_event *e = &t->events[n % TRACE_EVENTS];
+
+            fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":\"%s\","
+                       "\"ts\":%.3f,\"dur\":%.3f}",
+                    i, e->name, us(e->start - tl.epoch),
+                    us(e->end - e->start));
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    fclose(f);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+// trace_timeline.h
+//
+// A timeline of the frame phases on every thread, written as Chrome trace
+// event JSON for chrome://tracing and Perfetto. Phases are recorded while
+// trace_timeline_enabled is set, each thread into its own ring of the
+// most recent events, so recording takes no lock and a long run keeps its
+// end. Phases are per frame or coarser, never per instruction.
+
+#ifndef __TRACE_TIMELINE_H__
+#define __TRACE_TIMELINE_H__
+
+#include <stdint.h>
+
+extern uint8_t trace_timeline_enabled;
+
+// Start recording. The calling thread is named "emulation".
+void trace_timeline_start(void);
+
+// Name the calling thread in the timeline. name must be a string constant.
+void trace_timeline_thread_name(const char *name);
+
+// Open and close a phase on the calling thread; phases nest. name must be a
+// string constant.
+void trace_timeline_enter(const char *name);
+void trace_timeline_leave(void);
+
+#define TRACE_ENTER(name)                                                      \
+    do {                                                                       \
+        if (trace_timeline_enabled) {                                          \
+            trace_timeline_enter(name);                                        \
+        }                                                                      \
+    } while (0)
+
+#define TRACE_LEAVE()                                                          \
+    do {                                                                       \
+        if (trace_timeline_enabled) {                                          \
+            trace_timeline_leave();                                            \
+        }                                                                      \
+    } while (0)
+
+// Write every thread's events to filename. Other threads must be idle.
+// 0, or -errno.
+int trace_timeline_write(const char *filename);
+
+#endif /* __TRACE_TIMELINE_H__ */
\ No newline at end of file
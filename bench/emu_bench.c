@@ -0,0 +1,507 @@
+// Whole-system throughput benchmark: runs a ROM headless and reports how
+// fast the core emulates it
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "2c02.h"
+#include "6502.h"
+#include "cartridge.h"
+#include "mapper.h"
+#include "nes_state.h"
+#include "nesbus.h"
+
+#define NTSC_FPS 60.0988
+#define BOOT_CYCLES 29780
+
+static struct nesbus *bus;
+static struct cpu6502 *cpu;
+static struct ppu2c02 *ppu;
+
+static uint32_t framebuffer[256 * 240];
+
+// Controller 1 state for each frame from power on
+struct movie {
+    uint8_t *buttons;
+    uint32_t frames;
+};
+
+struct result {
+    const char *rom;
+    const char *core;
+    uint32_t frames;
+    uint32_t warmup;
+    double seconds;
+    uint64_t instructions;
+    uint64_t cycles;
+    double frames_per_sec;
+    double instructions_per_sec;
+    double cycles_per_sec;
+    double dots_per_sec;
+    double ns_per_frame_p50;
+    double ns_per_frame_p99;
+    long peak_rss_kb;
+    uint64_t frame_hash;
+};
+
+static void print_usage(const char *prog_name) {
+    printf("Usage: %s [options] <rom_file.nes>\n", prog_name);
+    printf("\nRuns the ROM without a display and reports emulation speed.\n");
+    printf("\nOptions:\n");
+    printf("  --frames N        Frames to measure (default 1800)\n");
+    printf("  --warmup N        Frames to run first, unmeasured (default 120)\n");
+    printf("  --movie FILE      Controller 1 input, one frame per line as\n");
+    printf("                    RLDUTSBA with '.' for released buttons, or an\n");
+    printf("                    FM2 input log\n");
+    printf("  --json FILE       Also write the results as JSON ('-': stdout)\n");
+    printf("  --baseline FILE   Compare against the JSON of an earlier run and\n");
+    printf("                    exit with status 2 on a regression\n");
+    printf("  --threshold PCT   Slowdown that counts as a regression (default "
+           "5)\n");
+    printf("  --render-thread   Render frames on a worker thread\n");
+    printf("  --render-bands N  Render each frame in N parallel bands (1-%d)\n",
+           PPU_RENDER_MAX_BANDS);
+    printf("\nExamples:\n");
+    printf("  %s --frames 3600 --json base.json mario.nes\n", prog_name);
+    printf("  %s --frames 3600 --baseline base.json mario.nes\n", prog_name);
+}
+
+// One frame of input: eight button columns, RLDUTSBA from bit 7 down to
+// bit 0, which is the order of the CONTROLLER_* bits
+static int parse_buttons(const char *line, uint8_t *buttons) {
+    *buttons = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = line[i];
+
+        if (c == '\0' || c == '\n' || c == '\r' || c == '|') {
+            return -EINVAL;
+        }
+        if (c != '.' && c != ' ') {
+            *buttons |= 0x80 >> i;
+        }
+    }
+    return 0;
+}
+
+static int movie_load(const char *filename, struct movie *movie) {
+    char line[256];
+    uint32_t size = 0;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (!f) {
+        int err = errno;
+
+        printf("Cannot open movie %s: %s\n", filename, strerror(err));
+        return -err;
+    }
+
+    movie->buttons = NULL;
+    movie->frames = 0;
+    while (fgets(line, sizeof(line), f)) {
+        const char *input = line;
+        uint8_t buttons;
+
+        // FM2 input lines are |commands|port 0|port 1|...
+        if (line[0] == '|') {
+            input = strchr(line + 1, '|');
+            if (!input) {
+                continue;
+            }
+            input++;
+        } else if (strspn(line, "RLDUTSBA.") < 8) {
+            continue; // Comment or header
+        }
+        if (parse_buttons(input, &buttons) < 0) {
+            continue;
+        }
+
+        if (movie->frames == size) {
+            uint8_t *grown;
+
+            size = size ? size * 2 : 1024;
+            grown = realloc(movie->buttons, size);
+            if (!grown) {
+                free(movie->buttons);
+                fclose(f);
+                return -ENOMEM;
+            }
+            movie->buttons = grown;
+        }
+        movie->buttons[movie->frames++] = buttons;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// Run a frame, counting CPU cycles and the instructions started in them.
+// An interrupt entry counts as an instruction.
+static void emulate_frame(uint64_t *instructions, uint64_t *cycles) {
+    uint64_t insns = 0;
+    uint64_t ticks = 0;
+
+    ppu->state->frame_complete = 0;
+    while (!ppu->state->frame_complete) {
+        ppu->clock();
+        ppu->clock();
+        ppu->clock();
+
+        insns += cpu->state->cycles == 0;
+        cpu->clock();
+        ticks++;
+    }
+
+    *instructions += insns;
+    *cycles += ticks;
+}
+
+static uint64_t frame_hash(const uint32_t *fb) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int i = 0; i < 256 * 240; i++) {
+        hash ^= fb[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const uint64_t *sorted, uint32_t count, double pct) {
+    uint32_t rank = (uint32_t)(pct / 100.0 * count + 0.5);
+
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > count) {
+        rank = count;
+    }
+    return sorted[rank - 1];
+}
+
+static int run(struct nes_cartridge *cartridge, const struct movie *movie,
+               struct result *res) {
+    uint64_t *frame_ns;
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    uint64_t start = 0;
+    uint32_t total = res->warmup + res->frames;
+    struct rusage usage;
+
+    frame_ns = calloc(res->frames, sizeof(*frame_ns));
+    if (!frame_ns) {
+        return -ENOMEM;
+    }
+
+    for (uint32_t frame = 0; frame < total; frame++) {
+        uint64_t frame_start;
+
+        if (frame == res->warmup) {
+            instructions = 0;
+            cycles = 0;
+            start = now_ns();
+        }
+
+        if (movie && frame < movie->frames) {
+            bus->controller1->buttons = movie->buttons[frame];
+        } else if (movie) {
+            bus->controller1->buttons = 0;
+        }
+
+        frame_start = now_ns();
+        emulate_frame(&instructions, &cycles);
+        cartridge_sync(cartridge);
+        if (frame >= res->warmup) {
+            frame_ns[frame - res->warmup] = now_ns() - frame_start;
+        }
+    }
+
+    // Publish the last frame if it is still with the render thread
+    ppu->set_render_mode(PPU_RENDER_INLINE);
+    res->seconds = (now_ns() - start) / 1e9;
+
+    qsort(frame_ns, res->frames, sizeof(*frame_ns), compare_u64);
+    res->ns_per_frame_p50 = percentile(frame_ns, res->frames, 50);
+    res->ns_per_frame_p99 = percentile(frame_ns, res->frames, 99);
+    free(frame_ns);
+
+    res->instructions = instructions;
+    res->cycles = cycles;
+    res->frames_per_sec = res->frames / res->seconds;
+    res->instructions_per_sec = instructions / res->seconds;
+    res->cycles_per_sec = cycles / res->seconds;
+    res->dots_per_sec = 3 * cycles / res->seconds;
+    res->frame_hash = frame_hash(framebuffer);
+
+    getrusage(RUSAGE_SELF, &usage);
+    res->peak_rss_kb = usage.ru_maxrss;
+
+    return 0;
+}
+
+static void print_result(const struct result *res) {
+    printf("\nROM:             %s\n", res->rom);
+    printf("CPU core:        %s\n", res->core);
+    printf("Frames:          %u (after %u warm-up)\n", res->frames,
+           res->warmup);
+    printf("Time:            %.3f s\n", res->seconds);
+    printf("Frames/s:        %.1f (%.2fx NTSC)\n", res->frames_per_sec,
+           res->frames_per_sec / NTSC_FPS);
+    printf("Instructions/s:  %.0f\n", res->instructions_per_sec);
+    printf("CPU cycles/s:    %.0f\n", res->cycles_per_sec);
+    printf("PPU dots/s:      %.0f\n", res->dots_per_sec);
+    printf("ns/frame p50:    %.0f\n", res->ns_per_frame_p50);
+    printf("ns/frame p99:    %.0f\n", res->ns_per_frame_p99);
+    printf("Peak RSS:        %ld KB\n", res->peak_rss_kb);
+    printf("Frame hash:      %016llx\n", (unsigned long long)res->frame_hash);
+}
+
+static int write_json(const struct result *res, const char *filename) {
+    FILE *f = stdout;
+
+    if (strcmp(filename, "-") != 0) {
+        f = fopen(filename, "w");
+        if (!f) {
+            int err = errno;
+
+            printf("Cannot write %s: %s\n", filename, strerror(err));
+            return -err;
+        }
+    }
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"rom\": \"%s\",\n", res->rom);
+    fprintf(f, "  \"cpu_core\": \"%s\",\n", res->core);
+    fprintf(f, "  \"frames\": %u,\n", res->frames);
+    fprintf(f, "  \"warmup_frames\": %u,\n", res->warmup);
+    fprintf(f, "  \"seconds\": %.6f,\n", res->seconds);
+    fprintf(f, "  \"instructions\": %llu,\n",
+            (unsigned long long)res->instructions);
+    fprintf(f, "  \"cpu_cycles\": %llu,\n", (unsigned long long)res->cycles);
+    fprintf(f, "  \"frames_per_sec\": %.3f,\n", res->frames_per_sec);
+    fprintf(f, "  \"instructions_per_sec\": %.0f,\n",
+            res->instructions_per_sec);
+    fprintf(f, "  \"cpu_cycles_per_sec\": %.0f,\n", res->cycles_per_sec);
+    fprintf(f, "  \"ppu_dots_per_sec\": %.0f,\n", res->dots_per_sec);
+    fprintf(f, "  \"ns_per_frame_p50\": %.0f,\n", res->ns_per_frame_p50);
+    fprintf(f, "  \"ns_per_frame_p99\": %.0f,\n", res->ns_per_frame_p99);
+    fprintf(f, "  \"peak_rss_kb\": %ld,\n", res->peak_rss_kb);
+    fprintf(f, "  \"frame_hash\": \"%016llx\"\n",
+            (unsigned long long)res->frame_hash);
+    fprintf(f, "}\n");
+
+    if (f != stdout) {
+        fclose(f);
+    }
+    return 0;
+}
+
+// Value of "key": in the JSON text, -1 if absent. Only reads the flat
+// objects write_json() produces.
+static double json_number(const char *json, const char *key) {
+    char pattern[64];
+    const char *p;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    p = strstr(json, pattern);
+    if (!p) {
+        return -1;
+    }
+    return strtod(p + strlen(pattern), NULL);
+}
+
+// Compare against a baseline run. 1 if any metric regressed by more than
+// threshold percent, 0 if not, -errno if the baseline can't be read.
+static int compare_baseline(const struct result *res, const char *filename,
+                            double threshold) {
+    static const struct {
+        const char *key;
+        int higher_is_better;
+    } metrics[] = {
+        {"frames_per_sec", 1},   {"instructions_per_sec", 1},
+        {"cpu_cycles_per_sec", 1}, {"ppu_dots_per_sec", 1},
+        {"ns_per_frame_p50", 0}, {"ns_per_frame_p99", 0},
+    };
+    double current[] = {
+        res->frames_per_sec, res->instructions_per_sec, res->cycles_per_sec,
+        res->dots_per_sec,   res->ns_per_frame_p50,     res->ns_per_frame_p99,
+    };
+    char json[4096];
+    char hash[20];
+    const char *p;
+    size_t len;
+    int regressed = 0;
+    FILE *f;
+
+    f = fopen(filename, "r");
+    if (!f) {
+        int err = errno;
+
+        printf("Cannot open baseline %s: %s\n", filename, strerror(err));
+        return -err;
+    }
+    len = fread(json, 1, sizeof(json) - 1, f);
+    json[len] = '\0';
+    fclose(f);
+
+    printf("\nAgainst baseline %s (threshold %.1f%%):\n", filename, threshold);
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+        double base = json_number(json, metrics[i].key);
+        double change;
+        int worse;
+
+        if (base <= 0) {
+            printf("  %-22s missing from baseline\n", metrics[i].key);
+            continue;
+        }
+
+        change = (current[i] - base) / base * 100.0;
+        worse = metrics[i].higher_is_better ? -change > threshold
+                                            : change > threshold;
+        regressed |= worse;
+        printf("  %-22s %14.1f -> %14.1f  %+6.1f%%%s\n", metrics[i].key, base,
+               current[i], change, worse ? "  REGRESSION" : "");
+    }
+
+    // A different final frame means the runs did not emulate the same thing
+    p = strstr(json, "\"frame_hash\": \"");
+    if (p) {
+        snprintf(hash, sizeof(hash), "%016llx",
+                 (unsigned long long)res->frame_hash);
+        if (strncmp(p + strlen("\"frame_hash\": \""), hash, 16) != 0) {
+            printf("  Warning: final frame differs from the baseline's\n");
+        }
+    }
+
+    return regressed;
+}
+
+int main(int argc, char *argv[]) {
+    struct nes_state *machine;
+    struct nes_cartridge *cartridge;
+    struct movie movie = {0};
+    struct result res = {0};
+    const char *movie_file = NULL;
+    const char *json_file = NULL;
+    const char *baseline_file = NULL;
+    double threshold = 5.0;
+    int render_thread = 0;
+    int render_bands = 1;
+    int ret = EXIT_SUCCESS;
+
+    res.frames = 1800;
+    res.warmup = 120;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            res.frames = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            res.warmup = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--movie") == 0 && i + 1 < argc) {
+            movie_file = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_file = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--render-thread") == 0) {
+            render_thread = 1;
+        } else if (strcmp(argv[i], "--render-bands") == 0 && i + 1 < argc) {
+            render_bands = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Error: Unknown option: %s\n\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            res.rom = argv[i];
+        }
+    }
+
+    if (!res.rom || res.frames == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (movie_file && movie_load(movie_file, &movie) < 0) {
+        return EXIT_FAILURE;
+    }
+
+    machine = nes_state_alloc();
+    if (!machine) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    cartridge = load_rom(res.rom, machine);
+    if (cartridge == NULL) {
+        fprintf(stderr, "Error: Failed to load ROM: %s\n", res.rom);
+        nes_state_free(machine);
+        return EXIT_FAILURE;
+    }
+
+    cpu = cpu6502_init();
+    ppu = ppu2c02_init();
+    bus = nesbus_init(cpu, ppu, machine);
+    bus->connect_cartridge(cartridge);
+    ppu->connect_cartridge(cartridge);
+    ppu->set_framebuffer(framebuffer);
+    res.core = cartridge->map->cpu_clock ? "mapper" : "generic";
+
+    if (render_thread && ppu->set_render_mode(PPU_RENDER_DEFERRED) < 0) {
+        fprintf(stderr, "Warning: Falling back to inline rendering\n");
+    }
+    if (render_bands > 1 && ppu->set_render_bands(render_bands) < 0) {
+        fprintf(stderr, "Warning: Rendering frames in one band\n");
+    }
+
+    // Same power-on sequence as emu
+    cpu->reset();
+    for (uint32_t cycle = 0; cycle < BOOT_CYCLES; cycle++) {
+        cpu->clock();
+    }
+
+    if (run(cartridge, movie_file ? &movie : NULL, &res) < 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        unload_rom(cartridge);
+        nes_state_free(machine);
+        return EXIT_FAILURE;
+    }
+
+    print_result(&res);
+    if (json_file && write_json(&res, json_file) < 0) {
+        ret = EXIT_FAILURE;
+    }
+    if (baseline_file) {
+        int regressed = compare_baseline(&res, baseline_file, threshold);
+
+        if (regressed < 0) {
+            ret = EXIT_FAILURE;
+        } else if (regressed) {
+            ret = 2;
+        }
+    }
+
+    free(movie.buttons);
+    unload_rom(cartridge);
+    nes_state_free(machine);
+    return ret;
+}
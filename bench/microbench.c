@@ -0,0 +1,596 @@
+// Component microbenchmarks: the bus, CPU, PPU, MMC1 and controller hot
+// paths in isolation, each timed over a fixed number of iterations
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "2c02.h"
+#include "6502.h"
+#include "cartridge.h"
+#include "controller.h"
+#include "mapper.h"
+#include "mapper_001.h"
+#include "nes_state.h"
+#include "nesbus.h"
+
+#ifdef BENCH_DISPLAY
+#include "display.h"
+#endif
+
+#define MAX_REPS 101
+
+// Synthetic MMC1 cartridge: 128KB PRG-ROM of NOPs, 32KB CHR-ROM, 8KB
+// PRG-RAM at $6000 for the CPU benchmarks' code
+#define PRG_BANKS 8
+#define CHR_BANKS 4
+#define CODE_START 0x6000
+#define CODE_END 0x7ff0
+
+static struct nesbus *bus;
+static struct cpu6502 *cpu;
+static struct ppu2c02 *ppu;
+static struct nes_state *machine;
+static struct nes_cartridge *cart;
+
+static uint32_t framebuffer[256 * 240];
+
+static int reps = 15;
+static const char *filter;
+
+// Results are folded in here so the timed loops are not optimized away
+static volatile uint32_t sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int selected(const char *name) {
+    return !filter || strstr(name, filter);
+}
+
+// Column headings for a group, printed with its first selected benchmark
+static const char *group_name;
+
+static void print_header(const char *group) { group_name = group; }
+
+// Time fn(iters) reps times and print ns per iteration. setup, if any,
+// runs untimed before each repetition.
+static void bench(const char *name, uint32_t iters, void (*setup)(void),
+                  void (*fn)(uint32_t iters)) {
+    double ns[MAX_REPS];
+    double mean = 0;
+    double var = 0;
+
+    if (!selected(name)) {
+        return;
+    }
+
+    if (group_name) {
+        printf("\n%-32s %10s %10s %10s %10s %8s\n", group_name, "iters",
+               "min", "median", "mean", "stddev");
+        group_name = NULL;
+    }
+
+    for (int r = 0; r < reps; r++) {
+        uint64_t start;
+
+        if (setup) {
+            setup();
+        }
+        start = now_ns();
+        fn(iters);
+        ns[r] = (double)(now_ns() - start) / iters;
+        mean += ns[r];
+    }
+    mean /= reps;
+    for (int r = 0; r < reps; r++) {
+        var += (ns[r] - mean) * (ns[r] - mean);
+    }
+    qsort(ns, reps, sizeof(ns[0]), compare_double);
+
+    printf("%-32s %10u %10.2f %10.2f %10.2f %8.2f\n", name, iters, ns[0],
+           ns[reps / 2], mean, reps > 1 ? sqrt(var / (reps - 1)) : 0.0);
+}
+
+static int make_cartridge(void) {
+    static const uint8_t header[16] = {'N', 'E', 'S', 0x1a, PRG_BANKS,
+                                       CHR_BANKS, 0x10}; // Mapper 1
+    char path[] = "/tmp/microbench-XXXXXX";
+    uint8_t *image;
+    size_t len = sizeof(header) + PRG_BANKS * 0x4000 + CHR_BANKS * 0x2000;
+    int fd;
+    int ret = 0;
+
+    image = malloc(len);
+    if (!image) {
+        return -ENOMEM;
+    }
+    memcpy(image, header, sizeof(header));
+    memset(image + sizeof(header), 0xea, PRG_BANKS * 0x4000);
+    for (size_t i = sizeof(header) + PRG_BANKS * 0x4000; i < len; i++) {
+        image[i] = i * 7;
+    }
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        free(image);
+        return -errno;
+    }
+    if (write(fd, image, len) != (ssize_t)len) {
+        ret = -EIO;
+    }
+    close(fd);
+    free(image);
+
+    if (ret == 0) {
+        cart = load_rom(path, machine);
+        if (!cart) {
+            ret = -EINVAL;
+        }
+    }
+    unlink(path);
+    return ret;
+}
+
+// Load an MMC1 register through its serial port
+static void mmc1_write(uint16_t addr, uint8_t value) {
+    for (int i = 0; i < 5; i++) {
+        bus->write(addr, (value >> i) & 1);
+    }
+}
+
+// Bus: one access per iteration through bus->read and bus->write, the path
+// the generic CPU core takes
+
+static uint16_t bus_addr;
+
+static void bus_read_loop(uint32_t iters) {
+    uint32_t acc = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        acc += bus->read(bus_addr + (i & 0xff));
+    }
+    sink = acc;
+}
+
+static void bus_write_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        bus->write(bus_addr + (i & 0xff), i);
+    }
+}
+
+// PPU and I/O registers don't mirror every byte, so hit one of them
+static void bus_reg_read_loop(uint32_t iters) {
+    uint32_t acc = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        acc += bus->read(bus_addr);
+    }
+    sink = acc;
+}
+
+static void bus_reg_write_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        bus->write(bus_addr, 0);
+    }
+}
+
+static void mmc1_reset_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        bus->write(bus_addr, 0x80);
+    }
+}
+
+// PPUDATA increments the VRAM address on every access. Point it back every
+// 256 so reads stay in the pattern tables and writes in a nametable.
+static void ppudata_read_loop(uint32_t iters) {
+    uint32_t acc = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        if ((i & 0xff) == 0) {
+            bus->write(PPUADDR, 0x00);
+            bus->write(PPUADDR, 0x00);
+        }
+        acc += bus->read(PPUDATA);
+    }
+    sink = acc;
+}
+
+static void ppudata_write_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        if ((i & 0xff) == 0) {
+            bus->write(PPUADDR, 0x20);
+            bus->write(PPUADDR, 0x00);
+        }
+        bus->write(PPUDATA, i);
+    }
+}
+
+static void bench_bus(void) {
+    static const struct {
+        const char *name;
+        uint16_t addr;
+        int reg;
+        int writable;
+    } regions[] = {
+        {"ram $0000", 0x0000, 0, 1},     {"ram mirror $1800", 0x1800, 0, 1},
+        {"ppu $2002", PPUSTATUS, 1, 0},  {"io $4016", 0x4016, 1, 1},
+        {"prg-ram $6000", 0x6000, 0, 1},
+        {"prg-rom $8000", 0x8000, 0, 0}, {"prg-rom $c000", 0xc000, 0, 0},
+    };
+    char name[64];
+
+    print_header("bus (ns/access)");
+    for (size_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        bus_addr = regions[i].addr;
+        snprintf(name, sizeof(name), "bus read %s", regions[i].name);
+        bench(name, 1000000, NULL,
+              regions[i].reg ? bus_reg_read_loop : bus_read_loop);
+        if (regions[i].writable) {
+            snprintf(name, sizeof(name), "bus write %s", regions[i].name);
+            bench(name, 1000000, NULL,
+                  regions[i].reg ? bus_reg_write_loop : bus_write_loop);
+        }
+    }
+    bench("bus read ppu $2007", 1000000, NULL, ppudata_read_loop);
+    bench("bus write ppu $2007", 1000000, NULL, ppudata_write_loop);
+
+    // A write with bit 7 set resets MMC1, which rebuilds its bank tables
+    // and the bus PRG pages
+    bus_addr = 0x8000;
+    bench("bus write mmc1 reset $8000", 100000, NULL, mmc1_reset_loop);
+}
+
+// CPU: one opcode repeated through PRG-RAM, so each iteration is one
+// instruction and all the clocks it takes
+
+static void cpu_setup(void) {
+    nes_state->cpu_regs.PC = CODE_START;
+    nes_state->cpu_regs.cycles = 0;
+    nes_state->cpu_regs.A = 0;
+    nes_state->cpu_regs.X = 0;
+    nes_state->cpu_regs.Y = 0;
+    nes_state->cpu_regs.sp = 0xfd;
+    nes_state->cpu_regs.flags.reg = 0x24;
+}
+
+static void cpu_loop(uint32_t iters) {
+    uint32_t insns = 0;
+
+    while (insns < iters) {
+        insns += nes_state->cpu_regs.cycles == 0;
+        cpu->clock();
+    }
+    // Finish the last instruction
+    while (nes_state->cpu_regs.cycles) {
+        cpu->clock();
+    }
+}
+
+// Bytes the opcode takes, found by running it once
+static uint8_t insn_length(uint8_t opcode) {
+    uint8_t *code = cart->prg_ram;
+
+    code[0] = opcode;
+    code[1] = 0x00;
+    code[2] = 0x02;
+    cpu_setup();
+    do {
+        cpu->clock();
+    } while (nes_state->cpu_regs.cycles);
+
+    return nes_state->cpu_regs.PC - CODE_START;
+}
+
+// Fill the code area with the opcode, operands pointing at $0000 (zero
+// page) or $0200 (absolute), branches and jumps going to the next
+// instruction, and a jump back at the end
+static void cpu_fill(uint8_t opcode, uint8_t len) {
+    uint8_t *code = cart->prg_ram;
+    uint16_t addr = CODE_START;
+
+    while (addr + len <= CODE_END) {
+        uint8_t *p = &code[addr - CODE_START];
+
+        p[0] = opcode;
+        if (opcode == 0x4c || opcode == 0x20) { // JMP abs, JSR
+            p[1] = (addr + 3) & 0xff;
+            p[2] = (addr + 3) >> 8;
+        } else if (len > 1) {
+            p[1] = 0x00;
+            if (len > 2) {
+                p[2] = 0x02;
+            }
+        }
+        addr += len;
+    }
+    code[addr - CODE_START] = 0x4c;
+    code[addr - CODE_START + 1] = CODE_START & 0xff;
+    code[addr - CODE_START + 2] = CODE_START >> 8;
+}
+
+static void bench_cpu(void) {
+    char name[64];
+
+    print_header("cpu (ns/instruction)");
+    for (int op = 0; op < 0x100; op++) {
+        uint8_t len;
+
+        // Control flow that leaves the code area
+        if (op == 0x00 || op == 0x40 || op == 0x60 || op == 0x6c) {
+            continue;
+        }
+
+        len = (op == 0x4c || op == 0x20) ? 3 : insn_length(op);
+        if (strcmp(cpu->curr_insn->mnem, "???") == 0 || len < 1 || len > 3) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "cpu %02x %s", op, cpu->curr_insn->mnem);
+        if (!selected(name)) {
+            continue;
+        }
+        cpu_fill(op, len);
+        bench(name, 100000, cpu_setup, cpu_loop);
+    }
+}
+
+// PPU: a whole frame of dots per iteration, reported per dot and per
+// scanline
+
+static uint8_t ppu_mask;
+
+static void ppu_setup(void) {
+    ppu->cpu_write(PPUCTRL, 0x00); // No NMI
+    ppu->cpu_write(PPUMASK, ppu_mask);
+}
+
+static void ppu_dot_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        ppu->clock();
+    }
+}
+
+static void ppu_scanline_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        for (int dot = 0; dot < 341; dot++) {
+            ppu->clock();
+        }
+    }
+}
+
+static void bench_ppu(void) {
+    print_header("ppu (ns/dot)");
+    ppu_mask = 0x00;
+    bench("ppu dot rendering off", 341 * 262, ppu_setup, ppu_dot_loop);
+    ppu_mask = 0x1e;
+    bench("ppu dot rendering on", 341 * 262, ppu_setup, ppu_dot_loop);
+
+    print_header("ppu (ns/scanline)");
+    ppu_mask = 0x00;
+    bench("ppu scanline rendering off", 262, ppu_setup, ppu_scanline_loop);
+    ppu_mask = 0x1e;
+    bench("ppu scanline rendering on", 262, ppu_setup, ppu_scanline_loop);
+
+    ppu_mask = 0x00;
+    ppu_setup();
+}
+
+// MMC1: reads straight through the mapper, in each PRG and CHR banking
+// mode
+
+static void mmc1_cpu_read_loop(uint32_t iters) {
+    uint32_t acc = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        acc += mapper_001_cpu_read(cart->map, 0x8000 + (i & 0x7fff));
+    }
+    sink = acc;
+}
+
+static void mmc1_ppu_read_loop(uint32_t iters) {
+    uint32_t acc = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        acc += mapper_001_ppu_read(cart->map, i & 0x1fff);
+    }
+    sink = acc;
+}
+
+// Each CHR bank switch snapshots the pattern tables for the renderer until
+// the frame ends, so run a frame between repetitions
+static void mmc1_flush(void) {
+    for (int dot = 0; dot < 341 * 262; dot++) {
+        ppu->clock();
+    }
+}
+
+static void mmc1_chr_load_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        mmc1_write(0xa000, i & 0x1f);
+    }
+}
+
+static void mmc1_prg_load_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        mmc1_write(0xe000, i & 0x0f);
+    }
+}
+
+static void bench_mmc1(void) {
+    static const struct {
+        const char *name;
+        uint8_t control;
+    } modes[] = {
+        {"prg 32k chr 8k", 0x00},
+        {"prg fix first", 0x08},
+        {"prg fix last", 0x0c},
+        {"prg fix last chr 4k", 0x1c},
+    };
+    char name[64];
+
+    print_header("mmc1 (ns/read)");
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        mmc1_write(0x8000, modes[i].control);
+        mmc1_write(0xa000, 1);
+        mmc1_write(0xc000, 2);
+        mmc1_write(0xe000, 3);
+
+        snprintf(name, sizeof(name), "mmc1 cpu_read %s", modes[i].name);
+        bench(name, 1000000, NULL, mmc1_cpu_read_loop);
+        snprintf(name, sizeof(name), "mmc1 ppu_read %s", modes[i].name);
+        bench(name, 1000000, NULL, mmc1_ppu_read_loop);
+    }
+
+    // Five serial writes per iteration
+    print_header("mmc1 (ns/register load)");
+    bench("mmc1 load chr bank 0", 1000, mmc1_flush, mmc1_chr_load_loop);
+    bench("mmc1 load prg bank", 1000, mmc1_flush, mmc1_prg_load_loop);
+
+    // Leave the mapper as it powered on
+    bus->write(0x8000, 0x80);
+}
+
+// Controller: strobe, then read the eight buttons back
+
+static struct controller pad;
+
+static void controller_loop(uint32_t iters) {
+    uint32_t acc = 0;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        if ((i & 7) == 0) {
+            controller_write(&pad, 1);
+            controller_write(&pad, 0);
+        }
+        acc += controller_read(&pad);
+    }
+    sink = acc;
+}
+
+static void bench_controller(void) {
+    print_header("controller (ns/read)");
+    controller_init(&pad);
+    controller_set_button(&pad, CONTROLLER_A | CONTROLLER_START, 1);
+    bench("controller_read", 1000000, NULL, controller_loop);
+}
+
+#ifdef BENCH_DISPLAY
+// Display: upload and present one frame per iteration
+
+static struct display_context *display;
+
+static void display_loop(uint32_t iters) {
+    for (uint32_t i = 0; i < iters; i++) {
+        display_render_frame(display);
+    }
+}
+
+static void bench_display(void) {
+    struct display_config config = {.window_title = "microbench",
+                                     .screen_width = 256,
+                                     .screen_height = 240,
+                                     .scale_factor = 1,
+                                     .enable_vsync = 0};
+
+    if (!selected("display_render_frame")) {
+        return;
+    }
+
+    display = display_init(&config);
+    if (!display) {
+        printf("\ndisplay_render_frame: no display available, skipped\n");
+        return;
+    }
+    print_header("display (ns/frame)");
+    memset(display_get_framebuffer(display), 0x55, sizeof(framebuffer));
+    bench("display_render_frame", 100, NULL, display_loop);
+    display_cleanup(display);
+}
+#endif
+
+static void print_usage(const char *prog_name) {
+    printf("Usage: %s [options]\n", prog_name);
+    printf("\nTimes the emulator's components in isolation.\n");
+    printf("\nOptions:\n");
+    printf("  --reps N          Repetitions of each benchmark (default 15, "
+           "max %d)\n",
+           MAX_REPS);
+    printf("  --filter TEXT     Only run benchmarks whose name contains TEXT\n");
+    printf("\nTimes are ns per iteration: min, median, mean and standard\n");
+    printf("deviation over the repetitions.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int ret;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (reps < 1 || reps > MAX_REPS) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    machine = nes_state_alloc();
+    if (!machine) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    ret = make_cartridge();
+    if (ret < 0) {
+        fprintf(stderr, "Error: Failed to create the test cartridge: %s\n",
+                strerror(-ret));
+        nes_state_free(machine);
+        return EXIT_FAILURE;
+    }
+
+    cpu = cpu6502_init();
+    ppu = ppu2c02_init();
+    bus = nesbus_init(cpu, ppu, machine);
+    bus->connect_cartridge(cart);
+    ppu->connect_cartridge(cart);
+    ppu->set_framebuffer(framebuffer);
+    cpu->reset();
+
+    // Get past the first frames, where the PPU logs register writes
+    for (int dot = 0; dot < 4 * 341 * 262; dot++) {
+        ppu->clock();
+    }
+
+    bench_bus();
+    bench_cpu();
+    bench_ppu();
+    bench_mmc1();
+    bench_controller();
+#ifdef BENCH_DISPLAY
+    bench_display();
+#endif
+
+    unload_rom(cart);
+    nes_state_free(machine);
+    return EXIT_SUCCESS;
+}
@@ -1,49 +1,333 @@
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "2c02.h"
 #include "6502.h"
+#ifdef CPU_PROFILE
+#include "6502_hotspot.h"
+#include "6502_profile.h"
+#endif
 #include "cartridge.h"
+#include "cheat.h"
 #include "display.h"
 #include "emu_config.h"
+#include "host_timer.h"
+#include "logger.h"
 #include "nes_input.h"
+#include "nes_state.h"
 #include "nesbus.h"
+#include "perf_counters.h"
+#include "probes.h"
+#include "trace_timeline.h"
 
 #include "debug.h"
 
 static struct nesbus *bus;
 static struct cpu6502 *cpu;
 static struct ppu2c02 *ppu;
+static struct cheat_table cheats;
+
+// Instructions the emulated CPU has run
+static uint64_t emulated_insns;
+
+// Frame buffer the PPU draws into when there is no window
+static uint32_t headless_framebuffer[256 * 240];
+
+// Set by SIGUSR1 to print the profiles without stopping
+static volatile sig_atomic_t report_requested;
+
+// Where to write the hot spot call stacks for flame graph tools
+static const char *folded_file;
+
+// Where to write the timeline of frame phases on exit
+static const char *trace_file;
+
+static void request_report(int sig) {
+    (void)sig;
+    report_requested = 1;
+}
+
+static void print_reports(void) {
+#ifdef CPU_PROFILE
+    if (cpu6502_profile.enabled) {
+        cpu6502_profile_report(stdout);
+    }
+    if (cpu6502_hotspot_enabled) {
+        cpu6502_hotspot_report(stdout, 30);
+        if (folded_file) {
+            cpu6502_hotspot_write_folded(folded_file);
+        }
+    }
+#endif
+#ifdef HOST_PROFILE
+    if (host_timer_enabled) {
+        host_timer_report(stdout);
+    }
+#endif
+    if (perf_counters_enabled) {
+        perf_counters_report(stdout);
+    }
+}
+
+// Hand the frame's counts to the profilers
+static void end_frame(void) {
+    static uint64_t frame_start_insns;
+
+#ifdef HOST_PROFILE
+    host_timer_frame();
+#endif
+    perf_counters_frame(emulated_insns - frame_start_insns);
+    frame_start_insns = emulated_insns;
+}
+
+// Called between frames
+static void poll_report_request(void) {
+    if (report_requested) {
+        report_requested = 0;
+        print_reports();
+    }
+}
 
 static void print_usage(const char *prog_name) {
-    printf("Usage: %s <rom_file.nes>\n", prog_name);
+    printf("Usage: %s [options] <rom_file.nes>\n", prog_name);
     printf("\nNES Emulator - Version %d.%d\n", emu_VERSION_MAJOR,
            emu_VERSION_MINOR);
     printf("\nArguments:\n");
     printf("  <rom_file.nes>    Path to NES ROM file (iNES format)\n");
+    printf("\nOptions:\n");
+    printf("  --render-thread   Render frames on a worker thread, overlapping\n");
+    printf("                    emulation of the next frame\n");
+    printf("  --render-bands N  Split each frame into N bands of scanlines\n");
+    printf("                    rendered in parallel (1-%d)\n",
+           PPU_RENDER_MAX_BANDS);
+    printf("  --headless        Run without a window or input, as fast as the\n");
+    printf("                    host allows, then print the final frame hash\n");
+    printf("  --frames N        Stop after N frames (headless default: 600)\n");
+    printf("  --profile-cpu     Count instructions per opcode and addressing\n");
+    printf("                    mode (needs NES_CPU_PROFILE); report on exit\n");
+    printf("                    and on SIGUSR1\n");
+    printf("  --profile-pc      Charge CPU cycles to ROM addresses and the\n");
+    printf("                    routines called (needs NES_CPU_PROFILE)\n");
+    printf("  --labels FILE     Name routines from a ca65 .dbg, FCEUX .nl or\n");
+    printf("                    Mesen .mlb file; may be repeated\n");
+    printf("  --folded FILE     With --profile-pc, write call stacks for\n");
+    printf("                    flame graph tools to FILE\n");
+    printf("  --profile-host    Time the CPU, PPU, bus, mapper, rendering,\n");
+    printf("                    input and display on the host (needs\n");
+    printf("                    NES_HOST_PROFILE); report on exit and SIGUSR1\n");
+    printf("  --host-csv FILE   With --profile-host, write each frame's times\n");
+    printf("                    to FILE\n");
+    printf("  --perf-counters   Count host instructions, cycles, branch and\n");
+    printf("                    cache misses per phase with perf_event_open\n");
+    printf("  --perf-csv FILE   With --perf-counters, write each frame's\n");
+    printf("                    counts to FILE\n");
+    printf("  --trace-timeline FILE\n");
+    printf("                    Write the emulation, render and display\n");
+    printf("                    phases of each frame and thread to FILE as\n");
+    printf("                    Chrome trace JSON, for chrome://tracing or\n");
+    printf("                    Perfetto\n");
+    printf("  --log SPEC        Log levels: one for every category, or a list\n");
+    printf("                    like ppu=debug,mapper=trace. Categories are\n");
+    printf("                    cpu, ppu, bus, mapper, input and display;\n");
+    printf("                    levels off, error, warn, info (default),\n");
+    printf("                    debug and trace\n");
+    printf("  --log-file FILE   Write the log to FILE instead of stderr\n");
+    printf("  --cheats FILE     Apply the Game Genie codes and AAAA:VV[:CC]\n");
+    printf("                    patches in FILE, one per line\n");
     printf("\nExamples:\n");
     printf("  %s mario.nes\n", prog_name);
     printf("  %s /path/to/rom/game.nes\n", prog_name);
+    printf("  %s --render-thread mario.nes\n", prog_name);
+    printf("  %s --cheats mario.cht mario.nes\n", prog_name);
+    printf("  %s --headless --frames 3600 mario.nes\n", prog_name);
+    printf("  %s --headless --profile-pc --labels game.dbg game.nes\n",
+           prog_name);
+}
+
+// Run the PPU and CPU until the PPU finishes a frame, returning the CPU
+// clocks it took
+static uint64_t emulate_frame(void) {
+    uint64_t ticks = 0;
+
+    // Reset frame complete flag
+    ppu->state->frame_complete = 0;
+
+    NES_PROBE0(frame__start);
+
+    // What the CPU, bus and renderer do not claim is the PPU's
+    PERF_PHASE_ENTER(PERF_PHASE_EMULATE);
+    HOST_TIMER_ENTER(HOST_PHASE_PPU);
+    TRACE_ENTER("emulate");
+
+    // Run until PPU completes a frame (ends at scanline 241, dot 1)
+    while (!ppu->state->frame_complete) {
+        // PPU clock (3x per CPU clock)
+        ppu->clock();
+        ppu->clock();
+        ppu->clock();
+
+        // CPU clock, starting an instruction when the last one is done
+        emulated_insns += cpu->state->cycles == 0;
+        cpu->clock();
+
+        // Temporary: Write random value for nestest compatibility
+        // TODO: Remove this when proper controller input is implemented
+        // cpu->write(0xd2, (uint8_t)(ticks & 0xff));
+
+        ticks++;
+    }
+    TRACE_LEAVE();
+    HOST_TIMER_LEAVE();
+    PERF_PHASE_LEAVE();
+    NES_PROBE1(frame__end, ticks);
+
+    return ticks;
+}
+
+// FNV-1a over the frame buffer, to compare runs without saving images
+static uint64_t frame_hash(const uint32_t *fb) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int i = 0; i < 256 * 240; i++) {
+        hash ^= fb[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run_headless(struct nes_cartridge *cartridge, uint32_t frames) {
+    struct timespec start;
+    uint64_t tick_count = 0;
+    double seconds;
+
+    printf("Running %u frames headless...\n", frames);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        tick_count += emulate_frame();
+        cartridge_sync(cartridge);
+        end_frame();
+        poll_report_request();
+    }
+
+    // Publish the last frame if it is still with the render thread
+    ppu->set_render_mode(PPU_RENDER_INLINE);
+    seconds = elapsed(&start);
+    if (trace_file) {
+        trace_timeline_write(trace_file);
+    }
+
+    printf("Frames: %u, Ticks: %lu, Time: %.3f s\n", frames, tick_count,
+           seconds);
+    if (seconds > 0) {
+        printf("Speed: %.1f frames/s (%.2fx NTSC), %.0f ticks/s\n",
+               frames / seconds, frames / seconds / 60.0988,
+               tick_count / seconds);
+    }
+    printf("Frame hash: %016llx\n",
+           (unsigned long long)frame_hash(headless_framebuffer));
+    print_reports();
 }
 
 int main(int argc, char *argv[]) {
+    struct nes_state *machine;
     struct nes_cartridge *cartridge;
-    struct display_context *display;
+    struct display_context *display = NULL;
     uint8_t buf[0x100];
     uint64_t tick_count = 0;
     uint32_t frame_count = 0;
+    const char *rom_file = NULL;
+    const char *cheat_file = NULL;
+    int render_thread = 0;
+    int render_bands = 1;
+    int headless = 0;
+    int profile_cpu = 0;
+    int profile_pc = 0;
+    int profile_host = 0;
+    const char *host_csv = NULL;
+    int perf = 0;
+    const char *perf_csv = NULL;
+    const char *label_files[8];
+    int label_file_count = 0;
+    const char *log_spec = NULL;
+    const char *log_file = NULL;
+    uint32_t max_frames = 0;
 
     printf("NES Emulator version %d.%d\n", emu_VERSION_MAJOR,
            emu_VERSION_MINOR);
 
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--render-thread") == 0) {
+            render_thread = 1;
+        } else if (strcmp(argv[i], "--render-bands") == 0 && i + 1 < argc) {
+            render_bands = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cheats") == 0 && i + 1 < argc) {
+            cheat_file = argv[++i];
+        } else if (strcmp(argv[i], "--profile-cpu") == 0) {
+            profile_cpu = 1;
+        } else if (strcmp(argv[i], "--profile-pc") == 0) {
+            profile_pc = 1;
+        } else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc &&
+                   label_file_count < 8) {
+            label_files[label_file_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc) {
+            folded_file = argv[++i];
+        } else if (strcmp(argv[i], "--profile-host") == 0) {
+            profile_host = 1;
+        } else if (strcmp(argv[i], "--host-csv") == 0 && i + 1 < argc) {
+            host_csv = argv[++i];
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            perf = 1;
+        } else if (strcmp(argv[i], "--perf-csv") == 0 && i + 1 < argc) {
+            perf_csv = argv[++i];
+        } else if (strcmp(argv[i], "--trace-timeline") == 0 && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_spec = argv[++i];
+        } else if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+            log_file = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            max_frames = strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Error: Unknown option: %s\n\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            rom_file = argv[i];
+        }
+    }
+
     // Check for ROM file argument
-    if (argc < 2) {
+    if (!rom_file) {
         fprintf(stderr, "Error: No ROM file specified\n\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    // Log records are written out on their own thread
+    if (log_start(log_file) < 0) {
+        fprintf(stderr, "Warning: Logging to stderr\n");
+        log_start(NULL);
+    }
+    atexit(log_stop);
+    if (log_spec && log_set_levels(log_spec) < 0) {
+        return EXIT_FAILURE;
+    }
+
     // Initialize display with NES configuration
     struct display_config config = {.window_title = "NES Emulator",
                                     .screen_width = 256,
@@ -51,16 +335,25 @@ int main(int argc, char *argv[]) {
                                     .scale_factor = 3,
                                     .enable_vsync = 1};
 
-    display = display_init(&config);
-    if (!display) {
-        fprintf(stderr, "Error: Failed to initialize display\n");
-        return EXIT_FAILURE;
+    if (!headless) {
+        display = display_init(&config);
+        if (!display) {
+            fprintf(stderr, "Error: Failed to initialize display\n");
+            return EXIT_FAILURE;
+        }
     }
 
-    // Load the ROM
-    cartridge = load_rom(argv[1]);
+    // Load the ROM into a fresh machine
+    machine = nes_state_alloc();
+    if (!machine) {
+        fprintf(stderr, "Error: Failed to allocate the machine state\n");
+        display_cleanup(display);
+        return EXIT_FAILURE;
+    }
+    cartridge = load_rom(rom_file, machine);
     if (cartridge == NULL) {
-        fprintf(stderr, "Error: Failed to load ROM: %s\n", argv[1]);
+        fprintf(stderr, "Error: Failed to load ROM: %s\n", rom_file);
+        nes_state_free(machine);
         display_cleanup(display);
         return EXIT_FAILURE;
     }
@@ -69,24 +362,47 @@ int main(int argc, char *argv[]) {
     // Initialize emulator components
     cpu = cpu6502_init();
     ppu = ppu2c02_init();
-    bus = nesbus_init(cpu, ppu);
+    bus = nesbus_init(cpu, ppu, machine);
     bus->connect_cartridge(cartridge);
 
+    if (cheat_file) {
+        int count = cheat_load(&cheats, cheat_file);
+
+        if (count < 0) {
+            fprintf(stderr, "Error: Failed to load cheats: %s\n", cheat_file);
+            display_cleanup(display);
+            return EXIT_FAILURE;
+        }
+        bus->set_cheats(&cheats);
+        printf("Loaded %d cheats from %s\n", count, cheat_file);
+    }
+
     // Connect cartridge to PPU for CHR-ROM access
     ppu->connect_cartridge(cartridge);
 
-    // Initialize NES input handler
-    nes_input_init(bus->controller1);
-
     // Connect PPU to display frame buffer for rendering
-    ppu->set_framebuffer(display_get_framebuffer(display));
+    if (headless) {
+        ppu->set_framebuffer(headless_framebuffer);
+    } else {
+        // Initialize NES input handler
+        nes_input_init(bus->controller1);
+        ppu->set_framebuffer(display_get_framebuffer(display));
+    }
+
+    if (render_thread && ppu->set_render_mode(PPU_RENDER_DEFERRED) < 0) {
+        fprintf(stderr, "Warning: Falling back to inline rendering\n");
+    }
+
+    if (render_bands > 1 && ppu->set_render_bands(render_bands) < 0) {
+        fprintf(stderr, "Warning: Rendering frames in one band\n");
+    }
 
     printf("End of the cartridge:\n");
     bus->debug_read(0xffff - 0xf, buf, 0x10);
     hex_dump(buf, 0x10);
 
     printf("PC:\n");
-    bus->debug_read(cpu->PC, buf, 0x20);
+    bus->debug_read(cpu->state->PC, buf, 0x20);
     hex_dump(buf, 0x20);
     cpu->reset();
 
@@ -100,6 +416,64 @@ int main(int argc, char *argv[]) {
     }
     printf("CPU initialization complete.\n");
 
+    if (profile_cpu) {
+#ifdef CPU_PROFILE
+        cpu6502_profile_enable(1);
+#else
+        fprintf(stderr, "Warning: Built without NES_CPU_PROFILE, --profile-cpu "
+                        "ignored\n");
+#endif
+    }
+    if (profile_pc) {
+#ifdef CPU_PROFILE
+        if (cpu6502_hotspot_start(cartridge) < 0) {
+            fprintf(stderr, "Warning: Out of memory for --profile-pc\n");
+        }
+        for (int i = 0; i < label_file_count; i++) {
+            int count = cpu6502_hotspot_load_labels(label_files[i]);
+
+            if (count >= 0) {
+                printf("Loaded %d labels from %s\n", count, label_files[i]);
+            }
+        }
+#else
+        (void)label_files;
+        fprintf(stderr, "Warning: Built without NES_CPU_PROFILE, --profile-pc "
+                        "ignored\n");
+#endif
+    }
+    if (profile_host) {
+#ifdef HOST_PROFILE
+        if (host_timer_start(host_csv) < 0) {
+            fprintf(stderr, "Warning: Not writing the per-frame CSV\n");
+            host_timer_start(NULL);
+        }
+#else
+        (void)host_csv;
+        fprintf(stderr, "Warning: Built without NES_HOST_PROFILE, "
+                        "--profile-host ignored\n");
+#endif
+    }
+    if (perf) {
+        int ret = perf_counters_start(perf_csv);
+
+        if (ret < 0) {
+            fprintf(stderr, "Warning: No performance counters: %s\n",
+                    strerror(-ret));
+        }
+    }
+    if (trace_file) {
+        trace_timeline_start();
+    }
+    signal(SIGUSR1, request_report);
+
+    if (headless) {
+        run_headless(cartridge, max_frames ? max_frames : 600);
+        unload_rom(cartridge);
+        nes_state_free(machine);
+        return EXIT_SUCCESS;
+    }
+
     printf("Starting emulation loop...\n");
     printf("Controls:\n");
     printf("  ESC=Quit, SPACE=Pause, R=Reset\n");
@@ -109,54 +483,79 @@ int main(int argc, char *argv[]) {
     while (display_is_running(display)) {
         // Handle display events (keyboard, window close, etc.)
         // Input callback updates controller state directly
+        HOST_TIMER_ENTER(HOST_PHASE_INPUT);
+        TRACE_ENTER("input");
         if (display_poll_events(display, nes_get_input_handler(), NULL)) {
+            TRACE_LEAVE();
+            HOST_TIMER_LEAVE();
             break; // User wants to quit
         }
+        TRACE_LEAVE();
+        HOST_TIMER_LEAVE();
 
         // Run emulation for one frame (if not paused)
         if (!display_is_paused(display)) {
             // NMI is now implemented, so games can enable rendering themselves
-
-            // Reset frame complete flag
-            ppu->frame_complete = 0;
-
-            // Run until PPU completes a frame (ends at scanline 241, dot 1)
-            while (!ppu->frame_complete) {
-                // PPU clock (3x per CPU clock)
-                ppu->clock();
-                ppu->clock();
-                ppu->clock();
-
-                // CPU clock
-                cpu->clock();
-
-                // Temporary: Write random value for nestest compatibility
-                // TODO: Remove this when proper controller input is implemented
-                // cpu->write(0xd2, (uint8_t)(tick_count & 0xff));
-
-                tick_count++;
-            }
-
+            tick_count += emulate_frame();
             frame_count++;
 
-            // Debug output every 60 frames (1 second at 60fps)
+            // Battery saves are written through a shared mapping, only the
+            // writeback to disk is kicked off here
+            cartridge_sync(cartridge);
+
+            // Status every 60 frames (1 second at 60fps)
             if (frame_count % 60 == 0) {
-                printf("Frame: %u, Ticks: %lu, PC: 0x%04X\n", frame_count,
-                       tick_count, cpu->PC);
+                LOG(LOG_CPU, LOG_LEVEL_INFO,
+                    "Frame: %u, Ticks: %lu, PC: 0x%04X", frame_count,
+                    tick_count, cpu->state->PC);
             }
         }
 
-        // Render the completed frame (PPU has written to frame_buffer)
-        display_render_frame(display);
+        // Render the completed frame. With the render thread this is the
+        // previous frame, the current one is still being drawn.
+        PERF_PHASE_ENTER(PERF_PHASE_PRESENT);
+        HOST_TIMER_ENTER(HOST_PHASE_UPLOAD);
+        TRACE_ENTER("upload");
+        ppu->sync_framebuffer();
+        display_upload_frame(display);
+        TRACE_LEAVE();
+        HOST_TIMER_LEAVE();
+
+        // Waits for vsync
+        HOST_TIMER_ENTER(HOST_PHASE_PRESENT);
+        TRACE_ENTER("present");
+        NES_PROBE0(present__start);
+        display_present(display);
+        NES_PROBE0(present__end);
+        TRACE_LEAVE();
+        HOST_TIMER_LEAVE();
+        PERF_PHASE_LEAVE();
+
+        end_frame();
+        poll_report_request();
+        if (max_frames && frame_count >= max_frames) {
+            break;
+        }
+    }
+
+    // Stop the render thread before the frame buffer goes away
+    ppu->set_render_mode(PPU_RENDER_INLINE);
+
+    if (trace_file) {
+        trace_timeline_write(trace_file);
     }
 
     printf("Emulation stopped. Total frames: %u, Total ticks: %lu\n",
            frame_count, tick_count);
+    print_reports();
 
     // Cleanup
     display_cleanup(display);
 
-    // TODO: Add proper cleanup for cartridge, bus, cpu, ppu
+    unload_rom(cartridge);
+    nes_state_free(machine);
+
+    // TODO: Add proper cleanup for bus, cpu, ppu
     // (Currently they are static globals that will be freed on program exit)
 
     return EXIT_SUCCESS;
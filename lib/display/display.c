@@ -213,6 +213,11 @@ int display_poll_events(struct display_context *ctx,
 }
 
 void display_render_frame(struct display_context *ctx) {
+    display_upload_frame(ctx);
+    display_present(ctx);
+}
+
+void display_upload_frame(struct display_context *ctx) {
     if (!ctx || !ctx->renderer || !ctx->screen_texture || !ctx->frame_buffer) {
         return;
     }
@@ -231,6 +236,12 @@ void display_render_frame(struct display_context *ctx) {
 
     // Render the screen texture (scaled)
     SDL_RenderCopy(ctx->renderer, ctx->screen_texture, NULL, NULL);
+}
+
+void display_present(struct display_context *ctx) {
+    if (!ctx || !ctx->renderer || !ctx->screen_texture || !ctx->frame_buffer) {
+        return;
+    }
 
     // Present to screen
     SDL_RenderPresent(ctx->renderer);
@@ -95,6 +95,18 @@ int display_poll_events(struct display_context *ctx,
  */
 void display_render_frame(struct display_context *ctx);
 
+/**
+ * The two halves of display_render_frame()
+ *
+ * display_upload_frame() copies the frame buffer to the screen texture and
+ * draws it; display_present() shows the result, waiting for vsync when it
+ * is enabled. Call them separately to time the two apart.
+ *
+ * @param ctx - Display context
+ */
+void display_upload_frame(struct display_context *ctx);
+void display_present(struct display_context *ctx);
+
 /**
  * Check if display is still running
  *
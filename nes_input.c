@@ -1,4 +1,5 @@
 #include "nes_input.h"
+#include "logger.h"
 #include <SDL2/SDL.h>
 #include <stdio.h>
 
@@ -58,6 +59,8 @@ static void nes_input_handler(int sdl_keycode, int is_pressed, void *userdata) {
 
     // Update controller state
     controller_set_button(g_controller1, button, is_pressed);
+    LOG(LOG_INPUT, LOG_LEVEL_DEBUG, "Button %02x %s", button,
+        is_pressed ? "pressed" : "released");
 }
 
 void nes_input_init(struct controller *ctrl) {